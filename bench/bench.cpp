@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <capstone/capstone.h>
+#include "../includes/loader.hpp"
+#include "../includes/output.hpp"
+#include "../includes/linear_disassembler.hpp"
+#include "../includes/disasm_backend.hpp"
+
+/* Settings of benchmark run */
+struct BenchOptions {
+	unsigned	repeat;		/* runs per phase, best run is reported */
+	unsigned	nthreads;	/* disassembly workers */
+	int		load_flags;	/* Binary :: LoadFlags passed to load_binary */
+};
+
+/* FUNCTION: now
+ * INPUT ARGUMENTS: NONE
+ * RETURN VALUE:
+ * 	double : monotonic time in seconds
+ */
+static double
+now() {
+	return std :: chrono :: duration <double> (std :: chrono :: steady_clock :: now().time_since_epoch()).count();
+}
+
+/* FUNCTION: report
+ * INPUT ARGUMENTS:
+ * 	phase	: name of timed phase
+ * 	secs	: best time of phase
+ * 	bytes	: bytes processed by phase
+ * 	items	: items processed by phase (0 to omit)
+ * 	unit	: name of items
+ * RETURN VALUE: NONE
+ */
+static void
+report(const char *phase, double secs, uint64_t bytes, uint64_t items, const char *unit) {
+	printf(" %-10s %10.3f ms %10.1f MB/s", phase, secs * 1e3, bytes / secs / 1e6);
+	if ( items ) printf(" %12.0f %s/s", items / secs, unit);
+	printf("\n");
+}
+
+/* FUNCTION: count_insns
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * 	text	: .text section of binary
+ * PROCESS:
+ * 	a) decode .text without formatting, resyncing one byte past undecodable bytes like disasm()
+ * RETURN VALUE:
+ * 	uint64_t : number of decoded instructions
+ */
+static uint64_t
+count_insns(Binary &bin, Section *text) {
+	DisasmHandle	*h;		/* capstone handle of calling thread */
+	const uint8_t	*code;		/* next byte to decode */
+	size_t		size;		/* bytes left to decode */
+	uint64_t	addr;		/* address of next byte */
+	uint64_t	n;		/* decoded instructions */
+
+	if ( !( h = acquire_handle(bin) ) ) return 0;
+
+	n	= 0;
+	code	= text -> get_bytes();
+	size	= text -> size;
+	addr	= text -> vma;
+	while ( size ) {
+		while ( cs_disasm_iter(h -> dis, &code, &size, &addr, h -> insn) ) ++n;
+		if ( size ) { ++code; --size; ++addr; }
+	}
+
+	return n;
+}
+
+/* FUNCTION: bench
+ * INPUT ARGUMENTS:
+ * 	fname	: binary to be benchmarked
+ * 	opts	: settings of benchmark run
+ * PROCESS:
+ * 	a) time load_binary, keeping loaded binary of last run
+ * 	b) time print_binary_header (header, sections, raw dumps and symbols) into /dev/null
+ * 	c) time decoding of .text alone, giving instruction count
+ * 	d) time disasm into /dev/null
+ * 	e) report best run of each phase
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+static int
+bench(std :: string &fname, BenchOptions &opts) {
+	Binary		bin;		/* binary being benchmarked */
+	Section		*text;		/* .text section */
+	struct stat	st;		/* size of file */
+	uint64_t	sec_bytes;	/* bytes of all sections */
+	uint64_t	ninsns;		/* instructions in .text */
+	double		best[4];	/* best time of each phase */
+	double		t;		/* start of run */
+	int		null_fd;	/* sink of formatted output */
+
+	if ( stat(fname.c_str(), &st) < 0 || ( null_fd = open("/dev/null", O_WRONLY) ) < 0 ) {
+		fprintf(stderr, "[!!] Failed to open '%s'\n", fname.c_str());
+		return -1;
+	}
+	OutputBuffer	sink(null_fd);	/* formatted output is discarded */
+
+	for ( int i = 0; i < 4; ++i ) best[i] = 1e30;
+
+	for ( unsigned r = 0; r < opts.repeat; ++r ) {
+		if ( r ) unload_binary(&bin), bin = Binary();
+		t = now();
+		if ( load_binary(fname, &bin, Binary :: BIN_TYPE_AUTO, opts.load_flags) < 0 ) {
+			close(null_fd);
+			return -1;
+		}
+		best[0] = std :: min(best[0], now() - t);
+	}
+
+	sec_bytes = 0;
+	for ( auto &sec : bin.sections ) sec_bytes += sec.size;
+
+	out = &sink;
+	for ( unsigned r = 0; r < opts.repeat; ++r ) {
+		t = now();
+		print_binary_header(bin);
+		sink.flush();
+		best[1] = std :: min(best[1], now() - t);
+	}
+
+	ninsns = 0;
+	if ( ( text = bin.get_text_section() ) && text -> get_bytes() ) {
+		for ( unsigned r = 0; r < opts.repeat; ++r ) {
+			t = now();
+			ninsns = count_insns(bin, text);
+			best[2] = std :: min(best[2], now() - t);
+		}
+		for ( unsigned r = 0; r < opts.repeat; ++r ) {
+			t = now();
+			disasm(bin, opts.nthreads);
+			sink.flush();
+			best[3] = std :: min(best[3], now() - t);
+		}
+	}
+	out = &stdout_buf;
+
+	printf("[*] %s: %s/%s, %lu sections (%lu bytes), %lu symbols, best of %u runs\n",
+		fname.c_str(), bin.type_str.c_str(), bin.arch_str.c_str(),
+		(unsigned long) bin.sections.size(), (unsigned long) sec_bytes,
+		(unsigned long) bin.symbols.size(), opts.repeat);
+	report("load", best[0], st.st_size, bin.symbols.size(), "symbols");
+	report("header", best[1], sec_bytes, bin.symbols.size(), "symbols");
+	if ( text ) {
+		report("decode", best[2], text -> size, ninsns, "insns");
+		report("disasm", best[3], text -> size, ninsns, "insns");
+	}
+
+	unload_binary(&bin);
+	close(null_fd);
+	return 0;
+}
+
+/* FUNCTION: main
+ * INPUT ARGUMENTS:
+ * 	argc	: count of arguments passed to program
+ * 	argv	: array of arguments passed to program
+ * PROCESS:
+ * 	a) parse settings of benchmark run
+ * 	b) benchmark each binary named on command line
+ * RETURN VALUE:
+ * 	int : status code
+ * 		0 - success
+ * 		1 - failure
+ */
+int
+main(int argc, char **argv) {
+	int		opt;		/* command line option */
+	int		status;		/* failure of any binary */
+	BenchOptions	opts;		/* settings of benchmark run */
+
+	opts.repeat	= 3;
+	opts.nthreads	= 1;
+	opts.load_flags	= Binary :: LOAD_DEFAULT;	/* read all sections while loading */
+
+	while ( ( opt = getopt(argc, argv, "r:j:lmbh") ) != EOF ) {
+		switch ( opt ) {
+			case 'r': opts.repeat	  = std :: max(1ul, strtoul(optarg, NULL, 10));	break;
+			case 'j': opts.nthreads	  = std :: max(1ul, strtoul(optarg, NULL, 10));	break;
+			case 'l': opts.load_flags |= Binary :: LOAD_LAZY;			break;
+			case 'm': opts.load_flags |= Binary :: LOAD_MMAP;			break;
+			case 'b': opts.load_flags |= Binary :: LOAD_BFD;			break;
+			default : optind = argc + 1;						break;
+		}
+	}
+
+	if ( optind >= argc ) {
+		printf("Usage: %s [options] <binary>...\n", argv[0]);
+		printf("\t-r COUNT  \truns per phase, best run is reported (3)\n");
+		printf("\t-j THREADS\tdisassembly workers (1)\n");
+		printf("\t-l        \tload sections lazily, reading them during header printing\n");
+		printf("\t-m        \tmap binary into memory\n");
+		printf("\t-b        \tforce libbfd loader\n");
+		return 1;
+	}
+
+	status = 0;
+	for ( ; optind < argc; ++optind ) {
+		std :: string fname(argv[optind]);
+		if ( bench(fname, opts) < 0 ) status = 1;
+	}
+
+	stdout_buf.flush();
+	return status;
+}
@@ -0,0 +1,328 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <elf.h>
+#include <unistd.h>
+
+#define BASE_ADDR		0x400000	/* virtual address the file is loaded at */
+#define TEXT_OFFSET		0x1000		/* file offset of .text */
+
+/* Parameters of generated binary */
+struct GenOptions {
+	const char	*output;	/* path of generated file */
+	uint64_t	text_size;	/* size of .text in bytes */
+	uint64_t	nsyms;		/* number of function symbols */
+	uint64_t	nsections;	/* number of data sections */
+	uint64_t	data_size;	/* size of each data section in bytes */
+	uint64_t	seed;		/* seed of pseudo random generator */
+};
+
+/* Instruction encodings filling function bodies, all decode as valid x86-64 */
+static const struct { uint8_t len; uint8_t bytes[8]; } insn_table[] = {
+	{ 4, { 0x48, 0x8b, 0x45, 0xf8 } },		/* mov rax, [rbp-8] */
+	{ 4, { 0x48, 0x89, 0x45, 0xf8 } },		/* mov [rbp-8], rax */
+	{ 4, { 0x48, 0x8b, 0x45, 0xf0 } },		/* mov rax, [rbp-0x10] */
+	{ 2, { 0x31, 0xc0 } },				/* xor eax, eax */
+	{ 3, { 0x48, 0x01, 0xd8 } },			/* add rax, rbx */
+	{ 3, { 0x48, 0x39, 0xc3 } },			/* cmp rbx, rax */
+	{ 2, { 0x74, 0x00 } },				/* je +0 */
+	{ 5, { 0xb8, 0x2a, 0x00, 0x00, 0x00 } },	/* mov eax, 0x2a */
+	{ 5, { 0xe8, 0x00, 0x00, 0x00, 0x00 } },	/* call +0 */
+	{ 7, { 0x48, 0x8d, 0x05, 0x10, 0x00, 0x00, 0x00 } },	/* lea rax, [rip+0x10] */
+	{ 5, { 0x0f, 0x1f, 0x44, 0x00, 0x00 } },	/* nop dword [rax+rax] */
+	{ 4, { 0x48, 0x83, 0xc0, 0x01 } },		/* add rax, 1 */
+	{ 3, { 0x48, 0x89, 0xc7 } },			/* mov rdi, rax */
+	{ 2, { 0x0f, 0x05 } },				/* syscall */
+};
+
+/* FUNCTION: next_random
+ * INPUT ARGUMENTS:
+ * 	state	: state of xorshift64 generator
+ * PROCESS:
+ * 	a) advance generator, output only depends on seed so files are reproducible
+ * RETURN VALUE:
+ * 	uint64_t : pseudo random value
+ */
+static uint64_t
+next_random(uint64_t &state) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/* FUNCTION: emit
+ * INPUT ARGUMENTS:
+ * 	buf	: file image
+ * 	p	: bytes to append
+ * 	n	: number of bytes
+ * RETURN VALUE: NONE
+ */
+static void
+emit(std :: vector <uint8_t> &buf, const void *p, size_t n) {
+	buf.insert(buf.end(), (const uint8_t *) p, (const uint8_t *) p + n);
+}
+
+/* FUNCTION: align
+ * INPUT ARGUMENTS:
+ * 	buf	: file image
+ * 	a	: alignment
+ * 	fill	: padding byte
+ * RETURN VALUE: NONE
+ */
+static void
+align(std :: vector <uint8_t> &buf, size_t a, uint8_t fill) {
+	while ( buf.size() % a ) buf.push_back(fill);
+}
+
+/* FUNCTION: add_name
+ * INPUT ARGUMENTS:
+ * 	strtab	: string table
+ * 	name	: string to add
+ * RETURN VALUE:
+ * 	uint32_t : offset of string in table
+ */
+static uint32_t
+add_name(std :: vector <uint8_t> &strtab, const std :: string &name) {
+	uint32_t off = strtab.size();
+	emit(strtab, name.c_str(), name.size() + 1);
+	return off;
+}
+
+/* FUNCTION: generate
+ * INPUT ARGUMENTS:
+ * 	opts	: parameters of generated binary
+ * PROCESS:
+ * 	a) fill .text with functions made of valid instructions, padded with int3
+ * 	b) append data sections of pseudo random bytes
+ * 	c) append symbol table with a function symbol per function and an object symbol
+ * 	   per data section, its string table and the section name string table
+ * 	d) append section headers and write the file
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+static int
+generate(GenOptions &opts) {
+	std :: vector <uint8_t>		img;		/* file image */
+	std :: vector <uint8_t>		strtab;		/* symbol names */
+	std :: vector <uint8_t>		shstrtab;	/* section names */
+	std :: vector <Elf64_Shdr>	shdrs;		/* section headers */
+	std :: vector <Elf64_Sym>	syms;		/* symbol table */
+	Elf64_Ehdr			ehdr;		/* file header */
+	Elf64_Phdr			phdr;		/* single loadable segment */
+	Elf64_Shdr			sh;		/* section header being built */
+	Elf64_Sym			sym;		/* symbol being built */
+	uint64_t			state;		/* pseudo random generator state */
+	uint64_t			fsize;		/* target size of function */
+	uint64_t			start;		/* file offset of function */
+	uint64_t			load_end;	/* end of loaded part of file */
+	uint64_t			text_end;	/* end of .text in file */
+	char				name[64];	/* generated name */
+	FILE				*f;		/* generated file */
+
+	state = opts.seed ? opts.seed : 1;
+	img.resize(TEXT_OFFSET, 0);
+	emit(strtab, "", 1);
+	emit(shstrtab, "", 1);
+
+	memset(&sh, 0, sizeof(sh));
+	shdrs.push_back(sh);			/* null section */
+	memset(&sym, 0, sizeof(sym));
+	syms.push_back(sym);			/* null symbol */
+
+	/* .text: functions of roughly text_size / nsyms bytes each */
+	text_end = TEXT_OFFSET + opts.text_size;
+	fsize	 = opts.nsyms ? opts.text_size / opts.nsyms : opts.text_size;
+	for ( uint64_t i = 0; img.size() < text_end; ++i ) {
+		start = img.size();
+		emit(img, "\x55\x48\x89\xe5", 4);	/* push rbp; mov rbp, rsp */
+		while ( img.size() - start + 2 < fsize / 2 + next_random(state) % ( fsize + 1 ) && img.size() + 16 < text_end ) {
+			const auto &insn = insn_table[next_random(state) % ( sizeof(insn_table) / sizeof(insn_table[0]) )];
+			emit(img, insn.bytes, insn.len);
+		}
+		emit(img, "\x5d\xc3", 2);		/* pop rbp; ret */
+		align(img, 16, 0xcc);
+
+		if ( i < opts.nsyms ) {
+			snprintf(name, sizeof(name), "_ZN5bench9generated8functionILm%luEEvPKcm", (unsigned long) i);
+			memset(&sym, 0, sizeof(sym));
+			sym.st_name	= add_name(strtab, name);
+			sym.st_info	= ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+			sym.st_shndx	= 1;
+			sym.st_value	= BASE_ADDR + start;
+			sym.st_size	= img.size() - start;
+			syms.push_back(sym);
+		}
+	}
+	img.resize(text_end, 0xcc);
+
+	memset(&sh, 0, sizeof(sh));
+	sh.sh_name	= add_name(shstrtab, ".text");
+	sh.sh_type	= SHT_PROGBITS;
+	sh.sh_flags	= SHF_ALLOC | SHF_EXECINSTR;
+	sh.sh_addr	= BASE_ADDR + TEXT_OFFSET;
+	sh.sh_offset	= TEXT_OFFSET;
+	sh.sh_size	= opts.text_size;
+	sh.sh_addralign	= 16;
+	shdrs.push_back(sh);
+
+	/* data sections */
+	for ( uint64_t i = 0; i < opts.nsections; ++i ) {
+		align(img, 16, 0);
+
+		snprintf(name, sizeof(name), ".data.bench%lu", (unsigned long) i);
+		memset(&sh, 0, sizeof(sh));
+		sh.sh_name	= add_name(shstrtab, name);
+		sh.sh_type	= SHT_PROGBITS;
+		sh.sh_flags	= SHF_ALLOC | SHF_WRITE;
+		sh.sh_addr	= BASE_ADDR + img.size();
+		sh.sh_offset	= img.size();
+		sh.sh_size	= opts.data_size;
+		sh.sh_addralign	= 16;
+		shdrs.push_back(sh);
+
+		for ( uint64_t j = 0; j < opts.data_size; ++j )
+			img.push_back(( j & 3 ) ? 0x20 + next_random(state) % 0x5f : next_random(state));
+
+		snprintf(name, sizeof(name), "bench_object_%lu", (unsigned long) i);
+		memset(&sym, 0, sizeof(sym));
+		sym.st_name	= add_name(strtab, name);
+		sym.st_info	= ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+		sym.st_shndx	= shdrs.size() - 1;
+		sym.st_value	= sh.sh_addr;
+		sym.st_size	= sh.sh_size;
+		syms.push_back(sym);
+	}
+	load_end = img.size();
+
+	/* .symtab, .strtab and .shstrtab are not loaded */
+	align(img, 8, 0);
+	memset(&sh, 0, sizeof(sh));
+	sh.sh_name	= add_name(shstrtab, ".symtab");
+	sh.sh_type	= SHT_SYMTAB;
+	sh.sh_offset	= img.size();
+	sh.sh_size	= syms.size() * sizeof(Elf64_Sym);
+	sh.sh_link	= shdrs.size() + 1;	/* .strtab follows */
+	sh.sh_info	= 1;			/* all symbols but the null symbol are global */
+	sh.sh_addralign	= 8;
+	sh.sh_entsize	= sizeof(Elf64_Sym);
+	shdrs.push_back(sh);
+	emit(img, syms.data(), sh.sh_size);
+
+	memset(&sh, 0, sizeof(sh));
+	sh.sh_name	= add_name(shstrtab, ".strtab");
+	sh.sh_type	= SHT_STRTAB;
+	sh.sh_offset	= img.size();
+	sh.sh_size	= strtab.size();
+	sh.sh_addralign	= 1;
+	shdrs.push_back(sh);
+	emit(img, strtab.data(), strtab.size());
+
+	memset(&sh, 0, sizeof(sh));
+	sh.sh_name	= add_name(shstrtab, ".shstrtab");
+	sh.sh_type	= SHT_STRTAB;
+	sh.sh_offset	= img.size();
+	sh.sh_size	= shstrtab.size();
+	sh.sh_addralign	= 1;
+	shdrs.push_back(sh);
+	emit(img, shstrtab.data(), shstrtab.size());
+
+	align(img, 8, 0);
+
+	/* file and program headers */
+	memset(&ehdr, 0, sizeof(ehdr));
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS]	 = ELFCLASS64;
+	ehdr.e_ident[EI_DATA]	 = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_type	 = ET_EXEC;
+	ehdr.e_machine	 = EM_X86_64;
+	ehdr.e_version	 = EV_CURRENT;
+	ehdr.e_entry	 = BASE_ADDR + TEXT_OFFSET;
+	ehdr.e_phoff	 = sizeof(Elf64_Ehdr);
+	ehdr.e_shoff	 = img.size();
+	ehdr.e_ehsize	 = sizeof(Elf64_Ehdr);
+	ehdr.e_phentsize = sizeof(Elf64_Phdr);
+	ehdr.e_phnum	 = 1;
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum	 = shdrs.size();
+	ehdr.e_shstrndx	 = shdrs.size() - 1;
+	memcpy(img.data(), &ehdr, sizeof(ehdr));
+
+	memset(&phdr, 0, sizeof(phdr));
+	phdr.p_type	= PT_LOAD;
+	phdr.p_flags	= PF_R | PF_W | PF_X;
+	phdr.p_vaddr	= phdr.p_paddr = BASE_ADDR;
+	phdr.p_filesz	= phdr.p_memsz = load_end;
+	phdr.p_align	= 0x1000;
+	memcpy(img.data() + sizeof(ehdr), &phdr, sizeof(phdr));
+
+	emit(img, shdrs.data(), shdrs.size() * sizeof(Elf64_Shdr));
+
+	if ( !( f = fopen(opts.output, "wb") ) || fwrite(img.data(), 1, img.size(), f) != img.size() ) {
+		fprintf(stderr, "[!!] Failed to write '%s'\n", opts.output);
+		if ( f ) fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	printf("[*] Generated '%s': %lu bytes, .text %lu bytes, %lu function symbols, %lu data sections\n",
+		opts.output, (unsigned long) img.size(), (unsigned long) opts.text_size,
+		(unsigned long) ( syms.size() - 1 - opts.nsections ), (unsigned long) opts.nsections);
+
+	return 0;
+}
+
+/* FUNCTION: main
+ * INPUT ARGUMENTS:
+ * 	argc	: count of arguments passed to program
+ * 	argv	: array of arguments passed to program
+ * PROCESS:
+ * 	a) parse parameters of generated binary
+ * 	b) generate binary
+ * RETURN VALUE:
+ * 	int : status code
+ * 		0 - success
+ * 		1 - failure
+ */
+int
+main(int argc, char **argv) {
+	int		opt;	/* command line option */
+	GenOptions	opts;	/* parameters of generated binary */
+
+	opts.output	= "bench.elf";
+	opts.text_size	= 16 << 20;
+	opts.nsyms	= 200000;
+	opts.nsections	= 64;
+	opts.data_size	= 256 << 10;
+	opts.seed	= 0x5eed;
+
+	while ( ( opt = getopt(argc, argv, "o:t:n:s:d:r:h") ) != EOF ) {
+		switch ( opt ) {
+			case 'o': opts.output	  = optarg;				break;
+			case 't': opts.text_size  = strtoull(optarg, NULL, 0) << 20;	break;
+			case 'n': opts.nsyms	  = strtoull(optarg, NULL, 0);		break;
+			case 's': opts.nsections  = strtoull(optarg, NULL, 0);		break;
+			case 'd': opts.data_size  = strtoull(optarg, NULL, 0) << 10;	break;
+			case 'r': opts.seed	  = strtoull(optarg, NULL, 0);		break;
+			default:
+				printf("Usage: %s [options]\n", argv[0]);
+				printf("\t-o FILE   \tgenerated file (bench.elf)\n");
+				printf("\t-t MB     \tsize of .text (16)\n");
+				printf("\t-n COUNT  \tnumber of function symbols (200000)\n");
+				printf("\t-s COUNT  \tnumber of data sections (64)\n");
+				printf("\t-d KB     \tsize of each data section (256)\n");
+				printf("\t-r SEED   \tseed, same seed gives same file (0x5eed)\n");
+				return 1;
+		}
+	}
+
+	if ( opts.text_size < 64 ) opts.text_size = 64;
+
+	return generate(opts) < 0 ? 1 : 0;
+}
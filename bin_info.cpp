@@ -1,10 +1,45 @@
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include "includes/loader.hpp"
+#include "includes/linear_disassembler.hpp"
+#include "includes/recursive_disassembler.hpp"
+#include "includes/batch.hpp"
+#include "includes/cache.hpp"
+#include "includes/records.hpp"
+#include "includes/metrics.hpp"
+#include "includes/diff.hpp"
+#include "includes/insn_stats.hpp"
+#include "includes/server.hpp"
+#include "includes/signature.hpp"
+#include "includes/strings.hpp"
 
-extern void disasm(Binary &bin);
+/* Actions and settings requested on the command line */
+struct Options {
+	uint8_t		examine_header;	/* flag to explore binary header structure*/
+	uint8_t		linear_disasm;	/* flag to perform linear disassembly of binary */
+	uint8_t		recursive_disasm;	/* flag to perform recursive descent disassembly of binary */
+	uint8_t		insn_stats;	/* flag to count instructions of code sections */
+	uint8_t		strings;	/* flag to extract printable strings */
+	bool		strings_all;	/* extract strings of all sections, not only data sections */
+	size_t		min_len;	/* shortest string extracted */
+	const char	*target;	/* symbol or address range to disassemble, NULL if none */
+	const char	*diff_with;	/* newer binary to compare with, NULL if not diffing */
+	SignatureSet	*sigs;		/* byte signatures to search for, NULL if not searching */
+	const char	*listen;	/* unix socket to serve queries on, NULL if not serving */
+	const char	*server;	/* unix socket of server to query, NULL if not querying */
+	size_t		cache_size;	/* bytes of loaded binaries kept by server */
+	int		load_flags;	/* options controlling how binary is loaded */
+	unsigned	nthreads;	/* number of threads used for disassembly, or for files in batch */
+	const char	*outdir;	/* directory receiving per-file outputs of a batch */
+	const char	*cache_dir;	/* directory of analysis cache, NULL if not caching */
+	bool		metrics_json;	/* report instrumentation as JSON instead of a table */
+};
+
+static int inspect(std :: string &fname, Options &opts, unsigned nthreads);
+static int compare(std :: string &old_fname, std :: string new_fname, Options &opts);
 void usage(char *);
 
 /* FUNCTION: main
@@ -13,8 +48,13 @@ void usage(char *);
  * 	argv	: array of arguments passed to program
  * PROCESS:
  * 	a) verify if proper number of arguments have been passed
- * 	b) load the binary executable
- * 	f) cleanup
+ * 	b) collect binaries named with -f, read from standard input (-f -) or found below -d
+ * 	c) inspect a single binary directly, using all threads for disassembly
+ * 	d) inspect several binaries as a batch, one binary per thread
+ * 	   (or compare the single binary with the one named with -D)
+ * 	e) report time per phase and counters if requested
+ * 	(or serve queries on the socket named with -L, or send the query given by the
+ * 	remaining arguments to the server named with -Q)
  * RETURN VALUE:
  * 	int : status code
  * 		0 - success
@@ -22,23 +62,127 @@ void usage(char *);
  */
 int
 main(int argc, char **argv) {
-	int		opt;		/* command line option */
-	uint8_t		examine_header;	/* flag to explore binary header structure*/
-	uint8_t		linear_disasm;	/* flag to perform linear disassembly of binary */
-	Binary		bin;		/* program internal representation of binary as an object */
-	std :: string	fname;		/* filename of binary executable to be loaded for inspection */
+	int				opt;		/* command line option */
+	Options				opts;		/* actions and settings requested */
+	std :: vector <std :: string>	files;		/* binaries to be loaded for inspection */
+	bool				batch;		/* inspect files as a batch */
+	SignatureSet			sigs;		/* byte signatures given with -g and -G */
+	int				ret;		/* exit status */
 
-	examine_header	= 0;
-	linear_disasm	= 0;
+	opts.examine_header	= 0;
+	opts.linear_disasm	= 0;
+	opts.recursive_disasm	= 0;
+	opts.insn_stats		= 0;
+	opts.strings		= 0;
+	opts.strings_all	= false;
+	opts.min_len		= STRINGS_MIN_LEN;
+	opts.target		= NULL;
+	opts.diff_with		= NULL;
+	opts.sigs		= NULL;
+	opts.listen		= NULL;
+	opts.server		= NULL;
+	opts.cache_size		= SERVER_CACHE_SIZE;
+	opts.load_flags		= Binary :: LOAD_LAZY;	/* only sections actually inspected are read */
+	opts.nthreads		= 1;
+	opts.outdir		= NULL;
+	opts.cache_dir		= NULL;
+	opts.metrics_json	= false;
+	batch			= false;
 	
-	while( (opt = getopt(argc, argv, "f:xlh")) != EOF) {
+	while( (opt = getopt(argc, argv, "f:d:o:C:O:T::t::n:s:D:L:Q:M:g:G:xlrSmbj:h")) != EOF) {
 		switch(opt) {
 			case 'f':
-				fname.assign(optarg);	break;
+				if ( !strcmp(optarg, "-") ) {
+					read_file_list(stdin, files);
+					batch = true;
+				} else {
+					files.push_back(optarg);
+				}
+				break;
+			case 'd':
+				if ( collect_files(optarg, files) < 0 ) return 1;
+				batch = true;
+				break;
+			case 'o':
+				opts.outdir = optarg;
+				batch = true;
+				break;
+			case 'C':
+				opts.cache_dir = optarg;	break;
+			case 'O':
+				if ( !strcmp(optarg, "text") ) {
+					out_format = OutputBuffer :: FMT_TEXT;
+				} else if ( !strcmp(optarg, "jsonl") ) {
+					out_format = OutputBuffer :: FMT_JSONL;
+				} else if ( !strcmp(optarg, "bin") ) {
+					out_format = OutputBuffer :: FMT_BIN;
+				} else {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'T':
+				if ( optarg && strcmp(optarg, "json") ) {
+					usage(argv[0]);
+					return 1;
+				}
+				metrics.enabled		= true;
+				opts.metrics_json	= optarg != NULL;
+				break;
+			case 't':
+				if ( optarg && strcmp(optarg, "all") ) {
+					usage(argv[0]);
+					return 1;
+				}
+				opts.strings		= 1;
+				opts.strings_all	= optarg != NULL;
+				break;
+			case 'n':
+				if ( ( opts.min_len = strtoul(optarg, NULL, 10) ) == 0 ) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
+			case 's':
+				opts.target = optarg;		break;
+			case 'D':
+				opts.diff_with = optarg;	break;
+			case 'g':
+				if ( sigs.add(optarg) < 0 ) return 1;
+				opts.sigs = &sigs;
+				break;
+			case 'G':
+				if ( sigs.add_file(optarg) < 0 ) return 1;
+				opts.sigs = &sigs;
+				break;
+			case 'L':
+				opts.listen = optarg;		break;
+			case 'Q':
+				opts.server = optarg;		break;
+			case 'M':
+				if ( ( opts.cache_size = strtoull(optarg, NULL, 10) << 20 ) == 0 ) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
 			case 'x':
-				examine_header = 1;	break;
+				opts.examine_header = 1;	break;
 			case 'l':
-				linear_disasm = 1;	break;
+				opts.linear_disasm = 1;		break;
+			case 'r':
+				opts.recursive_disasm = 1;	break;
+			case 'S':
+				opts.insn_stats = 1;		break;
+			case 'm':
+				opts.load_flags |= Binary :: LOAD_MMAP;	break;
+			case 'b':
+				opts.load_flags |= Binary :: LOAD_BFD;	break;
+			case 'j':
+				if ( ( opts.nthreads = strtoul(optarg, NULL, 10) ) == 0 ) {
+					usage(argv[0]);
+					return -1;
+				}
+				break;
 			case 'h':
 			case '?':
 			default:
@@ -47,19 +191,151 @@ main(int argc, char **argv) {
 		}
 	}
 
+	if ( opts.sigs ) sigs.compile();
+
+	if ( opts.listen )
+		return serve(opts.listen, opts.nthreads, opts.cache_size, opts.load_flags) < 0 ? 1 : 0;
+
+	if ( opts.server ) {
+		if ( argc - optind < 2 ) {
+			usage(argv[0]);
+			return -1;
+		}
+		return query(opts.server, argc - optind, argv + optind) < 0 ? 1 : 0;
+	}
+
+	if ( files.empty() ) {
+		if ( batch ) return 0;		/* empty directory or list */
+		usage(argv[0]);
+		return -1;
+	}
+
+	if ( opts.diff_with ) {
+		if ( batch || files.size() != 1 ) {
+			usage(argv[0]);
+			return -1;
+		}
+		ret = compare(files[0], opts.diff_with, opts) < 0 ? 1 : 0;
+	} else if ( !batch && files.size() == 1 ) {
+		ret = inspect(files[0], opts, opts.nthreads) < 0 ? 1 : 0;
+	} else {
+		ret = run_batch(files, opts.nthreads, opts.outdir, [&](std :: string &fname) {
+			return inspect(fname, opts, 1) < 0 ? 1 : 0;
+		}) ? 1 : 0;
+	}
+
+	/* output written so far counts, report goes to stderr to keep output clean */
+	if ( metrics.enabled ) {
+		stdout_buf.flush();
+		metrics.report(stderr, opts.metrics_json);
+	}
+
+	return ret;
+}
+
+/* FUNCTION: inspect
+ * INPUT ARGUMENTS:
+ * 	fname	: filename of binary executable to be loaded for inspection
+ * 	opts	: actions and settings requested
+ * 	nthreads: number of threads used for disassembly
+ * PROCESS:
+ * 	a) load the binary executable, from the analysis cache if it holds an entry for it
+ * 	b) perform requested actions, replaying cached disassembly if present, otherwise
+ * 	   recording it when caching
+ * 	c) store cache entry if it was missing or disassembly was added
+ * 	d) cleanup
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+static int
+inspect(std :: string &fname, Options &opts, unsigned nthreads) {
+	Binary		bin;		/* program internal representation of binary as an object */
+	CacheEntry	cached;		/* cache file the binary was loaded from */
+	OutputBuffer	log(-1, 0);	/* instruction records to be cached */
+	bool		store;		/* cache entry is to be written */
+	int		ret;		/* status code */
 
-	if ( load_binary(fname, &bin, Binary :: BIN_TYPE_AUTO) < 0 ) {
-		return 1;
+	store = false;
+	if ( !opts.cache_dir || cache_load(opts.cache_dir, fname, &bin, &cached, opts.load_flags) != 0 ) {
+		if ( load_binary(fname, &bin, Binary :: BIN_TYPE_AUTO, opts.load_flags) < 0 ) {
+			unload_binary(&bin);
+			return -1;
+		}
+		store = opts.cache_dir != NULL;
 	}
 
-	if ( examine_header )
+	ret = 0;
+	if ( out_format != OutputBuffer :: FMT_TEXT )
+		emit_binary(*out, bin);
+	if ( opts.examine_header )
 		print_binary_header(bin);
-	if ( linear_disasm )
-		disasm(bin);
+	if ( opts.linear_disasm ) {
+		if ( cached.insns ) {
+			ret = disasm_replay(bin, cached.insns, cached.insns_size);
+		} else if ( opts.cache_dir ) {
+			/* recording runs on a single thread, later runs replay it */
+			ret = disasm(bin, nthreads, &log);
+			store = true;
+		} else {
+			ret = disasm(bin, nthreads);
+		}
+	}
+	if ( opts.recursive_disasm && ret == 0 )
+		ret = disasm_recursive(bin, nthreads);
+	if ( opts.target && ret == 0 )
+		ret = disasm_target(bin, opts.target);
+	if ( opts.insn_stats && ret == 0 )
+		ret = disasm_stats(bin, nthreads);
+	if ( opts.sigs && ret == 0 )
+		ret = search_signatures(bin, *opts.sigs, nthreads);
+	if ( opts.strings && ret == 0 )
+		ret = extract_strings(bin, opts.min_len, opts.strings_all, nthreads);
+
+	if ( store && ret == 0 )
+		cache_store(opts.cache_dir, fname, bin, log.size() ? &log : NULL, opts.load_flags);
 
 	unload_binary(&bin);
 
-	return 0;
+	return ret;
+}
+
+/* FUNCTION: compare
+ * INPUT ARGUMENTS:
+ * 	old_fname: filename of older binary
+ * 	new_fname: filename of newer binary
+ * 	opts	: actions and settings requested
+ * PROCESS:
+ * 	a) load both binaries (the analysis cache is not consulted)
+ * 	b) compare them, hashing on all threads
+ * 	c) cleanup
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+static int
+compare(std :: string &old_fname, std :: string new_fname, Options &opts) {
+	Binary		a, b;		/* older and newer binary */
+	int		ret;		/* status code */
+
+	if ( load_binary(old_fname, &a, Binary :: BIN_TYPE_AUTO, opts.load_flags) < 0 ) return -1;
+	if ( load_binary(new_fname, &b, Binary :: BIN_TYPE_AUTO, opts.load_flags) < 0 ) {
+		unload_binary(&a);
+		return -1;
+	}
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_binary(*out, a);
+		emit_binary(*out, b);
+	}
+	ret = diff_binaries(a, b, opts.nthreads);
+
+	unload_binary(&b);
+	unload_binary(&a);
+
+	return ret;
 }
 
 /* FUNCTION: usage
@@ -72,8 +348,26 @@ main(int argc, char **argv) {
 void usage(char *program) {
 	printf("Usage: %s [options] <binary>\n", program);
 	printf("Options:\n");
-	printf("\t-f FILENAME\t\tpass file name\n");
+	printf("\t-f FILENAME\t\tpass file name (repeatable, '-' reads names from standard input)\n");
+	printf("\t-d DIRECTORY\t\tinspect every file below directory\n");
+	printf("\t-o DIRECTORY\t\twrite output of each file of a batch to its own file\n");
 	printf("\t-x         \t\textract binary header information\n");
 	printf("\t-l         \t\tperform linear disassembly\n");
+	printf("\t-r         \t\tperform recursive descent disassembly from entry point and functions\n");
+	printf("\t-S         \t\tcount instructions of code sections by class, length and mnemonic\n");
+	printf("\t-s TARGET  \t\tdisassemble only symbol TARGET, or address range START:END\n");
+	printf("\t-t[all]    \t\textract ASCII and UTF-16LE strings of data sections (of all sections)\n");
+	printf("\t-n LENGTH  \t\tshortest string extracted (default 4)\n");
+	printf("\t-g PATTERN \t\tsearch all sections for hex byte PATTERN, '?' matching any nibble (repeatable)\n");
+	printf("\t-G FILENAME\t\tsearch all sections for patterns listed in FILENAME, one per line\n");
+	printf("\t-D FILENAME\t\tcompare binary with newer FILENAME, disassembling changed functions\n");
+	printf("\t-L SOCKET  \t\tserve queries on unix SOCKET from binaries kept loaded, one per thread\n");
+	printf("\t-M MEGABYTES\t\tmemory budget of binaries kept loaded by server (default 1024)\n");
+	printf("\t-Q SOCKET  \t\tsend query 'header|linear|stats PATH', 'symbol ADDR PATH' or 'disasm TARGET PATH' to server\n");
+	printf("\t-m         \t\tmap binary and reference section contents in place (libbfd loads, native ELF loads always do)\n");
+	printf("\t-b         \t\tload ELF files through libbfd instead of native loader\n");
+	printf("\t-j THREADS \t\tnumber of threads used for disassembly, or for files in a batch\n");
+	printf("\t-C DIRECTORY\t\tcache loaded sections, symbols and disassembly in directory\n");
+	printf("\t-O FORMAT  \t\toutput format: text (default), jsonl or bin\n");
+	printf("\t-T[json]   \t\treport time per phase, counters and peak memory on stderr\n");
 }
-
@@ -1,100 +1,101 @@
 #include "ansi_colors.hpp"
+#include "output.hpp"
 
 /* set ansi color to black */
-void black() { printf(BLK); }
+void black() { out -> lit(BLK); }
 
 /* set ansi color to red */
-void red() { printf(RED); }
+void red() { out -> lit(RED); }
 
 /* set ansi color to green */
-void green() { printf(GRN); }
+void green() { out -> lit(GRN); }
 
 /* set ansi color to yellow */
-void yellow() { printf(YLW); }
+void yellow() { out -> lit(YLW); }
 
 /* set ansi color to blue */
-void blue() { printf(BLU); }
+void blue() { out -> lit(BLU); }
 
 /* set ansi color to magenta */
-void magenta() { printf(MAG); }
+void magenta() { out -> lit(MAG); }
 
 /* set ansi color to cyan */
-void cyan() { printf(CYN); }
+void cyan() { out -> lit(CYN); }
 
 /* set ansi color to white */
-void white() { printf(WHT); }
+void white() { out -> lit(WHT); }
 
 /* set ansi color to bold black */
-void bold_black() { printf(BBLK); }
+void bold_black() { out -> lit(BBLK); }
 
 /* set ansi color to bold red */
-void bold_red() { printf(BRED); }
+void bold_red() { out -> lit(BRED); }
 
 /* set ansi color to bold green */
-void bold_green() { printf(BGRN); }
+void bold_green() { out -> lit(BGRN); }
 
 /* set ansi color to bold yellow */
-void bold_yellow() { printf(BYLW); }
+void bold_yellow() { out -> lit(BYLW); }
 
 /* set ansi color to bold blue */
-void bold_blue() { printf(BBLU); }
+void bold_blue() { out -> lit(BBLU); }
 
 /* set ansi color to bold magenta */
-void bold_magenta() { printf(BMAG); }
+void bold_magenta() { out -> lit(BMAG); }
 
 /* set ansi color to bold cyan */
-void bold_cyan() { printf(BCYN); }
+void bold_cyan() { out -> lit(BCYN); }
 
 /* set ansi color to bold white */
-void bold_white() { printf(BWHT); }
+void bold_white() { out -> lit(BWHT); }
 
 /* set ansi color to underlined black */
-void underlined_black() { printf(UBLK); }
+void underlined_black() { out -> lit(UBLK); }
 
 /* set ansi color to underlined red */
-void underlined_red() { printf(URED); }
+void underlined_red() { out -> lit(URED); }
 
 /* set ansi color to underlined green */
-void underlined_green() { printf(UGRN); }
+void underlined_green() { out -> lit(UGRN); }
 
 /* set ansi color to underlined yellow */
-void underlined_yellow() { printf(UYLW); }
+void underlined_yellow() { out -> lit(UYLW); }
 
 /* set ansi color to underlined blue */
-void underlined_blue() { printf(UBLU); }
+void underlined_blue() { out -> lit(UBLU); }
 
 /* set ansi color to underlined magenta */
-void underlined_magenta() { printf(UMAG); }
+void underlined_magenta() { out -> lit(UMAG); }
 
 /* set ansi color to underlined cyan */
-void underlined_cyan() { printf(UCYN); }
+void underlined_cyan() { out -> lit(UCYN); }
 
 /* set ansi color to underlined white */
-void underlined_white() { printf(UWHT); }
+void underlined_white() { out -> lit(UWHT); }
 
 /* set ansi color to background black */
-void black_background() { printf(BLKB); }
+void black_background() { out -> lit(BLKB); }
 
 /* set ansi color to background red */
-void red_background() { printf(REDB); }
+void red_background() { out -> lit(REDB); }
 
 /* set ansi color to background green */
-void green_background() { printf(GRNB); }
+void green_background() { out -> lit(GRNB); }
 
 /* set ansi color to background yellow */
-void yellow_background() { printf(YLWB); }
+void yellow_background() { out -> lit(YLWB); }
 
 /* set ansi color to background blue */
-void blue_background() { printf(BLUB); }
+void blue_background() { out -> lit(BLUB); }
 
 /* set ansi color to background magenta */
-void magenta_background() { printf(MAGB); }
+void magenta_background() { out -> lit(MAGB); }
 
 /* set ansi color to background cyan */
-void cyan_background() { printf(CYNB); }
+void cyan_background() { out -> lit(CYNB); }
 
 /* set ansi color to background white */
-void white_background() { printf(WHTB); }
+void white_background() { out -> lit(WHTB); }
 
 /* reset ansi color to default */
-void reset_color() { printf(RESET); }
+void reset_color() { out -> lit(RESET); }
@@ -0,0 +1,178 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "batch.hpp"
+#include "output.hpp"
+#include "loader.hpp"
+
+/* FUNCTION: collect_files
+ * INPUT ARGUMENTS:
+ * 	dir	: directory to walk
+ * 	files	: receives paths of regular files
+ * PROCESS:
+ * 	a) read entries of directory, skipping '.' and '..'
+ * 	b) descend into sub-directories (symbolic links are not followed)
+ * 	c) append regular files
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - success
+ * 		-1 - directory could not be read
+ */
+int
+collect_files(const std :: string &dir, std :: vector <std :: string> &files) {
+	DIR		*d;		/* open directory */
+	struct dirent	*ent;		/* directory entry */
+	struct stat	st;		/* status of entry */
+	std :: string	path;		/* path of entry */
+
+	if ( !( d = opendir(dir.c_str()) ) ) {
+		fprintf(stderr, "[!!] Failed to read directory '%s' (%s)\n", dir.c_str(), strerror(errno));
+		return -1;
+	}
+
+	while ( ( ent = readdir(d) ) ) {
+		if ( !strcmp(ent -> d_name, ".") || !strcmp(ent -> d_name, "..") ) continue;
+
+		path = dir + "/" + ent -> d_name;
+		if ( lstat(path.c_str(), &st) < 0 ) continue;
+
+		if ( S_ISDIR(st.st_mode) )
+			collect_files(path, files);
+		else if ( S_ISREG(st.st_mode) )
+			files.push_back(path);
+	}
+
+	closedir(d);
+
+	return 0;
+}
+
+/* FUNCTION: read_file_list
+ * INPUT ARGUMENTS:
+ * 	in	: stream to read paths from
+ * 	files	: receives paths
+ * PROCESS:
+ * 	a) read lines, stripping line terminators and skipping empty lines
+ * RETURN VALUE: NONE
+ */
+void
+read_file_list(FILE *in, std :: vector <std :: string> &files) {
+	char	*line;		/* line read from stream */
+	size_t	cap;		/* capacity of 'line' */
+	ssize_t	n;		/* length of line */
+
+	line = NULL;
+	cap  = 0;
+
+	while ( ( n = getline(&line, &cap, in) ) >= 0 ) {
+		while ( n > 0 && ( line[n - 1] == '\n' || line[n - 1] == '\r' ) ) line[--n] = '\0';
+		if ( n > 0 ) files.push_back(std :: string(line, n));
+	}
+
+	free(line);
+}
+
+/* FUNCTION: output_path
+ * INPUT ARGUMENTS:
+ * 	outdir	: directory receiving per-file outputs
+ * 	fname	: path of analyzed file
+ * PROCESS:
+ * 	a) flatten path of analyzed file into a single file name, keeping its end
+ * 	   (the file's own name) when too long to fit NAME_MAX with the suffix
+ * 	b) append FNV-1a hash of the path, flattening alone maps 'a/b_c' and 'a_b/c'
+ * 	   to the same name
+ * RETURN VALUE:
+ * 	std :: string : path of output file
+ */
+static std :: string
+output_path(const char *outdir, const std :: string &fname) {
+	std :: string	name;		/* flattened file name */
+	char		suffix[32];	/* hash of path and extension */
+	size_t		max;		/* longest flattened name */
+
+	snprintf(suffix, sizeof(suffix), "-%016llx.txt", (unsigned long long) CStrHash()(fname.c_str()));
+	max = NAME_MAX - strlen(suffix);
+
+	for ( auto c : fname ) name += ( c == '/' ) ? '_' : c;
+	if ( name.size() > max ) name.erase(0, name.size() - max);
+
+	return std :: string(outdir) + "/" + name + suffix;
+}
+
+/* FUNCTION: run_batch
+ * INPUT ARGUMENTS:
+ * 	files	: paths of binaries to analyze
+ * 	nthreads: number of workers
+ * 	outdir	: directory receiving per-file outputs, NULL for standard output
+ * 	job	: analysis done for each file
+ * PROCESS:
+ * 	a) start workers taking files in turn
+ * 	b) each worker points its output at a buffer of its own for the duration of a file,
+ * 	   either capturing it in memory or writing to the file's output file
+ * 	c) captured output of a finished file is written to standard output in one piece
+ * RETURN VALUE:
+ * 	int : number of files that failed
+ */
+int
+run_batch(std :: vector <std :: string> &files, unsigned nthreads, const char *outdir, BatchJob job) {
+	std :: atomic <size_t>		next;		/* next file to analyze */
+	std :: atomic <int>		failed;		/* number of failed files */
+	std :: mutex			lock;		/* serializes writes to standard output */
+	std :: vector <std :: thread>	workers;	/* analyzing threads */
+
+	next	= 0;
+	failed	= 0;
+
+	/* anything already buffered goes first */
+	stdout_buf.flush();
+
+	if ( nthreads > files.size() ) nthreads = files.size();
+
+	for ( unsigned t = 0; t < nthreads; ++t ) {
+		workers.push_back(std :: thread([&]() {
+			size_t		i;	/* file being analyzed */
+			int		fd;	/* output file of file being analyzed */
+			std :: string	path;	/* path of output file */
+
+			while ( ( i = next++ ) < files.size() ) {
+				fd = -1;
+				if ( outdir ) {
+					path = output_path(outdir, files[i]);
+					if ( ( fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) ) < 0 ) {
+						fprintf(stderr, "[!!] Failed to create '%s' (%s)\n", path.c_str(), strerror(errno));
+						++failed;
+						continue;
+					}
+				}
+
+				{
+					OutputBuffer	buf(fd);	/* output of this file */
+
+					out = &buf;
+					if ( job(files[i]) ) ++failed;
+					out = &stdout_buf;
+
+					if ( fd < 0 ) {
+						std :: lock_guard <std :: mutex> g(lock);
+						stdout_buf.write(buf.data(), buf.size());
+						stdout_buf.flush();
+					}
+				}
+
+				if ( fd >= 0 ) close(fd);
+			}
+		}));
+	}
+
+	for ( auto &w : workers ) w.join();
+
+	return failed;
+}
@@ -0,0 +1,23 @@
+#ifndef BIN_BATCH_H
+#define BIN_BATCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+
+/* Work done for a single file of a batch, returns non-zero on failure */
+typedef std :: function <int (std :: string &fname)> BatchJob;
+
+/* Append regular files found below 'dir' to 'files' */
+int collect_files(const std :: string &dir, std :: vector <std :: string> &files);
+
+/* Append paths read from 'in', one per line, to 'files' */
+void read_file_list(FILE *in, std :: vector <std :: string> &files);
+
+/* Run 'job' on every file with 'nthreads' workers, output of each file stays contiguous
+ * on standard output or goes to its own file in 'outdir' (if not NULL)
+ */
+int run_batch(std :: vector <std :: string> &files, unsigned nthreads, const char *outdir, BatchJob job);
+
+#endif /* BIN_BATCH_H */
@@ -0,0 +1,443 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.hpp"
+
+#define CACHE_SEC_NONE		0	/* section contents not retrievable */
+#define CACHE_SEC_FILE		1	/* section contents stored verbatim at file offset */
+#define CACHE_SEC_ZERO		2	/* section contents are all zero */
+
+/* Fixed part of a cache file, followed by canonical path of binary (padded to 8 bytes),
+ * section and symbol records, string table and instruction records */
+struct CacheHeader {
+	char		magic[8];	/* CACHE_MAGIC */
+	uint64_t	file_size;	/* identity of binary when cached */
+	int64_t		mtime_sec;
+	int64_t		mtime_nsec;
+	uint64_t	ino;
+	uint64_t	dev;
+	uint64_t	entry;		/* entry point of binary */
+	uint32_t	type;		/* Binary :: BinaryType */
+	uint32_t	arch;		/* Binary :: BinaryArch */
+	uint32_t	bits;
+	uint32_t	path_len;	/* length of canonical path */
+	uint32_t	type_str;	/* offset of type string in string table */
+	uint32_t	arch_str;	/* offset of architecture string in string table */
+	uint32_t	loader;		/* Binary :: LOAD_BFD if loaded through libbfd, else 0 */
+	uint32_t	pad;
+	uint64_t	nsections;
+	uint64_t	nsymbols;
+	uint64_t	strs_size;	/* bytes of string table */
+	uint64_t	insns_size;	/* bytes of instruction records, 0 if not cached */
+};
+
+struct CacheSection {
+	uint64_t	vma;
+	uint64_t	size;
+	uint64_t	filepos;
+	uint32_t	name;		/* offset of name in string table */
+	uint8_t		type;		/* Section :: SectionType */
+	uint8_t		contents;	/* CACHE_SEC_* */
+	uint8_t		pad[2];
+};
+
+struct CacheSymbol {
+	uint64_t	addr;
+	uint32_t	name;		/* offset of name in string table */
+	uint8_t		type;		/* Symbol :: SymbolType flags */
+	uint8_t		source;		/* Symbol :: SymbolSource flags */
+	uint8_t		pad[2];
+};
+
+#define PAD8(n)			( ( (n) + 7 ) & ~(uint64_t) 7 )
+
+static std :: atomic <unsigned>	tmp_seq;	/* distinguishes temporary files of concurrent stores */
+
+/* FUNCTION: CacheEntry :: release
+ * PROCESS:
+ * 	a) unmap cache file, invalidating instruction records
+ * RETURN VALUE: NONE
+ */
+void
+CacheEntry :: release() {
+	if ( map ) munmap(map, size);
+	map		= NULL;
+	size		= 0;
+	insns		= NULL;
+	insns_size	= 0;
+}
+
+/* FUNCTION: cache_path
+ * INPUT ARGUMENTS:
+ * 	dir	: cache directory
+ * 	fname	: name of binary file
+ * 	loader	: Binary :: LOAD_BFD if loaded through libbfd, else 0
+ * 	real	: receives canonical path of binary (PATH_MAX bytes)
+ * 	st	: receives identity of binary
+ * 	path	: receives path of cache file
+ * PROCESS:
+ * 	a) resolve canonical path of binary and its size, modification time and inode
+ * 	b) name cache file after FNV-1a hash of canonical path, results of each loader
+ * 	   are kept apart
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - binary not found
+ */
+static int
+cache_path(const char *dir, std :: string &fname, uint32_t loader, char *real, struct stat *st, std :: string &path) {
+	char	name[32];	/* file name of cache entry */
+
+	if ( !realpath(fname.c_str(), real) || stat(real, st) < 0 ) return -1;
+
+	snprintf(name, sizeof(name), "/%016llx%s.bic", (unsigned long long) CStrHash()(real),
+		 loader ? ".bfd" : "");
+	path = std :: string(dir) + name;
+
+	return 0;
+}
+
+/* FUNCTION: add_string
+ * INPUT ARGUMENTS:
+ * 	strs	: string table being built
+ * 	s	: string to add
+ * 	off	: receives offset of string
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - string table too large
+ */
+static int
+add_string(OutputBuffer &strs, const char *s, uint32_t *off) {
+	size_t	n = strlen(s) + 1;
+
+	if ( strs.size() + n > UINT32_MAX ) return -1;
+	*off = strs.size();
+	strs.write(s, n);
+	return 0;
+}
+
+/* FUNCTION: write_all
+ * INPUT ARGUMENTS:
+ * 	fd	: destination file descriptor
+ * 	p	: bytes to write
+ * 	n	: number of bytes
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - write failed
+ */
+static int
+write_all(int fd, const void *p, size_t n) {
+	const char	*c = (const char *) p;
+	ssize_t		w;
+
+	while ( n ) {
+		if ( ( w = write(fd, c, n) ) < 0 ) {
+			if ( errno == EINTR ) continue;
+			return -1;
+		}
+		c += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/* FUNCTION: cache_store
+ * INPUT ARGUMENTS:
+ * 	dir	: cache directory, created if missing
+ * 	fname	: name of binary file
+ * 	bin	: loaded binary
+ * 	log	: instruction records made by disasm(), NULL if none
+ * 	flags	: Binary :: LoadFlags 'bin' was loaded with
+ * PROCESS:
+ * 	a) record whether contents of every section can be read back from the file (or
+ * 	   are all zero), asking the loader so contents are not retrieved for it
+ * 	b) where the loader cannot tell, retrieve contents and compare them with the
+ * 	   mapped file (mapped here unless 'bin' is), binaries whose sections were
+ * 	   changed while loading (e.g. relocated) are not cached
+ * 	c) build section and symbol records and string table
+ * 	d) write cache file under a temporary name and rename it into place
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - stored
+ * 		-1 - not cacheable or failed to write
+ */
+int
+cache_store(const char *dir, std :: string &fname, Binary &bin, OutputBuffer *log, int flags) {
+	char				real[PATH_MAX];	/* canonical path of binary */
+	struct stat			st;		/* identity of binary */
+	std :: string			path, tmp;	/* cache file and its temporary name */
+	Binary				file;		/* mapping of binary, if 'bin' has none */
+	const uint8_t			*map;		/* contents of binary file */
+	uint64_t			map_size;	/* size of binary file */
+	std :: vector <CacheSection>	secs;		/* section records */
+	std :: vector <CacheSymbol>	syms;		/* symbol records */
+	OutputBuffer			head(-1);	/* header, path and records */
+	OutputBuffer			strs(-1);	/* string table */
+	CacheHeader			hdr;		/* fixed part of cache file */
+	uint8_t				*bytes;		/* contents of section */
+	int				fd;		/* temporary cache file */
+	int				ret;
+
+	fd  = -1;
+	ret = -1;
+
+	if ( cache_path(dir, fname, flags & Binary :: LOAD_BFD, real, &st, path) < 0 ) return -1;
+
+	map	 = bin.map;
+	map_size = bin.map_size;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.file_size	= st.st_size;
+	hdr.mtime_sec	= st.st_mtim.tv_sec;
+	hdr.mtime_nsec	= st.st_mtim.tv_nsec;
+	hdr.ino		= st.st_ino;
+	hdr.dev		= st.st_dev;
+	hdr.entry	= bin.entry;
+	hdr.type	= bin.type;
+	hdr.arch	= bin.arch;
+	hdr.bits	= bin.bits;
+	hdr.path_len	= strlen(real);
+	hdr.loader	= flags & Binary :: LOAD_BFD;
+	if ( add_string(strs, bin.type_str.c_str(), &hdr.type_str) < 0
+	     || add_string(strs, bin.arch_str.c_str(), &hdr.arch_str) < 0 )
+		goto cleanup;
+
+	secs.resize(bin.sections.size());
+	for ( size_t i = 0; i < bin.sections.size(); ++i ) {
+		Section		&sec = bin.sections[i];
+		CacheSection	&rec = secs[i];
+
+		memset(&rec, 0, sizeof(rec));
+		rec.vma		= sec.vma;
+		rec.size	= sec.size;
+		rec.filepos	= sec.filepos;
+		rec.type	= sec.type;
+		rec.contents	= CACHE_SEC_NONE;
+		if ( add_string(strs, sec.name.c_str(), &rec.name) < 0 ) goto cleanup;
+
+		switch ( section_in_file(&sec, st.st_size) ) {
+			case 1:
+				rec.contents = CACHE_SEC_FILE;
+				continue;
+			case 0:
+				rec.contents = CACHE_SEC_ZERO;
+				continue;
+		}
+
+		if ( !( bytes = sec.get_bytes() ) ) continue;
+
+		if ( !map ) {
+			if ( map_binary(fname, &file) < 0 ) goto cleanup;
+			map	 = file.map;
+			map_size = file.map_size;
+		}
+
+		if ( sec.filepos <= map_size && sec.size <= map_size - sec.filepos
+		     && ( bytes == map + sec.filepos || !memcmp(bytes, map + sec.filepos, sec.size) ) ) {
+			rec.contents = CACHE_SEC_FILE;
+		} else {
+			for ( uint64_t j = 0; j < sec.size; ++j )
+				if ( bytes[j] ) goto cleanup;	/* contents exist only in memory */
+			rec.contents = CACHE_SEC_ZERO;
+		}
+	}
+
+	syms.resize(bin.symbols.size());
+	for ( size_t i = 0; i < bin.symbols.size(); ++i ) {
+		memset(&syms[i], 0, sizeof(syms[i]));
+		syms[i].addr	= bin.symbols[i].addr;
+		syms[i].type	= bin.symbols[i].type;
+		syms[i].source	= bin.symbols[i].source;
+		if ( add_string(strs, bin.symbols[i].name, &syms[i].name) < 0 ) goto cleanup;
+	}
+
+	hdr.nsections	= secs.size();
+	hdr.nsymbols	= syms.size();
+	hdr.strs_size	= strs.size();
+	hdr.insns_size	= log ? log -> size() : 0;
+
+	head.write((const char *) &hdr, sizeof(hdr));
+	head.write(real, hdr.path_len);
+	for ( uint64_t i = hdr.path_len; i < PAD8(hdr.path_len); ++i ) head.put('\0');
+	head.write((const char *) secs.data(), secs.size() * sizeof(CacheSection));
+	head.write((const char *) syms.data(), syms.size() * sizeof(CacheSymbol));
+
+	mkdir(dir, 0777);	/* may already exist */
+	tmp = path + ".tmp." + std :: to_string(getpid()) + "." + std :: to_string(tmp_seq++);
+	if ( ( fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) ) < 0 ) goto cleanup;
+
+	if ( write_all(fd, head.data(), head.size()) < 0 || write_all(fd, strs.data(), strs.size()) < 0
+	     || ( log && write_all(fd, log -> data(), log -> size()) < 0 ) ) {
+		unlink(tmp.c_str());
+		goto cleanup;
+	}
+
+	/* readers see either the previous entry or the complete new one */
+	if ( close(fd) < 0 || rename(tmp.c_str(), path.c_str()) < 0 ) {
+		fd = -1;
+		unlink(tmp.c_str());
+		goto cleanup;
+	}
+	fd  = -1;
+	ret = 0;
+
+	cleanup:
+		if ( fd >= 0 ) close(fd);
+		unload_binary(&file);
+
+	return ret;
+}
+
+/* FUNCTION: cache_load
+ * INPUT ARGUMENTS:
+ * 	dir	: cache directory
+ * 	fname	: name of binary file
+ * 	bin	: binary's object (program internal representation)
+ * 	entry	: receives mapping of cache file and instruction records (if cached)
+ * 	flags	: Binary :: LoadFlags the binary would be loaded with
+ * PROCESS:
+ * 	a) map cache file named after canonical path of binary and loader
+ * 	b) check it was made by the same loader from a binary of same path, size,
+ * 	   modification time and inode
+ * 	c) check all records lie within cache file
+ * 	d) map binary file, sections point into it or are zero filled
+ * 	e) copy string table into string arena of binary in one piece, rebuild sections,
+ * 	   symbols and indexes
+ * RETURN VALUE:
+ * 	int : status code
+ * 		0 - loaded from cache
+ * 		1 - no usable entry, 'bin' is left empty
+ */
+int
+cache_load(const char *dir, std :: string &fname, Binary *bin, CacheEntry *entry, int flags) {
+	char			real[PATH_MAX];	/* canonical path of binary */
+	struct stat		st;		/* identity of binary */
+	std :: string		path;		/* cache file */
+	const CacheHeader	*hdr;		/* fixed part of cache file */
+	const CacheSection	*secs;		/* section records */
+	const CacheSymbol	*syms;		/* symbol records */
+	const char		*strs;		/* string table as stored */
+	char			*names;		/* string table copied into arena */
+	uint64_t		off;		/* offset of next part of cache file */
+	void			*map;		/* mapping of cache file */
+	int			fd;		/* cache file */
+	struct stat		cst;		/* size of cache file */
+
+	if ( cache_path(dir, fname, flags & Binary :: LOAD_BFD, real, &st, path) < 0 ) return 1;
+
+	if ( ( fd = open(path.c_str(), O_RDONLY) ) < 0 ) return 1;
+	if ( fstat(fd, &cst) < 0 || cst.st_size < (off_t) sizeof(CacheHeader) ) {
+		close(fd);
+		return 1;
+	}
+	map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( map == MAP_FAILED ) return 1;
+
+	entry -> release();
+	entry -> map	= (uint8_t *) map;
+	entry -> size	= cst.st_size;
+
+	hdr = (const CacheHeader *) entry -> map;
+	if ( memcmp(hdr -> magic, CACHE_MAGIC, sizeof(hdr -> magic))
+	     || hdr -> file_size != (uint64_t) st.st_size
+	     || hdr -> mtime_sec != st.st_mtim.tv_sec || hdr -> mtime_nsec != st.st_mtim.tv_nsec
+	     || hdr -> ino != st.st_ino || hdr -> dev != st.st_dev
+	     || hdr -> path_len != strlen(real) || hdr -> loader != ( flags & Binary :: LOAD_BFD ) )
+		goto miss;
+
+	/* lay out parts, rejecting counts that cannot fit in the file */
+	off = sizeof(CacheHeader);
+	if ( PAD8(hdr -> path_len) > entry -> size - off
+	     || memcmp(entry -> map + off, real, hdr -> path_len) )
+		goto miss;
+	off += PAD8(hdr -> path_len);
+
+	if ( hdr -> nsections > ( entry -> size - off ) / sizeof(CacheSection) ) goto miss;
+	secs = (const CacheSection *) ( entry -> map + off );
+	off += hdr -> nsections * sizeof(CacheSection);
+
+	if ( hdr -> nsymbols > ( entry -> size - off ) / sizeof(CacheSymbol) ) goto miss;
+	syms = (const CacheSymbol *) ( entry -> map + off );
+	off += hdr -> nsymbols * sizeof(CacheSymbol);
+
+	if ( hdr -> strs_size == 0 || hdr -> strs_size > entry -> size - off ) goto miss;
+	strs = (const char *) entry -> map + off;
+	off += hdr -> strs_size;
+
+	if ( strs[hdr -> strs_size - 1] != '\0' || hdr -> insns_size != entry -> size - off
+	     || hdr -> type_str >= hdr -> strs_size || hdr -> arch_str >= hdr -> strs_size )
+		goto miss;
+
+	/* section contents are read from the binary itself */
+	if ( map_binary(fname, bin) < 0 ) goto miss;
+
+	names = bin -> names.alloc(hdr -> strs_size);
+	memcpy(names, strs, hdr -> strs_size);
+
+	bin -> filename	= fname;
+	bin -> type	= (Binary :: BinaryType) hdr -> type;
+	bin -> type_str	= names + hdr -> type_str;
+	bin -> arch	= (Binary :: BinaryArch) hdr -> arch;
+	bin -> arch_str	= names + hdr -> arch_str;
+	bin -> bits	= hdr -> bits;
+	bin -> entry	= hdr -> entry;
+
+	bin -> sections.resize(hdr -> nsections);
+	for ( uint64_t i = 0; i < hdr -> nsections; ++i ) {
+		Section		&sec = bin -> sections[i];
+		const CacheSection &rec = secs[i];
+
+		if ( rec.name >= hdr -> strs_size ) goto miss;
+
+		sec.binary	= bin;
+		sec.name	= names + rec.name;
+		sec.type	= (Section :: SectionType) rec.type;
+		sec.vma		= rec.vma;
+		sec.size	= rec.size;
+		sec.filepos	= rec.filepos;
+
+		if ( rec.contents == CACHE_SEC_FILE ) {
+			if ( rec.filepos > bin -> map_size || rec.size > bin -> map_size - rec.filepos ) goto miss;
+			sec.bytes = bin -> map + rec.filepos;
+			sec.flags = Section :: SEC_FLAG_MAPPED;
+		} else if ( rec.contents == CACHE_SEC_ZERO ) {
+			if ( !( sec.bytes = (uint8_t *) calloc(rec.size ? rec.size : 1, 1) ) ) goto miss;
+			sec.flags = Section :: SEC_FLAG_MALLOC;
+		}
+	}
+
+	bin -> symbols.resize(hdr -> nsymbols);
+	for ( uint64_t i = 0; i < hdr -> nsymbols; ++i ) {
+		if ( syms[i].name >= hdr -> strs_size ) goto miss;
+		bin -> symbols[i].name	 = names + syms[i].name;
+		bin -> symbols[i].addr	 = syms[i].addr;
+		bin -> symbols[i].type	 = syms[i].type;
+		bin -> symbols[i].source = syms[i].source;
+	}
+
+	bin -> build_index();
+
+	entry -> insns		= hdr -> insns_size ? entry -> map + off : NULL;
+	entry -> insns_size	= hdr -> insns_size;
+
+	return 0;
+
+	miss:
+		unload_binary(bin);
+		*bin = Binary();
+		entry -> release();
+
+	return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef BIN_CACHE_H
+#define BIN_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include "loader.hpp"
+#include "output.hpp"
+
+#define CACHE_MAGIC		"BINFOC02"	/* identifies cache files, changed with their layout */
+
+/* Cache file of a binary, mapped while its analysis is in use */
+class CacheEntry {
+	public:
+		uint8_t		*map;		/* mapping of cache file (NULL if none) */
+		uint64_t	size;		/* size of mapping in bytes */
+		const uint8_t	*insns;		/* instruction records made by disasm(), NULL if not cached */
+		uint64_t	insns_size;	/* bytes of instruction records */
+
+		CacheEntry() : map(NULL), size(0), insns(NULL), insns_size(0) {}
+		~CacheEntry() { release(); }
+
+		CacheEntry(const CacheEntry &) = delete;
+		CacheEntry &operator=(const CacheEntry &) = delete;
+
+		/* Unmap cache file */
+		void release();
+};
+
+/* Load 'bin' from cache entry of 'fname' in 'dir', if the file is unchanged since it was cached
+ * by the loader 'flags' (Binary :: LoadFlags) select */
+int cache_load(const char *dir, std :: string &fname, Binary *bin, CacheEntry *entry, int flags);
+
+/* Store sections and symbols of 'bin', loaded with 'flags', and instruction records 'log'
+ * (if not NULL), as cache entry of 'fname' in 'dir' */
+int cache_store(const char *dir, std :: string &fname, Binary &bin, OutputBuffer *log, int flags);
+
+#endif /* BIN_CACHE_H */
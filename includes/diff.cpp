@@ -0,0 +1,449 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+#include "diff.hpp"
+#include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+#include "linear_disassembler.hpp"
+
+/* A section or function of one binary, hashed in chunks of DIFF_CHUNK_SIZE bytes */
+struct Region {
+	const char		*name;		/* name of section or function */
+	Section			*sec;		/* section containing region */
+	uint64_t		addr;		/* address of region */
+	uint64_t		size;		/* bytes in region */
+	std :: vector <uint32_t> hashes;	/* CRC32C of each chunk, filled by workers */
+
+	Region(const char *n, Section *s, uint64_t a, uint64_t sz)
+		: name(n), sec(s), addr(a), size(sz), hashes(( sz + DIFF_CHUNK_SIZE - 1 ) / DIFF_CHUNK_SIZE) {}
+
+	/* Return TRUE if chunk 'i' of both regions exists and has the same hash */
+	bool same_chunk(const Region &o, size_t i) const {
+		return i < hashes.size() && i < o.hashes.size() && hashes[i] == o.hashes[i];
+	}
+
+	bool same_as(const Region &o) const { return size == o.size && hashes == o.hashes; }
+};
+
+/* Regions of one binary taking part in a diff */
+struct DiffSide {
+	Binary			*bin;		/* binary compared */
+	std :: vector <Region>	sections;	/* one region per section, in section order */
+	std :: vector <Region>	functions;	/* one region per function name, by address */
+	NameIndex		fun_by_name;	/* index of function regions by name */
+};
+
+static uint32_t crc32c_table[256];	/* byte at a time table of reflected CRC32C polynomial */
+
+/* FUNCTION: crc32c_scalar
+ * INPUT ARGUMENTS:
+ * 	crc	: CRC of preceding bytes (0 initially)
+ * 	p	: bytes to hash
+ * 	n	: number of bytes
+ * PROCESS:
+ * 	a) update CRC one byte at a time through lookup table
+ * RETURN VALUE:
+ * 	uint32_t : CRC of preceding bytes followed by 'p'
+ */
+static uint32_t
+crc32c_scalar(uint32_t crc, const uint8_t *p, size_t n) {
+	crc = ~crc;
+	while ( n-- ) crc = crc32c_table[( crc ^ *p++ ) & 0xff] ^ ( crc >> 8 );
+	return ~crc;
+}
+
+/* FUNCTION: crc32c_sse42
+ * INPUT ARGUMENTS:
+ * 	crc	: CRC of preceding bytes (0 initially)
+ * 	p	: bytes to hash
+ * 	n	: number of bytes
+ * PROCESS:
+ * 	a) update CRC eight bytes at a time with the crc32 instruction
+ * 	b) update CRC with remaining bytes one at a time
+ * RETURN VALUE:
+ * 	uint32_t : CRC of preceding bytes followed by 'p', same as crc32c_scalar()
+ */
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *p, size_t n) {
+	uint64_t	c;	/* running CRC, widened for 64 bit steps */
+	uint64_t	v;	/* next eight bytes */
+
+	c = (uint32_t) ~crc;
+	for ( ; n >= 8; n -= 8, p += 8 ) {
+		memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+	}
+
+	crc = (uint32_t) c;
+	for ( ; n > 0; --n ) crc = _mm_crc32_u8(crc, *p++);
+
+	return ~crc;
+}
+
+/* FUNCTION: select_crc32c
+ * PROCESS:
+ * 	a) build table of scalar kernel
+ * 	b) pick hardware kernel if supported by the running cpu
+ * RETURN VALUE:
+ * 	pointer to CRC kernel
+ */
+static uint32_t (*select_crc32c())(uint32_t, const uint8_t *, size_t) {
+	uint32_t	c;	/* table entry being computed */
+
+	for ( uint32_t i = 0; i < 256; ++i ) {
+		c = i;
+		for ( int k = 0; k < 8; ++k ) c = ( c >> 1 ) ^ ( ( c & 1 ) ? 0x82f63b78 : 0 );
+		crc32c_table[i] = c;
+	}
+
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("sse4.2") ) return crc32c_sse42;
+	return crc32c_scalar;
+}
+
+static uint32_t (*const crc32c_impl)(uint32_t, const uint8_t *, size_t) = select_crc32c();
+
+/* FUNCTION: crc32c
+ * INPUT ARGUMENTS:
+ * 	crc	: CRC of preceding bytes (0 initially)
+ * 	p	: bytes to hash
+ * 	n	: number of bytes
+ * PROCESS:
+ * 	a) hash bytes with kernel selected for the running cpu
+ * RETURN VALUE:
+ * 	uint32_t : CRC of preceding bytes followed by 'p'
+ */
+uint32_t
+crc32c(uint32_t crc, const uint8_t *p, size_t n) {
+	return crc32c_impl(crc, p, n);
+}
+
+/* FUNCTION: collect_regions
+ * INPUT ARGUMENTS:
+ * 	side	: binary to collect regions of
+ * PROCESS:
+ * 	a) retrieve contents of every section, a region per section
+ * 	b) a region per function symbol in a code section, first symbol of each name
+ * 	   only, extending up to the next symbol or the end of its section
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - section contents could not be retrieved
+ */
+static int
+collect_regions(DiffSide &side) {
+	Binary		*bin = side.bin;	/* binary compared */
+	Section		*sec;			/* section containing function */
+	Symbol		*next;			/* symbol following function */
+	uint64_t	end;			/* end of function */
+	std :: vector <uint32_t>	funs;	/* function symbols, by address */
+
+	/* contents are retrieved here, workers only read them */
+	for ( auto &s : bin -> sections ) {
+		if ( !s.get_bytes() ) return -1;
+		side.sections.push_back(Region(s.name.c_str(), &s, s.vma, s.size));
+	}
+
+	bin -> select_symbols(Symbol :: SYM_TYPE_FUN, funs, true);
+	for ( auto i : funs ) {
+		Symbol &sym = bin -> symbols[i];
+
+		if ( !( sec = bin -> find_section(sym.addr) ) || sec -> type != Section :: SEC_TYPE_CODE ) continue;
+		if ( !side.fun_by_name.insert(std :: make_pair(sym.name, (uint32_t) side.functions.size())).second ) continue;
+
+		end = ( next = bin -> next_symbol(sym.addr) ) ? next -> addr : UINT64_MAX;
+		if ( end > sec -> vma + sec -> size ) end = sec -> vma + sec -> size;
+
+		side.functions.push_back(Region(sym.name, sec, sym.addr, end - sym.addr));
+	}
+
+	return 0;
+}
+
+/* FUNCTION: hash_regions
+ * INPUT ARGUMENTS:
+ * 	sides	: both binaries compared
+ * 	nthreads: number of workers
+ * PROCESS:
+ * 	a) list every chunk of every region of both binaries as a job
+ * 	b) workers take jobs in turn and hash the chunk's bytes
+ * RETURN VALUE: NONE
+ */
+static void
+hash_regions(DiffSide *sides, unsigned nthreads) {
+	std :: vector <std :: pair <Region *, uint32_t> >	jobs;		/* region and chunk to hash */
+	std :: atomic <size_t>					next(0);	/* next job to take */
+	std :: vector <std :: thread>				workers;	/* hashing threads */
+
+	for ( int k = 0; k < 2; ++k ) {
+		for ( auto &r : sides[k].sections )
+			for ( uint32_t i = 0; i < r.hashes.size(); ++i ) jobs.push_back(std :: make_pair(&r, i));
+		for ( auto &r : sides[k].functions )
+			for ( uint32_t i = 0; i < r.hashes.size(); ++i ) jobs.push_back(std :: make_pair(&r, i));
+	}
+
+	auto work = [&]() {
+		size_t	j;		/* job taken */
+		uint64_t off, n;	/* offset of chunk in section, bytes in chunk */
+
+		while ( ( j = next.fetch_add(1) ) < jobs.size() ) {
+			Region &r = *jobs[j].first;
+
+			off = r.addr - r.sec -> vma + (uint64_t) jobs[j].second * DIFF_CHUNK_SIZE;
+			n   = std :: min <uint64_t> (DIFF_CHUNK_SIZE, r.size - (uint64_t) jobs[j].second * DIFF_CHUNK_SIZE);
+			r.hashes[jobs[j].second] = crc32c(0, r.sec -> bytes + off, n);
+		}
+	};
+
+	for ( unsigned t = 1; t < nthreads && t < jobs.size(); ++t )
+		workers.push_back(std :: thread(work));
+	work();
+	for ( auto &w : workers ) w.join();
+}
+
+/* FUNCTION: print_diff_row
+ * INPUT ARGUMENTS:
+ * 	kind	: DIFF_KIND_* of regions
+ * 	status	: DIFF_* outcome of comparison
+ * 	a	: region of old binary, NULL if added
+ * 	b	: region of new binary, NULL if removed
+ * PROCESS:
+ * 	a) in machine readable formats, emit a diff record
+ * 	b) otherwise print name, status, addresses and sizes, and for sections the
+ * 	   number of differing chunks
+ * RETURN VALUE: NONE
+ */
+static void
+print_diff_row(uint8_t kind, uint8_t status, const Region *a, const Region *b) {
+	static const char * const	statuses[] = { "same    ", "changed ", "added   ", "removed " };
+	const char			*name = a ? a -> name : b -> name;
+	size_t				nchunks, ndiff;	/* chunks of larger region, chunks differing */
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_diff(*out, kind, status, name, a ? a -> addr : 0, a ? a -> size : 0, b ? b -> addr : 0, b ? b -> size : 0);
+		return;
+	}
+
+	out -> put(' ');
+	if ( strlen(name) > MAX_SYM_NAME_LEN ) {
+		out -> write(name, MAX_SYM_NAME_LEN - 2);
+		out -> lit("... ");
+	} else {
+		out -> str(name, -40);
+	}
+
+	if ( status == DIFF_SAME ) green();
+	else if ( status == DIFF_CHANGED ) yellow();
+	else red();
+	out -> str(statuses[status]);
+	reset_color();
+
+	out -> lit(" 0x");
+	out -> hex(a ? a -> addr : 0, 16);
+	out -> lit(" 0x");
+	out -> hex(b ? b -> addr : 0, 16);
+	out -> put(' ');
+	out -> dec(a ? a -> size : 0, 10);
+	out -> put(' ');
+	out -> dec(b ? b -> size : 0, 10);
+
+	if ( kind == DIFF_KIND_SECTION && a && b ) {
+		nchunks = std :: max(a -> hashes.size(), b -> hashes.size());
+		for ( size_t i = ndiff = 0; i < nchunks; ++i ) ndiff += !a -> same_chunk(*b, i);
+		out -> put(' ');
+		out -> dec(ndiff, 7);
+		out -> put('/');
+		out -> dec(nchunks);
+	}
+	out -> put('\n');
+}
+
+/* FUNCTION: print_changed_code
+ * INPUT ARGUMENTS:
+ * 	a	: region of old binary
+ * 	b	: region of new binary
+ * 	start	: offset into both regions to disassemble from
+ * 	end	: offset into both regions to stop at
+ * PROCESS:
+ * 	a) print range of old region, then of new region, each disassembled on its own
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - disassembled
+ * 		-1 - failure
+ */
+static int
+print_changed_code(const Region &a, const Region &b, uint64_t start, uint64_t end) {
+	const Region	*r;	/* side being disassembled */
+
+	for ( int k = 0; k < 2; ++k ) {
+		r = k ? &b : &a;
+		if ( start >= r -> size ) continue;
+
+		yellow();
+		out -> lit(k ? "+++ new 0x" : "--- old 0x");
+		out -> hex(r -> addr + start, 16);
+		out -> lit(" - 0x");
+		out -> hex(r -> addr + std :: min(end, r -> size), 16);
+		out -> put('\n');
+		reset_color();
+
+		if ( disasm_range(r -> sec, r -> addr + start, r -> addr + std :: min(end, r -> size)) < 0 ) return -1;
+	}
+
+	return 0;
+}
+
+/* FUNCTION: diff_binaries
+ * INPUT ARGUMENTS:
+ * 	a	: old binary
+ * 	b	: new binary
+ * 	nthreads: number of workers hashing regions
+ * PROCESS:
+ * 	a) collect sections and functions of both binaries and hash them in chunks
+ * 	b) match sections by name and report each as same, changed, removed or added
+ * 	c) match functions by name and report those not the same
+ * 	d) in text output, disassemble both versions of changed functions, and the
+ * 	   differing chunks of changed code sections holding no function symbols
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - compared
+ * 		-1 - failure
+ */
+int
+diff_binaries(Binary &a, Binary &b, unsigned nthreads) {
+	DiffSide		sides[2];	/* old and new binary */
+	Section			*sec;		/* section of other binary with same name */
+	NameIndex :: iterator	it;		/* function of other binary with same name */
+	size_t			counts[4];	/* functions per DIFF_* status */
+	std :: vector <bool>	has_funs;	/* section of old binary holds function regions */
+	uint64_t		start;		/* offset of first differing chunk of a run */
+
+	sides[0].bin = &a;
+	sides[1].bin = &b;
+	if ( collect_regions(sides[0]) < 0 || collect_regions(sides[1]) < 0 ) return -1;
+
+	hash_regions(sides, nthreads ? nthreads : 1);
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		underlined_red();
+		out -> lit("[*] Diff of '");
+		out -> str(a.filename.c_str());
+		out -> lit("' and '");
+		out -> str(b.filename.c_str());
+		out -> lit("'\n");
+		red();
+		out -> lit("[*] Sections:\n");
+		blue();
+		out -> lit(" NAME                                    STATUS   OLD ADDR           NEW ADDR           OLD SIZE   NEW SIZE  CHUNKS\n");
+		reset_color();
+	}
+
+	/* sections, in order of old binary, then those only in new binary */
+	for ( auto &r : sides[0].sections ) {
+		if ( ( sec = b.find_section(r.name) ) ) {
+			Region &o = sides[1].sections[sec - &b.sections[0]];
+			print_diff_row(DIFF_KIND_SECTION, r.same_as(o) ? DIFF_SAME : DIFF_CHANGED, &r, &o);
+		} else {
+			print_diff_row(DIFF_KIND_SECTION, DIFF_REMOVED, &r, NULL);
+		}
+	}
+	for ( auto &r : sides[1].sections )
+		if ( !a.find_section(r.name) ) print_diff_row(DIFF_KIND_SECTION, DIFF_ADDED, NULL, &r);
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		out -> put('\n');
+		red();
+		out -> lit("[*] Functions not the same:\n");
+		blue();
+		out -> lit(" NAME                                    STATUS   OLD ADDR           NEW ADDR           OLD SIZE   NEW SIZE\n");
+		reset_color();
+	}
+
+	/* functions, in address order of old binary, then those only in new binary */
+	memset(counts, 0, sizeof(counts));
+	for ( auto &r : sides[0].functions ) {
+		if ( ( it = sides[1].fun_by_name.find(r.name) ) != sides[1].fun_by_name.end() ) {
+			Region &o = sides[1].functions[it -> second];
+			if ( r.same_as(o) ) {
+				++counts[DIFF_SAME];
+				continue;
+			}
+			++counts[DIFF_CHANGED];
+			print_diff_row(DIFF_KIND_FUNCTION, DIFF_CHANGED, &r, &o);
+		} else {
+			++counts[DIFF_REMOVED];
+			print_diff_row(DIFF_KIND_FUNCTION, DIFF_REMOVED, &r, NULL);
+		}
+	}
+	for ( auto &r : sides[1].functions ) {
+		if ( sides[0].fun_by_name.count(r.name) ) continue;
+		++counts[DIFF_ADDED];
+		print_diff_row(DIFF_KIND_FUNCTION, DIFF_ADDED, NULL, &r);
+	}
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) return 0;
+
+	bold_yellow();
+	out -> put(' ');
+	out -> dec(counts[DIFF_SAME]);
+	out -> lit(" same, ");
+	out -> dec(counts[DIFF_CHANGED]);
+	out -> lit(" changed, ");
+	out -> dec(counts[DIFF_ADDED]);
+	out -> lit(" added, ");
+	out -> dec(counts[DIFF_REMOVED]);
+	out -> lit(" removed\n");
+	reset_color();
+
+	/* both versions of every changed function */
+	has_funs.assign(a.sections.size(), false);
+	for ( auto &r : sides[0].functions ) {
+		has_funs[r.sec - &a.sections[0]] = true;
+
+		if ( ( it = sides[1].fun_by_name.find(r.name) ) == sides[1].fun_by_name.end() ) continue;
+		Region &o = sides[1].functions[it -> second];
+		if ( r.same_as(o) ) continue;
+
+		out -> put('\n');
+		red();
+		out -> lit("[*] Changed function ");
+		out -> str(r.name);
+		out -> lit(":\n");
+		reset_color();
+		if ( print_changed_code(r, o, 0, std :: max(r.size, o.size)) < 0 ) return -1;
+	}
+
+	/* without function symbols, runs of differing chunks of code sections stand in for them */
+	for ( auto &r : sides[0].sections ) {
+		if ( r.sec -> type != Section :: SEC_TYPE_CODE || has_funs[r.sec - &a.sections[0]] ) continue;
+		if ( !( sec = b.find_section(r.name) ) ) continue;
+
+		Region &o = sides[1].sections[sec - &b.sections[0]];
+		size_t nchunks = std :: max(r.hashes.size(), o.hashes.size());
+
+		for ( size_t i = 0; i < nchunks; ) {
+			if ( r.same_chunk(o, i) ) { ++i; continue; }
+
+			start = (uint64_t) i * DIFF_CHUNK_SIZE;
+			while ( i < nchunks && !r.same_chunk(o, i) ) ++i;
+
+			out -> put('\n');
+			red();
+			out -> lit("[*] Changed bytes of ");
+			out -> str(r.name);
+			out -> lit(" at offset 0x");
+			out -> hex(start, 8);
+			out -> lit(":\n");
+			reset_color();
+			if ( print_changed_code(r, o, start, (uint64_t) i * DIFF_CHUNK_SIZE) < 0 ) return -1;
+		}
+	}
+
+	return 0;
+}
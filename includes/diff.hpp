@@ -0,0 +1,19 @@
+#ifndef BIN_DIFF_H
+#define BIN_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include "loader.hpp"
+
+#define DIFF_CHUNK_SIZE		0x10000		/* bytes of a section hashed as one unit of work */
+
+/* CRC32C (Castagnoli) of 'n' bytes of 'p' continuing from 'crc', hardware accelerated
+ * when the running cpu supports SSE4.2 */
+uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t n);
+
+/* Compare sections (by name) and function symbols (by name, extending up to the next
+ * symbol) of binaries 'a' and 'b', hashing them on 'nthreads' workers, report the
+ * outcome and disassemble code that differs */
+int diff_binaries(Binary &a, Binary &b, unsigned nthreads = 1);
+
+#endif /* BIN_DIFF_H */
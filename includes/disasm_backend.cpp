@@ -0,0 +1,102 @@
+#include <cstdio>
+#include "disasm_backend.hpp"
+
+/* Capstone architecture and mode of each decoding mode */
+static const struct {
+	Binary :: BinaryArch	arch;		/* architecture of binary */
+	uint32_t		bits;		/* word size of binary */
+	cs_arch			cs_arch_id;	/* capstone architecture */
+	cs_mode			cs_mode_id;	/* capstone mode */
+} modes[NUM_DIS_MODES] = {
+	{ Binary :: ARCH_X86, 32, CS_ARCH_X86, CS_MODE_32 },	/* DIS_MODE_X86_32 */
+	{ Binary :: ARCH_X86, 64, CS_ARCH_X86, CS_MODE_64 },	/* DIS_MODE_X86_64 */
+};
+
+/* Handles opened by one thread, indexed by mode and detail option */
+class HandleCache {
+	public:
+		DisasmHandle	handles[NUM_DIS_MODES][2];
+
+		HandleCache() {
+			for ( int m = 0; m < NUM_DIS_MODES; ++m )
+				for ( int d = 0; d < 2; ++d ) handles[m][d].insn = NULL;
+		}
+
+		~HandleCache() {
+			for ( int m = 0; m < NUM_DIS_MODES; ++m ) {
+				for ( int d = 0; d < 2; ++d ) {
+					if ( !handles[m][d].insn ) continue;
+					cs_free(handles[m][d].insn, 1);
+					cs_close(&handles[m][d].dis);
+				}
+			}
+		}
+};
+
+static thread_local HandleCache	handle_cache;	/* handles of calling thread */
+
+/* FUNCTION: disasm_mode
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * PROCESS:
+ * 	a) look architecture and word size of binary up in mode table
+ * RETURN VALUE:
+ * 	DisasmMode : decoding mode, DIS_MODE_NONE if not supported
+ */
+DisasmMode
+disasm_mode(const Binary &bin) {
+	for ( int m = 0; m < NUM_DIS_MODES; ++m )
+		if ( modes[m].arch == bin.arch && modes[m].bits == bin.bits ) return (DisasmMode) m;
+	return DIS_MODE_NONE;
+}
+
+/* FUNCTION: acquire_handle
+ * INPUT ARGUMENTS:
+ * 	mode	: decoding mode
+ * 	detail	: decode instruction details (operands, groups)
+ * PROCESS:
+ * 	a) return handle cached by calling thread, if any
+ * 	b) otherwise open capstone in mode, set detail option and allocate the
+ * 	   reusable instruction, keeping them until the thread exits
+ * RETURN VALUE:
+ * 	DisasmHandle * : handle of calling thread, NULL on failure
+ */
+DisasmHandle *
+acquire_handle(DisasmMode mode, bool detail) {
+	DisasmHandle	*h;	/* cached handle */
+
+	if ( mode == DIS_MODE_NONE ) {
+		fprintf(stderr, "Unsupported architecture for disassembly\n");
+		return NULL;
+	}
+
+	h = &handle_cache.handles[mode][detail];
+	if ( h -> insn ) return h;
+
+	if ( cs_open(modes[mode].cs_arch_id, modes[mode].cs_mode_id, &h -> dis) != CS_ERR_OK ) {
+		fprintf(stderr, "Failed to open Capstone");
+		return NULL;
+	}
+
+	if ( detail ) cs_option(h -> dis, CS_OPT_DETAIL, CS_OPT_ON);
+
+	if ( !( h -> insn = cs_malloc(h -> dis) ) ) {
+		fprintf(stderr, "Disassembly error: %s\n", cs_strerror(cs_errno(h -> dis)));
+		cs_close(&h -> dis);
+		return NULL;
+	}
+
+	return h;
+}
+
+/* FUNCTION: acquire_handle
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	detail	: decode instruction details (operands, groups)
+ * RETURN VALUE:
+ * 	DisasmHandle * : handle of calling thread for mode of binary, NULL on failure
+ */
+DisasmHandle *
+acquire_handle(const Binary &bin, bool detail) {
+	return acquire_handle(disasm_mode(bin), detail);
+}
@@ -0,0 +1,32 @@
+#ifndef BIN_DISASM_BACKEND_H
+#define BIN_DISASM_BACKEND_H
+
+#include <capstone/capstone.h>
+#include "loader.hpp"
+
+/* Decoding modes supported, selected from Binary :: arch and Binary :: bits */
+enum DisasmMode {
+	DIS_MODE_NONE	= -1,	/* Architecture not supported */
+	DIS_MODE_X86_32	= 0,	/* i386 */
+	DIS_MODE_X86_64	= 1,	/* amd64 */
+	NUM_DIS_MODES	= 2
+};
+
+/* Capstone handle and reusable instruction, owned by the thread that acquired them */
+struct DisasmHandle {
+	csh		dis;	/* handler to capstone api */
+	cs_insn		*insn;	/* reusable instruction, filled by each decode */
+};
+
+/* Return decoding mode of 'bin', DIS_MODE_NONE if its architecture is not supported */
+DisasmMode disasm_mode(const Binary &bin);
+
+/* Return handle of the calling thread for 'mode', with instruction details if 'detail'.
+ * Handles are opened on first use and closed when the thread exits, so callers must not
+ * close them. NULL on failure (message printed) */
+DisasmHandle * acquire_handle(DisasmMode mode, bool detail = false);
+
+/* Same as acquire_handle(disasm_mode(bin), detail) */
+DisasmHandle * acquire_handle(const Binary &bin, bool detail = false);
+
+#endif /* BIN_DISASM_BACKEND_H */
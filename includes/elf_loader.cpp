@@ -0,0 +1,442 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <elf.h>
+#include "elf_loader.hpp"
+#include "metrics.hpp"
+
+#define VERSYM_VERSION		0x7fff		/* version index bits of a .gnu.version entry */
+#define VERSYM_HIDDEN		0x8000		/* symbol is not the default version */
+
+/* Layout of ELF structures for each file class */
+struct Elf32Types {
+	typedef Elf32_Ehdr	Ehdr;
+	typedef Elf32_Shdr	Shdr;
+	typedef Elf32_Sym	Sym;
+	static const int	bits = 32;
+};
+
+struct Elf64Types {
+	typedef Elf64_Ehdr	Ehdr;
+	typedef Elf64_Shdr	Shdr;
+	typedef Elf64_Sym	Sym;
+	static const int	bits = 64;
+};
+
+/* Section headers of a mapped ELF file */
+template <class T>
+struct ElfImage {
+	const uint8_t		*base;		/* start of mapping */
+	uint64_t		size;		/* size of mapping */
+	const typename T :: Ehdr *ehdr;		/* file header */
+	const typename T :: Shdr *shdrs;	/* section header table */
+	uint64_t		shnum;		/* number of section headers */
+	const char		*shstrtab;	/* section name string table */
+	uint64_t		shstrsz;	/* size of section name string table */
+
+	/* Return TRUE if [off, off + len) lies within the mapping */
+	bool in_file(uint64_t off, uint64_t len) const { return off <= size && len <= size - off; }
+
+	/* Return string at 'off' of table [tab, tab + tabsz), NULL if not terminated inside it */
+	static const char * str(const char *tab, uint64_t tabsz, uint64_t off) {
+		if ( !tab || off >= tabsz || !memchr(tab + off, '\0', tabsz - off) ) return NULL;
+		return tab + off;
+	}
+};
+
+/* FUNCTION: open_elf
+ * INPUT ARGUMENTS:
+ * 	img	: receives section headers of binary
+ * 	bin	: binary's object, holding mapping of file
+ * PROCESS:
+ * 	a) locate section header table and check it lies within file
+ * 	b) resolve extended section count and section name string table index
+ * 	c) locate section name string table
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - malformed file
+ */
+template <class T>
+static int
+open_elf(ElfImage <T> &img, Binary *bin) {
+	uint64_t	shstrndx;	/* index of section name string table */
+
+	img.base = bin -> map;
+	img.size = bin -> map_size;
+	img.ehdr = (const typename T :: Ehdr *) img.base;
+
+	if ( !img.in_file(0, sizeof(typename T :: Ehdr)) || img.ehdr -> e_shoff == 0
+	     || img.ehdr -> e_shentsize != sizeof(typename T :: Shdr)
+	     || !img.in_file(img.ehdr -> e_shoff, sizeof(typename T :: Shdr)) )
+		return -1;
+
+	img.shdrs = (const typename T :: Shdr *) ( img.base + img.ehdr -> e_shoff );
+
+	/* counts too large for the file header are stored in the first section header */
+	img.shnum = img.ehdr -> e_shnum ? img.ehdr -> e_shnum : img.shdrs[0].sh_size;
+	shstrndx  = img.ehdr -> e_shstrndx == SHN_XINDEX ? img.shdrs[0].sh_link : img.ehdr -> e_shstrndx;
+
+	if ( img.shnum > img.size / sizeof(typename T :: Shdr)
+	     || !img.in_file(img.ehdr -> e_shoff, img.shnum * sizeof(typename T :: Shdr))
+	     || shstrndx >= img.shnum )
+		return -1;
+
+	if ( !img.in_file(img.shdrs[shstrndx].sh_offset, img.shdrs[shstrndx].sh_size) ) return -1;
+
+	img.shstrtab = (const char *) img.base + img.shdrs[shstrndx].sh_offset;
+	img.shstrsz  = img.shdrs[shstrndx].sh_size;
+
+	return 0;
+}
+
+/* FUNCTION: load_sections_elf
+ * INPUT ARGUMENTS:
+ * 	img	: section headers of binary
+ * 	bin	: binary's object (program internal representation)
+ * PROCESS:
+ * 	a) classify each section the way libbfd does: executable sections are CODE,
+ * 	   other allocated sections with file contents are DATA, the rest is skipped
+ * 	b) populate program internal representation of section, pointing its
+ * 	   contents into the mapping (zero filled copy for sections without contents)
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - section cannot be referenced in place
+ */
+template <class T>
+static int
+load_sections_elf(ElfImage <T> &img, Binary *bin) {
+	const typename T :: Shdr	*shdr;		/* section header */
+	const char			*secname;	/* section name */
+	Section				*sec;		/* program internal representation of section */
+	Section	:: SectionType		sectype;	/* program internal representation of section type */
+
+	for ( uint64_t i = 1; i < img.shnum; ++i ) {
+		shdr = &img.shdrs[i];
+
+		if ( shdr -> sh_flags & SHF_EXECINSTR ) {
+			sectype = Section :: SEC_TYPE_CODE;
+		} else if ( ( shdr -> sh_flags & SHF_ALLOC ) && shdr -> sh_type != SHT_NOBITS ) {
+			sectype = Section :: SEC_TYPE_DATA;
+		} else {
+			continue;
+		}
+
+		/* compressed contents need libbfd to inflate them */
+		if ( shdr -> sh_flags & SHF_COMPRESSED ) return -1;
+
+		if ( !( secname = ElfImage <T> :: str(img.shstrtab, img.shstrsz, shdr -> sh_name) ) )
+			secname = "<unnamed>";
+
+		bin -> sections.push_back(Section());
+		sec = &bin -> sections.back();
+
+		sec -> binary	= bin;
+		sec -> name	= std :: string(secname);
+		sec -> type	= sectype;
+		sec -> vma	= shdr -> sh_addr;
+		sec -> size	= shdr -> sh_size;
+		sec -> filepos	= shdr -> sh_offset;
+
+		if ( shdr -> sh_type == SHT_NOBITS ) {
+			if ( !( sec -> bytes = (uint8_t *) calloc(1, sec -> size ? sec -> size : 1) ) ) return -1;
+			sec -> flags = Section :: SEC_FLAG_MALLOC;
+			continue;
+		}
+
+		if ( !img.in_file(sec -> filepos, sec -> size) ) return -1;
+
+		sec -> bytes	= bin -> map + sec -> filepos;
+		sec -> flags	= Section :: SEC_FLAG_MAPPED;
+		metrics.count(Metrics :: CNT_BYTES_LOADED, sec -> size);
+	}
+
+	return 0;
+}
+
+/* FUNCTION: symbol_version
+ * INPUT ARGUMENTS:
+ * 	img	: section headers of binary
+ * 	versym	: version index of dynamic symbol
+ * 	hidden	: receives TRUE if version is not the default one
+ * PROCESS:
+ * 	a) search version definitions, then version requirements, for 'versym'
+ * RETURN VALUE:
+ * 	static const char * : version name, NULL for local, base or unknown versions
+ */
+template <class T>
+static const char *
+symbol_version(ElfImage <T> &img, uint16_t versym, bool *hidden) {
+	const typename T :: Shdr	*shdr;		/* version section header */
+	const typename T :: Shdr	*strs;		/* string table of version section */
+	const char			*strtab;	/* version names */
+	uint64_t			off;		/* offset of version entry */
+	uint16_t			ndx;		/* version index without hidden bit */
+
+	ndx	= versym & VERSYM_VERSION;
+	*hidden	= ( versym & VERSYM_HIDDEN ) != 0;
+
+	if ( ndx <= VER_NDX_GLOBAL ) return NULL;
+
+	for ( uint64_t i = 1; i < img.shnum; ++i ) {
+		shdr = &img.shdrs[i];
+		if ( shdr -> sh_type != SHT_GNU_verdef && shdr -> sh_type != SHT_GNU_verneed ) continue;
+		if ( shdr -> sh_link >= img.shnum ) continue;
+
+		strs	= &img.shdrs[shdr -> sh_link];
+		if ( !img.in_file(strs -> sh_offset, strs -> sh_size) ) continue;
+		strtab	= (const char *) img.base + strs -> sh_offset;
+
+		off = shdr -> sh_offset;
+		for ( uint64_t n = 0; n < shdr -> sh_info; ++n ) {
+			if ( shdr -> sh_type == SHT_GNU_verdef ) {
+				const Elf64_Verdef	*vd;	/* version definition, same layout for both classes */
+				const Elf64_Verdaux	*vda;	/* name of version definition */
+
+				if ( !img.in_file(off, sizeof(*vd)) ) break;
+				vd = (const Elf64_Verdef *) ( img.base + off );
+				if ( vd -> vd_ndx == ndx && !( vd -> vd_flags & VER_FLG_BASE ) ) {
+					if ( !img.in_file(off + vd -> vd_aux, sizeof(*vda)) ) return NULL;
+					vda = (const Elf64_Verdaux *) ( img.base + off + vd -> vd_aux );
+					return ElfImage <T> :: str(strtab, strs -> sh_size, vda -> vda_name);
+				}
+				if ( !vd -> vd_next ) break;
+				off += vd -> vd_next;
+			} else {
+				const Elf64_Verneed	*vn;	/* version requirement, same layout for both classes */
+				const Elf64_Vernaux	*vna;	/* version required from a file */
+				uint64_t		aux;	/* offset of auxiliary entry */
+
+				if ( !img.in_file(off, sizeof(*vn)) ) break;
+				vn  = (const Elf64_Verneed *) ( img.base + off );
+				aux = off + vn -> vn_aux;
+				for ( uint64_t a = 0; a < vn -> vn_cnt && img.in_file(aux, sizeof(*vna)); ++a ) {
+					vna = (const Elf64_Vernaux *) ( img.base + aux );
+					if ( vna -> vna_other == ndx ) {
+						*hidden = true;		/* references are always printed with '@' */
+						return ElfImage <T> :: str(strtab, strs -> sh_size, vna -> vna_name);
+					}
+					if ( !vna -> vna_next ) break;
+					aux += vna -> vna_next;
+				}
+				if ( !vn -> vn_next ) break;
+				off += vn -> vn_next;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* FUNCTION: load_symbols_elf
+ * INPUT ARGUMENTS:
+ * 	img	: section headers of binary
+ * 	merge	: merges symbols into binary's object (program internal representation)
+ * 	type	: SHT_SYMTAB for static symbols, SHT_DYNSYM for dynamic symbols
+ * PROCESS:
+ * 	a) locate symbol table of 'type' and its string table
+ * 	b) for each symbol past the null symbol
+ * 		b1) compute its value the way libbfd does
+ * 		b2) append version to names of dynamic symbols
+ * 		b3) merge symbol, tagging function symbols, local & global symbols and debugging symbols
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success (or no such table)
+ * 		-1 - failure
+ */
+template <class T>
+static int
+load_symbols_elf(ElfImage <T> &img, SymbolMerger &merge, uint32_t type) {
+	const typename T :: Shdr	*symtab, *strtab;	/* symbol table and its string table */
+	const typename T :: Shdr	*versyms;		/* version indexes of dynamic symbols */
+	const typename T :: Sym		*syms;			/* symbol table entries */
+	const char			*strs;			/* symbol names */
+	const char			*name, *version;	/* symbol name and version */
+	uint64_t			nsyms;			/* number of symbols */
+	uint8_t				stype;			/* type of symbol */
+	bool				hidden;			/* symbol version is not the default */
+	uint64_t			addr;			/* value of symbol */
+	uint8_t				source;			/* Symbol :: SymbolSource of table */
+	std :: string			full;			/* versioned symbol name */
+	Symbol				*sym;			/* single symbol instance */
+
+	symtab	= NULL;
+	versyms	= NULL;
+	for ( uint64_t i = 1; i < img.shnum; ++i ) {
+		if ( img.shdrs[i].sh_type == type && !symtab ) symtab = &img.shdrs[i];
+		if ( img.shdrs[i].sh_type == SHT_GNU_versym ) versyms = &img.shdrs[i];
+	}
+
+	if ( !symtab ) return 0;
+
+	if ( symtab -> sh_link >= img.shnum || symtab -> sh_entsize != sizeof(typename T :: Sym)
+	     || !img.in_file(symtab -> sh_offset, symtab -> sh_size) ) {
+		fprintf(stderr, "[!!] Failed to read symbols table (malformed section header)\n");
+		return -1;
+	}
+
+	strtab = &img.shdrs[symtab -> sh_link];
+	if ( !img.in_file(strtab -> sh_offset, strtab -> sh_size) ) return -1;
+
+	syms	= (const typename T :: Sym *) ( img.base + symtab -> sh_offset );
+	strs	= (const char *) img.base + strtab -> sh_offset;
+	nsyms	= symtab -> sh_size / sizeof(typename T :: Sym);
+
+	if ( type != SHT_DYNSYM || !versyms || !img.in_file(versyms -> sh_offset, nsyms * sizeof(uint16_t)) )
+		versyms = NULL;
+
+	source = ( type == SHT_DYNSYM ) ? Symbol :: SYM_SRC_DYNAMIC : Symbol :: SYM_SRC_STATIC;
+
+	for ( uint64_t i = 1; i < nsyms; ++i ) {
+		const typename T :: Sym &s = syms[i];
+
+		if ( !( name = ElfImage <T> :: str(strs, strtab -> sh_size, s.st_name) ) ) name = "(null)";
+
+		/* section symbols carry the name of their section */
+		stype = ELF64_ST_TYPE(s.st_info);
+		if ( !*name && stype == STT_SECTION && s.st_shndx < img.shnum )
+			if ( !( name = ElfImage <T> :: str(img.shstrtab, img.shstrsz, img.shdrs[s.st_shndx].sh_name) ) )
+				name = "";
+
+		/* libbfd keeps section relative values for relocatable files */
+		addr = s.st_value;
+		if ( s.st_shndx == SHN_COMMON )
+			addr = s.st_size;
+		else if ( img.ehdr -> e_type == ET_REL && s.st_shndx != SHN_UNDEF
+			  && s.st_shndx < SHN_LORESERVE && s.st_shndx < img.shnum )
+			addr += img.shdrs[s.st_shndx].sh_addr;
+
+		version = NULL;
+		if ( versyms ) {
+			version = symbol_version(img, ( (const uint16_t *) ( img.base + versyms -> sh_offset ) )[i], &hidden);
+			/* symbols defining a version are named after it and get no suffix */
+			if ( version && ( !*version || !strcmp(version, name) ) ) version = NULL;
+		}
+
+		/* versioned names are built in scratch buffer and copied if new, others stay in mapping */
+		if ( version ) {
+			full.assign(name);
+			full.append(( hidden || s.st_shndx == SHN_UNDEF ) ? "@" : "@@");
+			full.append(version);
+			sym = merge.add(full.c_str(), addr, source, true);
+		} else {
+			sym = merge.add(name, addr, source, false);
+		}
+
+		if ( stype == STT_FUNC )
+			sym -> type |= Symbol :: SYM_TYPE_FUN;
+		if ( ELF64_ST_BIND(s.st_info) == STB_LOCAL )
+			sym -> type |= Symbol :: SYM_TYPE_LOC;
+		if ( ELF64_ST_BIND(s.st_info) == STB_GLOBAL && s.st_shndx != SHN_UNDEF && s.st_shndx != SHN_COMMON )
+			sym -> type |= Symbol :: SYM_TYPE_GLB;
+		if ( stype == STT_SECTION || stype == STT_FILE )
+			sym -> type |= Symbol :: SYM_TYPE_DBG;
+	}
+
+	return 0;
+}
+
+/* FUNCTION: load_elf
+ * INPUT ARGUMENTS:
+ * 	bin	: binary's object, holding mapping of file
+ * PROCESS:
+ * 	a) locate section headers
+ * 	b) set executable type, architecture and entry point in 'bin'
+ * 	c) size symbol vector from both symbol tables
+ * 	d) merge static symbols (if present) and dynamic symbols
+ * 	e) load sections
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - file must be left to libbfd
+ */
+template <class T>
+static int
+load_elf(Binary *bin) {
+	ElfImage <T>	img;	/* section headers of binary */
+	uint64_t	nsyms;	/* upper bound of symbols in both tables */
+	PhaseTimer	timer(Metrics :: PHASE_SECTIONS);	/* charges open and symbols phases on the way */
+
+	if ( open_elf(img, bin) < 0 ) return -1;
+
+	switch ( img.ehdr -> e_machine ) {
+		case EM_386:
+			if ( T :: bits != 32 ) return -1;
+			bin -> type_str	= "elf32-i386";
+			bin -> arch_str	= "i386";
+			break;
+		case EM_X86_64:
+			if ( T :: bits != 64 ) return -1;	/* x32 is left to libbfd */
+			bin -> type_str	= "elf64-x86-64";
+			bin -> arch_str	= "i386:x86-64";
+			break;
+		default:
+			return -1;
+	}
+
+	bin -> type	= Binary :: BIN_TYPE_ELF;
+	bin -> arch	= Binary :: ARCH_X86;
+	bin -> bits	= T :: bits;
+	bin -> entry	= img.ehdr -> e_entry;
+
+	/* symbols may not be present if the binary is stripped, tables are merged into one set */
+	nsyms = 0;
+	for ( uint64_t i = 1; i < img.shnum; ++i )
+		if ( img.shdrs[i].sh_type == SHT_SYMTAB || img.shdrs[i].sh_type == SHT_DYNSYM )
+			nsyms += img.shdrs[i].sh_size / sizeof(typename T :: Sym);
+	nsyms = std :: min(nsyms, img.size / sizeof(typename T :: Sym));
+
+	timer.lap(Metrics :: PHASE_OPEN);
+
+	SymbolMerger	merge(bin, nsyms);
+
+	load_symbols_elf(img, merge, SHT_SYMTAB);
+	load_symbols_elf(img, merge, SHT_DYNSYM);
+	timer.lap(Metrics :: PHASE_SYMBOLS);
+
+	return load_sections_elf(img, bin);
+}
+
+/* FUNCTION: load_binary_elf
+ * INPUT ARGUMENTS:
+ * 	fname	: name of binary file to load
+ * 	bin	: binary's object (program internal representation)
+ * PROCESS:
+ * 	a) map binary file and check ELF identification, section contents are always
+ * 	   referenced in the mapping
+ * 	b) load little endian ELF32 or ELF64 file for x86
+ * 	c) on anything unsupported, undo partial loading so libbfd starts afresh
+ * RETURN VALUE:
+ * 	int : status code
+ * 		0 - loaded
+ * 		1 - not handled, load through libbfd
+ */
+int
+load_binary_elf(std :: string &fname, Binary *bin) {
+	const unsigned char	*ident;		/* ELF identification bytes */
+	int			ret;		/* status of class specific loader */
+
+	{
+		PhaseTimer	timer(Metrics :: PHASE_OPEN);
+		if ( map_binary(fname, bin) < 0 ) return 1;
+	}
+
+	ident = bin -> map;
+	ret   = -1;
+
+	if ( bin -> map_size >= EI_NIDENT && !memcmp(ident, ELFMAG, SELFMAG) && ident[EI_DATA] == ELFDATA2LSB ) {
+		bin -> filename = fname;
+		if ( ident[EI_CLASS] == ELFCLASS32 ) ret = load_elf <Elf32Types> (bin);
+		if ( ident[EI_CLASS] == ELFCLASS64 ) ret = load_elf <Elf64Types> (bin);
+	}
+
+	if ( ret < 0 ) {
+		unload_binary(bin);
+		*bin = Binary();
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef BIN_ELF_LOADER_H
+#define BIN_ELF_LOADER_H
+
+#include <string>
+#include "loader.hpp"
+
+/* Load ELF32/ELF64 x86 binary without libbfd, referencing section contents in the file mapping.
+ * Return 0 if loaded, 1 if the file is left to libbfd */
+int load_binary_elf(std :: string &fname, Binary *bin);
+
+#endif /* BIN_ELF_LOADER_H */
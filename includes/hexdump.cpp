@@ -0,0 +1,232 @@
+#include <cstring>
+#include <immintrin.h>
+#include "hexdump.hpp"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* FUNCTION: dump_line_scalar
+ * INPUT ARGUMENTS:
+ * 	dst	: destination of formatted line
+ * 	src	: bytes to format
+ * 	n	: number of bytes on line (at most MAX_LINE_LEN)
+ * PROCESS:
+ * 	a) format hexadecimal value of each byte, padded to MAX_LINE_LEN columns
+ * 	b) format corresponding ascii character if it exists
+ * RETURN VALUE:
+ * 	size_t : length of formatted line
+ */
+static size_t
+dump_line_scalar(char *dst, const uint8_t *src, size_t n) {
+	size_t	j;		/* loop iterator */
+	char	*p;		/* write position in line */
+	char	ascii_code;	/* single character/byte in section content */
+
+	p = dst;
+
+	/* hex value for each byte */
+	for ( j = 0; j < n; ++j ) {
+		*p++ = ' ';
+		*p++ = hex_digits[src[j] >> 4];
+		*p++ = hex_digits[src[j] & 0xf];
+	}
+
+	/* additional space for last line less than maximum length */
+	for ( ; j < MAX_LINE_LEN; ++j ) {
+		*p++ = ' ';
+		*p++ = ' ';
+		*p++ = ' ';
+	}
+
+	/* column to separate hex and character columns */
+	*p++ = ' ';
+	*p++ = ' ';
+
+	/* corresponding character if printable */
+	for ( j = 0; j < n; ++j ) {
+		ascii_code = src[j];
+		*p++ = (ascii_code >= 32 && ascii_code <=128) ? ascii_code : '.';
+	}
+
+	*p++ = '\n';
+
+	return p - dst;
+}
+
+static void
+dump_lines_scalar(char *dst, const uint8_t *src, size_t nlines) {
+	for ( size_t i = 0; i < nlines; ++i )
+		dump_line_scalar(dst + i * DUMP_LINE_LEN, src + i * MAX_LINE_LEN, MAX_LINE_LEN);
+}
+
+/* Shuffle masks placing interleaved hex digit pairs into " hl" triples. A line's
+ * 32 digits are split in 'pairs_lo' (bytes 0-7) and 'pairs_hi' (bytes 8-15), each
+ * of the three 16 byte output blocks takes digits from one or both of them, lanes
+ * with index 0x80 are zeroed and receive a space from 'spaces'.
+ */
+#define Z	( (char) 0x80 )
+static const char shuf_blk0_lo[16] = { Z, 0, 1, Z, 2, 3, Z, 4, 5, Z, 6, 7, Z, 8, 9, Z };
+static const char shuf_blk1_lo[16] = { 10, 11, Z, 12, 13, Z, 14, 15, Z, Z, Z, Z, Z, Z, Z, Z };
+static const char shuf_blk1_hi[16] = { Z, Z, Z, Z, Z, Z, Z, Z, Z, 0, 1, Z, 2, 3, Z, 4 };
+static const char shuf_blk2_hi[16] = { 5, Z, 6, 7, Z, 8, 9, Z, 10, 11, Z, 12, 13, Z, 14, 15 };
+static const char spaces_blk0[16]  = { ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ' };
+static const char spaces_blk1[16]  = { 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0 };
+static const char spaces_blk2[16]  = { 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0 };
+#undef Z
+
+/* FUNCTION: dump_lines_ssse3
+ * INPUT ARGUMENTS:
+ * 	dst	: destination of formatted lines
+ * 	src	: bytes to format
+ * 	nlines	: number of full lines to format
+ * PROCESS:
+ * 	a) for each line of MAX_LINE_LEN bytes
+ * 		a1) split bytes in nibbles and translate them to digits with a table shuffle
+ * 		a2) shuffle digit pairs into three blocks of " hl" triples
+ * 		a3) replace bytes outside 0x20-0x7f with '.' for the ascii column
+ * RETURN VALUE: NONE
+ */
+__attribute__((target("ssse3")))
+static void
+dump_lines_ssse3(char *dst, const uint8_t *src, size_t nlines) {
+	const __m128i	lut	= _mm_loadu_si128((const __m128i *) hex_digits);
+	const __m128i	nibble	= _mm_set1_epi8(0x0f);
+	const __m128i	ctrl	= _mm_set1_epi8(0x1f);
+	const __m128i	dot	= _mm_set1_epi8('.');
+	const __m128i	b0_lo	= _mm_loadu_si128((const __m128i *) shuf_blk0_lo);
+	const __m128i	b1_lo	= _mm_loadu_si128((const __m128i *) shuf_blk1_lo);
+	const __m128i	b1_hi	= _mm_loadu_si128((const __m128i *) shuf_blk1_hi);
+	const __m128i	b2_hi	= _mm_loadu_si128((const __m128i *) shuf_blk2_hi);
+	const __m128i	sp0	= _mm_loadu_si128((const __m128i *) spaces_blk0);
+	const __m128i	sp1	= _mm_loadu_si128((const __m128i *) spaces_blk1);
+	const __m128i	sp2	= _mm_loadu_si128((const __m128i *) spaces_blk2);
+	__m128i		v, hi, lo, pairs_lo, pairs_hi, printable, ascii;
+
+	for ( size_t i = 0; i < nlines; ++i, src += MAX_LINE_LEN, dst += DUMP_LINE_LEN ) {
+		v	= _mm_loadu_si128((const __m128i *) src);
+		hi	= _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		lo	= _mm_shuffle_epi8(lut, _mm_and_si128(v, nibble));
+		pairs_lo = _mm_unpacklo_epi8(hi, lo);
+		pairs_hi = _mm_unpackhi_epi8(hi, lo);
+
+		_mm_storeu_si128((__m128i *) ( dst +  0 ), _mm_or_si128(_mm_shuffle_epi8(pairs_lo, b0_lo), sp0));
+		_mm_storeu_si128((__m128i *) ( dst + 16 ), _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(pairs_lo, b1_lo), _mm_shuffle_epi8(pairs_hi, b1_hi)), sp1));
+		_mm_storeu_si128((__m128i *) ( dst + 32 ), _mm_or_si128(_mm_shuffle_epi8(pairs_hi, b2_hi), sp2));
+
+		/* signed compare: 0x80-0xff are negative, matching the scalar 'char' test */
+		printable = _mm_cmpgt_epi8(v, ctrl);
+		ascii	  = _mm_or_si128(_mm_and_si128(printable, v), _mm_andnot_si128(printable, dot));
+
+		dst[48] = ' ';
+		dst[49] = ' ';
+		_mm_storeu_si128((__m128i *) ( dst + 50 ), ascii);
+		dst[66] = '\n';
+	}
+}
+
+/* FUNCTION: dump_lines_avx2
+ * INPUT ARGUMENTS:
+ * 	dst	: destination of formatted lines
+ * 	src	: bytes to format
+ * 	nlines	: number of full lines to format
+ * PROCESS:
+ * 	a) format two lines per iteration, one per 128 bit lane, with the same
+ * 	   shuffles as dump_lines_ssse3()
+ * 	b) format odd remaining line with dump_lines_ssse3()
+ * RETURN VALUE: NONE
+ */
+__attribute__((target("avx2")))
+static void
+dump_lines_avx2(char *dst, const uint8_t *src, size_t nlines) {
+	const __m256i	lut	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) hex_digits));
+	const __m256i	nibble	= _mm256_set1_epi8(0x0f);
+	const __m256i	ctrl	= _mm256_set1_epi8(0x1f);
+	const __m256i	dot	= _mm256_set1_epi8('.');
+	const __m256i	b0_lo	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) shuf_blk0_lo));
+	const __m256i	b1_lo	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) shuf_blk1_lo));
+	const __m256i	b1_hi	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) shuf_blk1_hi));
+	const __m256i	b2_hi	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) shuf_blk2_hi));
+	const __m256i	sp0	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) spaces_blk0));
+	const __m256i	sp1	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) spaces_blk1));
+	const __m256i	sp2	= _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) spaces_blk2));
+	__m256i		v, hi, lo, pairs_lo, pairs_hi, blk0, blk1, blk2, printable, ascii;
+	size_t		i;
+
+	for ( i = 0; i + 2 <= nlines; i += 2, src += 2 * MAX_LINE_LEN, dst += 2 * DUMP_LINE_LEN ) {
+		v	= _mm256_loadu_si256((const __m256i *) src);
+		hi	= _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+		lo	= _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nibble));
+		pairs_lo = _mm256_unpacklo_epi8(hi, lo);
+		pairs_hi = _mm256_unpackhi_epi8(hi, lo);
+
+		blk0	= _mm256_or_si256(_mm256_shuffle_epi8(pairs_lo, b0_lo), sp0);
+		blk1	= _mm256_or_si256(_mm256_or_si256(
+			_mm256_shuffle_epi8(pairs_lo, b1_lo), _mm256_shuffle_epi8(pairs_hi, b1_hi)), sp1);
+		blk2	= _mm256_or_si256(_mm256_shuffle_epi8(pairs_hi, b2_hi), sp2);
+
+		printable = _mm256_cmpgt_epi8(v, ctrl);
+		ascii	  = _mm256_or_si256(_mm256_and_si256(printable, v), _mm256_andnot_si256(printable, dot));
+
+		_mm_storeu_si128((__m128i *) ( dst +  0 ), _mm256_castsi256_si128(blk0));
+		_mm_storeu_si128((__m128i *) ( dst + 16 ), _mm256_castsi256_si128(blk1));
+		_mm_storeu_si128((__m128i *) ( dst + 32 ), _mm256_castsi256_si128(blk2));
+		dst[48] = ' ';
+		dst[49] = ' ';
+		_mm_storeu_si128((__m128i *) ( dst + 50 ), _mm256_castsi256_si128(ascii));
+		dst[66] = '\n';
+
+		_mm_storeu_si128((__m128i *) ( dst + DUMP_LINE_LEN +  0 ), _mm256_extracti128_si256(blk0, 1));
+		_mm_storeu_si128((__m128i *) ( dst + DUMP_LINE_LEN + 16 ), _mm256_extracti128_si256(blk1, 1));
+		_mm_storeu_si128((__m128i *) ( dst + DUMP_LINE_LEN + 32 ), _mm256_extracti128_si256(blk2, 1));
+		dst[DUMP_LINE_LEN + 48] = ' ';
+		dst[DUMP_LINE_LEN + 49] = ' ';
+		_mm_storeu_si128((__m128i *) ( dst + DUMP_LINE_LEN + 50 ), _mm256_extracti128_si256(ascii, 1));
+		dst[DUMP_LINE_LEN + 66] = '\n';
+	}
+
+	if ( i < nlines ) dump_lines_ssse3(dst, src, 1);
+}
+
+/* FUNCTION: select_dump_lines
+ * PROCESS:
+ * 	a) pick widest line kernel supported by the running cpu
+ * RETURN VALUE:
+ * 	pointer to line kernel
+ */
+static void (*select_dump_lines())(char *, const uint8_t *, size_t) {
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) return dump_lines_avx2;
+	if ( __builtin_cpu_supports("ssse3") ) return dump_lines_ssse3;
+	return dump_lines_scalar;
+}
+
+static void (*const dump_lines_impl)(char *, const uint8_t *, size_t) = select_dump_lines();
+
+/* FUNCTION: dump_lines
+ * INPUT ARGUMENTS:
+ * 	dst	: destination of formatted lines, at least 'nlines' * DUMP_LINE_LEN bytes
+ * 	src	: bytes to format, 'nlines' * MAX_LINE_LEN bytes
+ * 	nlines	: number of full lines to format
+ * PROCESS:
+ * 	a) format lines with kernel selected for the running cpu
+ * RETURN VALUE: NONE
+ */
+void
+dump_lines(char *dst, const uint8_t *src, size_t nlines) {
+	dump_lines_impl(dst, src, nlines);
+}
+
+/* FUNCTION: dump_partial_line
+ * INPUT ARGUMENTS:
+ * 	dst	: destination of formatted line, at least DUMP_LINE_LEN bytes
+ * 	src	: bytes to format
+ * 	n	: number of bytes on line
+ * PROCESS:
+ * 	a) format line with the scalar kernel, the vector kernels read whole lines
+ * RETURN VALUE:
+ * 	size_t : length of formatted line
+ */
+size_t
+dump_partial_line(char *dst, const uint8_t *src, size_t n) {
+	return dump_line_scalar(dst, src, n);
+}
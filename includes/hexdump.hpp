@@ -0,0 +1,17 @@
+#ifndef BIN_HEXDUMP_H
+#define BIN_HEXDUMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include "loader.hpp"
+
+#define DUMP_BATCH_LINES	512		/* lines formatted per call into output buffer */
+#define DUMP_WINDOW_SIZE	( 1 << 22 )	/* bytes of a large section resident at once while printed */
+
+/* Format 'nlines' lines of MAX_LINE_LEN bytes from 'src', DUMP_LINE_LEN bytes each, into 'dst' */
+void dump_lines(char *dst, const uint8_t *src, size_t nlines);
+
+/* Format last line of 'n' (< MAX_LINE_LEN) bytes from 'src' into 'dst', return its length */
+size_t dump_partial_line(char *dst, const uint8_t *src, size_t n);
+
+#endif /* BIN_HEXDUMP_H */
@@ -0,0 +1,392 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <capstone/capstone.h>
+#include "insn_stats.hpp"
+#include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+#include "metrics.hpp"
+#include "disasm_backend.hpp"
+#include "linear_disassembler.hpp"
+
+#define MAX_INSN_LEN		15		/* longest x86 instruction encoding */
+
+/* Classes of instructions counted, derived from the histogram of instruction ids */
+enum InsnClass {
+	CLS_CALL	= 0,	/* Direct and far calls */
+	CLS_SYSCALL	= 1,	/* System call entries, including software interrupts */
+	CLS_PRIVILEGED	= 2,	/* Instructions faulting outside ring 0 (or without I/O permission) */
+	NUM_CLASSES	= 3
+};
+
+static const char * const	class_names[NUM_CLASSES] = { "calls", "syscalls", "privileged" };
+
+/* Instruction ids of each class */
+static const struct {
+	unsigned	id;
+	InsnClass	cls;
+} class_ids[] = {
+	{ X86_INS_CALL, CLS_CALL },		{ X86_INS_LCALL, CLS_CALL },
+	{ X86_INS_SYSCALL, CLS_SYSCALL },	{ X86_INS_SYSENTER, CLS_SYSCALL },
+	{ X86_INS_INT, CLS_SYSCALL },
+	{ X86_INS_HLT, CLS_PRIVILEGED },	{ X86_INS_CLI, CLS_PRIVILEGED },
+	{ X86_INS_STI, CLS_PRIVILEGED },	{ X86_INS_IN, CLS_PRIVILEGED },
+	{ X86_INS_OUT, CLS_PRIVILEGED },	{ X86_INS_INSB, CLS_PRIVILEGED },
+	{ X86_INS_INSW, CLS_PRIVILEGED },	{ X86_INS_INSD, CLS_PRIVILEGED },
+	{ X86_INS_OUTSB, CLS_PRIVILEGED },	{ X86_INS_OUTSW, CLS_PRIVILEGED },
+	{ X86_INS_OUTSD, CLS_PRIVILEGED },	{ X86_INS_LGDT, CLS_PRIVILEGED },
+	{ X86_INS_LIDT, CLS_PRIVILEGED },	{ X86_INS_LLDT, CLS_PRIVILEGED },
+	{ X86_INS_LTR, CLS_PRIVILEGED },	{ X86_INS_LMSW, CLS_PRIVILEGED },
+	{ X86_INS_CLTS, CLS_PRIVILEGED },	{ X86_INS_INVD, CLS_PRIVILEGED },
+	{ X86_INS_WBINVD, CLS_PRIVILEGED },	{ X86_INS_INVLPG, CLS_PRIVILEGED },
+	{ X86_INS_RDMSR, CLS_PRIVILEGED },	{ X86_INS_WRMSR, CLS_PRIVILEGED },
+	{ X86_INS_SWAPGS, CLS_PRIVILEGED },	{ X86_INS_SYSRET, CLS_PRIVILEGED },
+	{ X86_INS_SYSEXIT, CLS_PRIVILEGED },
+};
+
+#define RESYNC_INSNS		64		/* instructions at the start of a range kept to resynchronize it */
+
+/* One decoding step: an instruction, or an undecodable byte when 'size' is 0 */
+struct DecodedInsn {
+	uint64_t	addr;		/* address of instruction or byte */
+	uint16_t	id;		/* capstone instruction id */
+	uint8_t		size;		/* encoded length, 0 for an undecodable byte */
+};
+
+/* Counts gathered by one worker, merged once all code is decoded */
+struct InsnStats {
+	std :: vector <uint64_t>	by_id;				/* instructions per capstone id */
+	uint64_t			by_len[MAX_INSN_LEN + 1];	/* instructions per encoded length */
+	uint64_t			bad;				/* undecodable bytes */
+
+	InsnStats() : by_id(X86_INS_ENDING, 0), bad(0) { memset(by_len, 0, sizeof(by_len)); }
+
+	/* Count decoding step 'd' times, (uint64_t) -1 takes it back */
+	void add(const DecodedInsn &i, uint64_t d) {
+		if ( !i.size ) { bad += d; return; }
+		if ( i.id < by_id.size() ) by_id[i.id] += d;
+		by_len[i.size] += d;
+	}
+
+	void merge(const InsnStats &o) {
+		for ( size_t i = 0; i < by_id.size(); ++i ) by_id[i] += o.by_id[i];
+		for ( int i = 0; i <= MAX_INSN_LEN; ++i ) by_len[i] += o.by_len[i];
+		bad += o.bad;
+	}
+};
+
+/* A range of a code section decoded by one worker */
+struct StatsJob {
+	Section				*sec;		/* code section */
+	uint64_t			start;		/* address decoding starts at */
+	uint64_t			end;		/* decoding stops at the first instruction starting past it */
+	uint64_t			stop;		/* address following last decoded instruction */
+	uint64_t			head_stop;	/* address following last step kept in 'head' */
+	std :: vector <DecodedInsn>	head;		/* first RESYNC_INSNS steps decoded */
+};
+
+/* FUNCTION: decode_step
+ * INPUT ARGUMENTS:
+ * 	h	: capstone handle, without instruction details
+ * 	pc	: next byte to decode, advanced past the step
+ * 	n	: bytes left in section, decreased by the step
+ * 	addr	: address of next byte, advanced past the step
+ * 	step	: receives decoded instruction, or undecodable byte
+ * PROCESS:
+ * 	a) decode one instruction, or skip one byte to resynchronize at the following one
+ * RETURN VALUE: NONE
+ */
+static inline void
+decode_step(DisasmHandle *h, const uint8_t **pc, size_t *n, uint64_t *addr, DecodedInsn *step) {
+	step -> addr = *addr;
+	if ( cs_disasm_iter(h -> dis, pc, n, addr, h -> insn) ) {
+		step -> id   = h -> insn -> id;
+		step -> size = h -> insn -> size;
+		return;
+	}
+
+	step -> id   = 0;
+	step -> size = 0;
+	++*pc;
+	--*n;
+	++*addr;
+}
+
+/* FUNCTION: count_range
+ * INPUT ARGUMENTS:
+ * 	h	: capstone handle, without instruction details
+ * 	job	: range to decode, receives address decoding stopped at and first steps
+ * 	s	: counts of worker
+ * PROCESS:
+ * 	a) decode instructions one at a time, counting their id and length
+ * 	b) count undecodable bytes and resynchronize at the following byte
+ * 	c) keep the first RESYNC_INSNS steps, so a range entered mid-instruction can be
+ * 	   realigned with the previous one by resync_range()
+ * RETURN VALUE: NONE
+ */
+static void
+count_range(DisasmHandle *h, StatsJob &job, InsnStats &s) {
+	const uint8_t	*pc;		/* next byte to decode */
+	size_t		n;		/* bytes left in section */
+	uint64_t	addr;		/* address of next byte to decode */
+	DecodedInsn	step;		/* decoded instruction or byte */
+
+	pc   = job.sec -> bytes + ( job.start - job.sec -> vma );
+	n    = job.sec -> size - ( job.start - job.sec -> vma );
+	addr = job.start;
+
+	job.head.reserve(RESYNC_INSNS);
+	while ( n > 0 && addr < job.end ) {
+		decode_step(h, &pc, &n, &addr, &step);
+		s.add(step, 1);
+		if ( job.head.size() < RESYNC_INSNS ) {
+			job.head.push_back(step);
+			job.head_stop = addr;
+		}
+	}
+
+	job.stop = addr;
+}
+
+/* FUNCTION: resync_range
+ * INPUT ARGUMENTS:
+ * 	h	: capstone handle, without instruction details
+ * 	job	: range decoded by count_range(), its stop is updated
+ * 	pos	: address the previous range's last instruction ended at, past job's start
+ * 	s	: merged counts, corrected to those of a sequential sweep
+ * PROCESS:
+ * 	a) decode from 'pos', counting, until the stream lands on a step kept in the
+ * 	   job's head, and take back the head steps before it
+ * 	b) if it never does (head exhausted, or end of range reached), take back all of
+ * 	   the job's counts, re-decoding what follows the head the way the job did, then
+ * 	   count the rest of the range from the sequential stream
+ * RETURN VALUE: NONE
+ */
+static void
+resync_range(DisasmHandle *h, StatsJob &job, uint64_t pos, InsnStats &s) {
+	const uint8_t	*pc;		/* next byte to decode */
+	size_t		n;		/* bytes left in section */
+	uint64_t	addr;		/* address of next byte to decode */
+	DecodedInsn	step;		/* decoded instruction or byte */
+	size_t		k;		/* first head step not below 'pos' */
+
+	pc = job.sec -> bytes + ( pos - job.sec -> vma );
+	n  = job.sec -> size - ( pos - job.sec -> vma );
+
+	for ( k = 0; n > 0 && pos < job.end; ) {
+		while ( k < job.head.size() && job.head[k].addr < pos ) ++k;
+		if ( k == job.head.size() && job.head.size() == RESYNC_INSNS ) break;
+		if ( k < job.head.size() && job.head[k].addr == pos ) {
+			for ( size_t i = 0; i < k; ++i ) s.add(job.head[i], (uint64_t) -1);
+			return;
+		}
+
+		decode_step(h, &pc, &n, &pos, &step);
+		s.add(step, 1);
+	}
+
+	/* job's stream never met the sequential one: none of its counts stand */
+	for ( auto &i : job.head ) s.add(i, (uint64_t) -1);
+	if ( job.head.size() == RESYNC_INSNS ) {
+		const uint8_t	*jpc = job.sec -> bytes + ( job.head_stop - job.sec -> vma );
+		size_t		jn   = job.sec -> size - ( job.head_stop - job.sec -> vma );
+
+		for ( addr = job.head_stop; jn > 0 && addr < job.end; ) {
+			decode_step(h, &jpc, &jn, &addr, &step);
+			s.add(step, (uint64_t) -1);
+		}
+	}
+
+	while ( n > 0 && pos < job.end ) {
+		decode_step(h, &pc, &n, &pos, &step);
+		s.add(step, 1);
+	}
+
+	job.stop = pos;
+}
+
+/* FUNCTION: print_stat
+ * INPUT ARGUMENTS:
+ * 	kind	: STAT_* kind of count
+ * 	name	: name of count
+ * 	count	: value
+ * 	total	: count 'count' is a share of, 0 to print no percentage
+ * PROCESS:
+ * 	a) print one row of a statistics table, or a stat record
+ * RETURN VALUE: NONE
+ */
+static void
+print_stat(uint8_t kind, const char *name, uint64_t count, uint64_t total) {
+	uint64_t	pct;	/* share in hundredths of a percent */
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_stat(*out, kind, name, count);
+		return;
+	}
+
+	out -> put(' ');
+	out -> str(name, -20);
+	out -> put(' ');
+	out -> dec(count, 14);
+	if ( total ) {
+		pct = count * 10000 / total;
+		out -> put(' ');
+		out -> dec(pct / 100, 4);
+		out -> put('.');
+		out -> put('0' + pct / 10 % 10);
+		out -> put('0' + pct % 10);
+		out -> put('%');
+	}
+	out -> put('\n');
+}
+
+/* FUNCITON: disasm_stats
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	nthreads: number of workers
+ * PROCESS:
+ * 	a) retrieve contents of code sections and cut them into ranges at function symbols
+ * 	b) decode ranges on 'nthreads' workers, with capstone details disabled, each
+ * 	   counting into histograms of its own stack, merged under a lock when done
+ * 	c) where the previous range's last instruction ran past the start of a range
+ * 	   (cut at a fixed offset), realign it so counts match a sequential sweep
+ * 	d) derive class counts from instruction ids
+ * 	e) print totals, classes, lengths and most frequent mnemonics (all of them in
+ * 	   machine readable formats)
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - decoded
+ *		-1 - failure
+ */
+int
+disasm_stats(Binary &bin, unsigned nthreads) {
+	DisasmMode			mode;		/* decoding mode of binary */
+	DisasmHandle			*h;		/* capstone handle of calling thread */
+	std :: vector <StatsJob>	jobs;		/* ranges to decode */
+	InsnStats			all;		/* counts of all workers */
+	std :: mutex			lock;		/* guards 'all' while workers merge */
+	std :: vector <std :: thread>	workers;	/* decoding threads */
+	std :: atomic <size_t>		next(0);	/* next job to take */
+	std :: atomic <bool>		failed(false);	/* a worker could not open capstone */
+	std :: vector <uint32_t>	ids;		/* ids of decoded mnemonics, most frequent first */
+	uint64_t			classes[NUM_CLASSES];
+	uint64_t			ninsns, nbytes, size;
+	uint64_t			pos;		/* address previous range stopped at */
+	size_t				nsecs;		/* code sections */
+	char				name[8];	/* name of length row */
+
+	mode = disasm_mode(bin);
+	if ( !( h = acquire_handle(mode) ) ) return -1;
+
+	nsecs = size = 0;
+	for ( auto &sec : bin.sections ) {
+		std :: vector <std :: pair <uint64_t, uint64_t> >	ranges;	/* ranges of section */
+
+		if ( sec.type != Section :: SEC_TYPE_CODE || !sec.size ) continue;
+		if ( !sec.get_bytes() ) return -1;
+
+		partition_code(bin, &sec, ranges);
+		for ( auto &r : ranges ) jobs.push_back(StatsJob { &sec, r.first, r.second, r.first, r.first, {} });
+		++nsecs;
+		size += sec.size;
+	}
+
+	if ( nthreads < 1 ) nthreads = 1;
+	if ( nthreads > jobs.size() ) nthreads = jobs.size() ? jobs.size() : 1;
+
+	auto work = [&]() {
+		DisasmHandle	*wh;		/* capstone handle of this worker */
+		InsnStats	mine;		/* counts of this worker, kept off shared cache lines */
+		size_t		j;		/* job taken */
+		PhaseTimer	timer(Metrics :: PHASE_DECODE);
+
+		if ( !( wh = acquire_handle(mode) ) ) {
+			failed = true;
+			return;
+		}
+
+		while ( !failed && ( j = next.fetch_add(1) ) < jobs.size() )
+			count_range(wh, jobs[j], mine);
+
+		std :: lock_guard <std :: mutex> g(lock);
+		all.merge(mine);
+	};
+
+	for ( unsigned t = 1; t < nthreads; ++t ) workers.push_back(std :: thread(work));
+	work();
+	for ( auto &w : workers ) w.join();
+
+	if ( failed ) return -1;
+
+	PhaseTimer	timer(Metrics :: PHASE_DECODE);
+	pos = 0;
+	for ( size_t j = 0; j < jobs.size(); ++j ) {
+		if ( !j || jobs[j].sec != jobs[j - 1].sec ) pos = jobs[j].start;
+		if ( pos > jobs[j].start ) resync_range(h, jobs[j], pos, all);
+		pos = jobs[j].stop;
+	}
+
+	ninsns = nbytes = 0;
+	for ( int i = 1; i <= MAX_INSN_LEN; ++i ) {
+		ninsns += all.by_len[i];
+		nbytes += all.by_len[i] * i;
+	}
+	metrics.count(Metrics :: CNT_INSNS, ninsns);
+
+	memset(classes, 0, sizeof(classes));
+	for ( auto &c : class_ids ) classes[c.cls] += all.by_id[c.id];
+
+	for ( uint32_t i = 0; i < all.by_id.size(); ++i )
+		if ( all.by_id[i] ) ids.push_back(i);
+	std :: stable_sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+		return all.by_id[a] > all.by_id[b];
+	});
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		red();
+		out -> lit("[*] Instruction statistics of ");
+		out -> dec(nsecs);
+		out -> lit(" code sections (");
+		out -> dec(size);
+		out -> lit(" bytes):\n");
+		reset_color();
+	}
+	print_stat(STAT_TOTAL, "instructions", ninsns, 0);
+	print_stat(STAT_TOTAL, "bytes decoded", nbytes, size);
+	print_stat(STAT_TOTAL, "undecodable bytes", all.bad, size);
+	for ( int c = 0; c < NUM_CLASSES; ++c ) print_stat(STAT_CLASS, class_names[c], classes[c], ninsns);
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		red();
+		out -> lit("[*] Instruction lengths:\n");
+		blue();
+		out -> lit(" LENGTH                        COUNT  PERCENT\n");
+		reset_color();
+	}
+	for ( int i = 1; i <= MAX_INSN_LEN; ++i ) {
+		if ( !all.by_len[i] ) continue;
+		snprintf(name, sizeof(name), "%d", i);
+		print_stat(STAT_LENGTH, name, all.by_len[i], ninsns);
+	}
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		red();
+		out -> lit("[*] Most frequent mnemonics (");
+		out -> dec(std :: min <size_t> (ids.size(), STATS_TOP_MNEMONICS));
+		out -> lit(" of ");
+		out -> dec(ids.size());
+		out -> lit("):\n");
+		blue();
+		out -> lit(" MNEMONIC                      COUNT  PERCENT\n");
+		reset_color();
+		if ( ids.size() > STATS_TOP_MNEMONICS ) ids.resize(STATS_TOP_MNEMONICS);
+	}
+	for ( auto i : ids ) print_stat(STAT_MNEMONIC, cs_insn_name(h -> dis, i), all.by_id[i], ninsns);
+
+	return 0;
+}
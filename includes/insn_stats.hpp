@@ -0,0 +1,12 @@
+#ifndef BIN_INSN_STATS_H
+#define BIN_INSN_STATS_H
+
+#include "loader.hpp"
+
+#define STATS_TOP_MNEMONICS	32		/* most frequent mnemonics listed in text report */
+
+/* Decode all code sections without instruction details on 'nthreads' workers and report
+ * instruction counts by class, encoded length and mnemonic; instructions are never formatted */
+int disasm_stats(Binary &bin, unsigned nthreads = 1);
+
+#endif /* BIN_INSN_STATS_H */
@@ -1,27 +1,387 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <capstone/capstone.h>
-#include "loader.hpp"
+#include "linear_disassembler.hpp"
 #include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+#include "metrics.hpp"
+#include "disasm_backend.hpp"
+
+/* A contiguous part of .text decoded independently by one worker */
+struct Shard {
+    uint64_t        start;      /* address decoding of shard starts at */
+    uint64_t        end;        /* address shard ends at, last instruction may run past it */
+    uint64_t        stop;       /* address following last decoded instruction */
+    OutputBuffer    out;        /* formatted instructions, captured in memory */
+    std :: vector <std :: pair <uint64_t, size_t> > marks;  /* instruction address, offset in 'out' */
+    bool            done;       /* set once worker finished decoding the shard */
+
+    Shard(uint64_t s, uint64_t e) : start(s), end(e), stop(s), out(-1, 0), done(false) {}
+};
+
+/* FUNCTION: format_insn
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer to append formatted instruction to
+ * 	addr	: address of instruction
+ * 	bytes	: encoded bytes of instruction
+ * 	size	: number of encoded bytes
+ * 	mnemonic: instruction mnemonic
+ * 	op_str	: instruction operands
+ * PROCESS:
+ * 	a) in machine readable formats, emit an instruction record
+ * 	b) otherwise append address, raw bytes (padded to 16 columns), mnemonic and operands
+ * RETURN VALUE: NONE
+ */
+void
+format_insn(OutputBuffer &o, uint64_t addr, const uint8_t *bytes, size_t size,
+            const char *mnemonic, const char *op_str) {
+    char    *p;     /* raw bytes column */
+
+    if ( out_format != OutputBuffer :: FMT_TEXT ) {
+        emit_insn(o, addr, bytes, size, mnemonic, op_str);
+        return;
+    }
+
+    o.lit(GRN);
+    o.lit("0x");
+    o.hex(addr, 16);
+    o.lit(": ");
+    o.lit(RESET);
+
+    p = o.reserve(16 * 3);
+    for ( size_t j = 0; j < 16; ++j, p += 3 ) {
+        if ( j < size ) {
+            p[0] = OutputBuffer :: hex_digits[bytes[j] >> 4];
+            p[1] = OutputBuffer :: hex_digits[bytes[j] & 0xf];
+        } else {
+            p[0] = p[1] = ' ';
+        }
+        p[2] = ' ';
+    }
+    o.advance(16 * 3);
+
+    o.str(mnemonic, -8);
+    o.put(' ');
+    o.str(op_str);
+    o.put('\n');
+}
+
+/* FUNCTION: format_data_byte
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer to append formatted directive to
+ * 	addr	: address of byte
+ * 	pc	: byte capstone could not decode
+ * PROCESS:
+ * 	a) append byte as a '.byte' data directive in instruction format
+ * RETURN VALUE: NONE
+ */
+static void
+format_data_byte(OutputBuffer &o, uint64_t addr, const uint8_t *pc) {
+    char    op[5];  /* operand of data directive */
+
+    op[0] = '0';
+    op[1] = 'x';
+    op[2] = OutputBuffer :: hex_digits[*pc >> 4];
+    op[3] = OutputBuffer :: hex_digits[*pc & 0xf];
+    op[4] = '\0';
+
+    format_insn(o, addr, pc, 1, ".byte", op);
+}
+
+/* FUNCTION: log_insn
+ * INPUT ARGUMENTS:
+ * 	log	: buffer receiving record
+ * 	size	: number of encoded bytes
+ * 	mnemonic: instruction mnemonic
+ * 	op_str	: instruction operands
+ * PROCESS:
+ * 	a) append size, then mnemonic and operands each preceded by its length
+ * RETURN VALUE: NONE
+ */
+static void
+log_insn(OutputBuffer &log, size_t size, const char *mnemonic, const char *op_str) {
+    size_t  m = strlen(mnemonic), o = strlen(op_str);
+
+    log.put((char) size);
+    log.put((char) m);
+    log.write(mnemonic, m);
+    log.put((char) o);
+    log.write(op_str, o);
+}
+
+/* FUNCTION: decode_range
+ * INPUT ARGUMENTS:
+ * 	dis	: handler to capstone api
+ * 	insn	: reusable capstone instruction
+ * 	sec	: section being decoded
+ * 	bytes	: contents of section
+ * 	start	: address to start decoding at
+ * 	end	: decoding stops at the first instruction starting at or after this address
+ * 	out	: output buffer to append formatted instructions to
+ * 	marks	: if not NULL, receives address and output offset of every instruction
+ * 	log	: if not NULL, receives a record of every instruction (see disasm())
+ * PROCESS:
+ * 	a) decode and format instructions one at a time from 'start'
+ * 	b) format undecodable bytes as data and resynchronize at the following byte
+ * 	c) when instrumenting, charge decoding and formatting to their phases
+ * RETURN VALUE:
+ * 	uint64_t : address following the last decoded instruction
+ */
+static uint64_t
+decode_range(csh dis, cs_insn *insn, Section *sec, const uint8_t *bytes, uint64_t start, uint64_t end,
+             OutputBuffer &out, std :: vector <std :: pair <uint64_t, size_t> > *marks, OutputBuffer *log) {
+    const uint8_t   *pc;        /* next byte to decode */
+    size_t          n;          /* bytes left in section */
+    uint64_t        addr;       /* address of next byte to decode */
+    uint64_t        ninsns;     /* instructions decoded */
+    PhaseTimer      timer;      /* splits time between decoding and formatting */
+
+    pc     = bytes + ( start - sec -> vma );
+    n      = sec -> size - ( start - sec -> vma );
+    addr   = start;
+    ninsns = 0;
+
+    while ( n > 0 && addr < end ) {
+        if ( marks ) marks -> push_back(std :: make_pair(addr, out.size()));
+
+        /* cs_disasm_iter advances pc, n and addr past the decoded instruction */
+        if ( cs_disasm_iter(dis, &pc, &n, &addr, insn) ) {
+            timer.lap(Metrics :: PHASE_DECODE);
+            format_insn(out, insn -> address, insn -> bytes, insn -> size, insn -> mnemonic, insn -> op_str);
+            if ( log ) log_insn(*log, insn -> size, insn -> mnemonic, insn -> op_str);
+            timer.lap(Metrics :: PHASE_FORMAT);
+            ++ninsns;
+            continue;
+        }
+
+        /* undecodable byte: emit it as data and resume decoding at the next byte */
+        timer.lap(Metrics :: PHASE_DECODE);
+        format_data_byte(out, addr, pc);
+        if ( log ) log -> put(0);
+        timer.lap(Metrics :: PHASE_FORMAT);
+        ++pc;
+        --n;
+        ++addr;
+    }
+
+    metrics.count(Metrics :: CNT_INSNS, ninsns);
+
+    return addr;
+}
+
+/* FUNCTION: partition_code
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	sec	: code section of binary
+ * 	ranges	: receives start and end of ranges covering section in address order
+ * PROCESS:
+ * 	a) select function symbols by address, keep starts of those inside section
+ * 	b) cut section roughly every SHARD_SIZE bytes, at a function start where one is
+ * 	   close enough, otherwise at a fixed offset
+ * RETURN VALUE: NONE
+ */
+void
+partition_code(Binary &bin, Section *sec, std :: vector <std :: pair <uint64_t, uint64_t> > &ranges) {
+    std :: vector <uint32_t>            funs;       /* function symbols, by address */
+    std :: vector <uint64_t>            starts;     /* function start addresses in section, ascending */
+    std :: vector <uint64_t> :: iterator it;        /* first function start past preferred cut */
+    uint64_t                            pos, cut;   /* start and end of range being cut */
+    uint64_t                            end;        /* end of section */
+
+    bin.select_symbols(Symbol :: SYM_TYPE_FUN, funs, true);
+    for ( auto i : funs )
+        if ( sec -> contains(bin.symbols[i].addr) ) starts.push_back(bin.symbols[i].addr);
+
+    pos = sec -> vma;
+    end = sec -> vma + sec -> size;
+
+    while ( pos < end ) {
+        cut = ( end - pos > SHARD_SIZE ) ? pos + SHARD_SIZE : end;
+        it  = std :: lower_bound(starts.begin(), starts.end(), cut);
+
+        if ( it != starts.end() && *it - pos <= 2 * SHARD_SIZE ) cut = *it;
+        if ( cut > end ) cut = end;
+
+        ranges.push_back(std :: make_pair(pos, cut));
+        pos = cut;
+    }
+}
+
+/* FUNCTION: partition_text
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	text	: .text section of binary
+ * 	shards	: receives shards covering .text in address order
+ * PROCESS:
+ * 	a) cut .text with partition_code(), fixed offset cuts are resynchronized while merging
+ * RETURN VALUE: NONE
+ */
+static void
+partition_text(Binary &bin, Section *text, std :: vector <Shard> &shards) {
+    std :: vector <std :: pair <uint64_t, uint64_t> >   ranges;     /* start and end of shards */
+
+    partition_code(bin, text, ranges);
+    for ( auto &r : ranges ) shards.push_back(Shard(r.first, r.second));
+}
+
+/* FUNCTION: disasm_parallel
+ * INPUT ARGUMENTS:
+ * 	text	: .text section of binary
+ * 	bytes	: contents of .text section
+ * 	shards	: partition of .text
+ * 	nthreads: number of workers
+ * 	mode	: decoding mode of binary
+ * PROCESS:
+ * 	a) start workers, each with its thread's capstone handle, decoding shards in order
+ * 	   but no more than SHARD_WINDOW shards per worker ahead of output
+ * 	b) print finished shards in address order, when the previous shard's last
+ * 	   instruction ran past the start of a shard, decode from there until the
+ * 	   instruction stream meets an instruction of the shard and splice the rest
+ * 	   so output matches a sequential sweep byte for byte
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - disassembled
+ *		-1 - failure
+ */
+static int
+disasm_parallel(Section *text, const uint8_t *bytes, std :: vector <Shard> &shards, unsigned nthreads, DisasmMode mode) {
+    std :: mutex                lock;       /* guards 'next', 'emitted', 'failed' and Shard :: done */
+    std :: condition_variable   cv;         /* signalled whenever a shard is finished or printed */
+    std :: vector <std :: thread> workers;  /* decoding threads */
+    size_t                      next;       /* next shard to hand to a worker */
+    size_t                      emitted;    /* shards printed so far */
+    bool                        failed;     /* a worker could not open capstone */
+    DisasmHandle                *h;         /* capstone handle used to resynchronize shards */
+    uint64_t                    pos;        /* address following last printed instruction */
+
+    next    = 0;
+    emitted = 0;
+    failed  = false;
+
+    if ( !( h = acquire_handle(mode) ) ) return -1;
+
+    for ( unsigned t = 0; t < nthreads; ++t ) {
+        workers.push_back(std :: thread([&]() {
+            DisasmHandle    *wh;    /* capstone handle of this worker */
+            size_t          i;      /* shard being decoded */
+
+            if ( !( wh = acquire_handle(mode) ) ) {
+                std :: lock_guard <std :: mutex> g(lock);
+                failed = true;
+                cv.notify_all();
+                return;
+            }
+
+            for ( ;; ) {
+                {
+                    std :: unique_lock <std :: mutex> g(lock);
+                    cv.wait(g, [&]() { return next < emitted + SHARD_WINDOW * nthreads || failed; });
+                    if ( failed || next >= shards.size() ) break;
+                    i = next++;
+                }
+
+                Shard &s = shards[i];
+                s.stop = decode_range(wh -> dis, wh -> insn, text, bytes, s.start, s.end, s.out, &s.marks, NULL);
+
+                std :: lock_guard <std :: mutex> g(lock);
+                s.done = true;
+                cv.notify_all();
+            }
+        }));
+    }
+
+    pos = text -> vma;
+
+    for ( size_t i = 0; i < shards.size(); ++i ) {
+        Shard &s = shards[i];
+
+        {
+            std :: unique_lock <std :: mutex> g(lock);
+            cv.wait(g, [&]() { return s.done || failed; });
+            if ( failed ) break;
+        }
+
+        if ( pos == s.start ) {
+            out -> write(s.out.data(), s.out.size());
+            pos = s.stop;
+        } else {
+            /* previous shard ran past our start: decode until we land on one of our instructions */
+            const uint8_t   *pc = bytes + ( pos - text -> vma );
+            size_t          n   = text -> size - ( pos - text -> vma );
+            size_t          off = std :: string :: npos;
+
+            while ( n > 0 && pos < s.end ) {
+                auto m = std :: lower_bound(s.marks.begin(), s.marks.end(), std :: make_pair(pos, (size_t) 0));
+                if ( m != s.marks.end() && m -> first == pos ) {
+                    off = m -> second;
+                    break;
+                }
+
+                if ( cs_disasm_iter(h -> dis, &pc, &n, &pos, h -> insn) ) {
+                    format_insn(*out, h -> insn -> address, h -> insn -> bytes, h -> insn -> size,
+                                h -> insn -> mnemonic, h -> insn -> op_str);
+                    continue;
+                }
+
+                format_data_byte(*out, pos, pc);
+                ++pc;
+                --n;
+                ++pos;
+            }
+
+            if ( off != std :: string :: npos ) {
+                out -> write(s.out.data() + off, s.out.size() - off);
+                pos = s.stop;
+            }
+        }
+
+        /* release memory of printed shard and let workers move ahead */
+        s.out.release();
+        std :: vector <std :: pair <uint64_t, size_t> >().swap(s.marks);
+
+        std :: lock_guard <std :: mutex> g(lock);
+        ++emitted;
+        cv.notify_all();
+    }
+
+    for ( auto &w : workers ) w.join();
+
+    if ( failed ) return -1;
+
+    return 0;
+}
 
 /* FUNCITON: disasm
  * INPUT ARGUMENTS:
- * 	bin : binary file loaded
+ * 	bin	: binary file loaded
+ * 	nthreads: number of threads to decode with
+ * 	log	: if not NULL, receives a record of every instruction
  * PROCESS:
- * 	a) Retreive .text section of binary
- * 	b) Create an instance of capstone handler (dis)
- * 	c) disassemble all the instuctions in .text section and store in local variable 'insns'
- * 	d) print the disassembled instructions from insns
+ * 	a) Retreive .text section of binary and its contents
+ * 	b) if more than one thread is requested and no log is kept, split .text at
+ * 	   function symbols and decode the shards in parallel
+ * 	c) otherwise decode with the thread's capstone handle for the binary's
+ * 	   architecture, printing each instruction as soon as it is decoded
+ * 	d) print undecodable bytes as data and resynchronize at the following byte
  * RETURN VALUE:
  *	int : statue code
  *		 0 - disassembled
  *		-1 - failure
  */
 int
-disasm(Binary &bin) {
-    csh         dis;		/* handler to capstone api */
-    cs_insn     *insns;		/* capstone internal data structure to store disassembly */
-    Section     *text;		/* .text section of binary */
-    size_t      n;		/* number of instructions decoded */
+disasm(Binary &bin, unsigned nthreads, OutputBuffer *log) {
+    DisasmHandle            *h;		/* capstone handle of calling thread */
+    Section                 *text;	/* .text section of binary */
+    uint8_t                 *bytes;	/* contents of .text section */
+    std :: vector <Shard>   shards;	/* partition of .text for parallel decoding */
 
     text = bin.get_text_section();
 
@@ -30,36 +390,237 @@ disasm(Binary &bin) {
         return 0;
     }
 
-    if ( cs_open(CS_ARCH_X86, CS_MODE_64, &dis) != CS_ERR_OK ) {
-        fprintf(stderr, "Failed to open Capstone");
-        return -1;
+    /* retrieve .text contents on first use */
+    if ( !( bytes = text -> get_bytes() ) ) return -1;
+
+    if ( out_format == OutputBuffer :: FMT_TEXT ) {
+        red();
+        out -> lit("[*] Disassembly of .text section:\n");
+        reset_color();
     }
 
-    n = cs_disasm(dis, text -> bytes, text -> size, text -> vma, 0, &insns);
+    if ( nthreads > 1 && !log ) {
+        partition_text(bin, text, shards);
+        if ( shards.size() > 1 ) return disasm_parallel(text, bytes, shards, nthreads, disasm_mode(bin));
+    }
 
-    if ( n <= 0 ) {
-        fprintf(stderr, "Disassembly error: %s\n", cs_strerror(cs_errno(dis)));
-        return -1;
+    if ( !( h = acquire_handle(bin) ) ) return -1;
+
+    /* instructions go straight to the output buffer as they are decoded */
+    decode_range(h -> dis, h -> insn, text, bytes, text -> vma, text -> vma + text -> size, *out, NULL, log);
+
+    return 0;
+}
+
+/* FUNCTION: target_error
+ * INPUT ARGUMENTS:
+ * 	msg	: error message, with terminating newline
+ * PROCESS:
+ * 	a) report on standard error when output goes to standard output
+ * 	b) otherwise append message to output of calling thread, so a captured or
+ * 	   forwarded reply (batch file, server query) carries it
+ * RETURN VALUE: NONE
+ */
+static void
+target_error(const char *msg) {
+    if ( out == &stdout_buf ) fputs(msg, stderr);
+    else out -> str(msg);
+}
+
+/* FUNCTION: resolve_target
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	target	: symbol name or 'start:end' address range
+ * 	start	: receives first address to decode
+ * 	end	: receives address decoding stops at
+ * PROCESS:
+ * 	a) parse 'start:end' if both halves are numbers (decimal, or hex with 0x)
+ * 	b) otherwise look symbol up by name, it extends up to the next symbol
+ * 	c) locate section containing start and clamp end to it
+ * RETURN VALUE:
+ * 	Section * : section containing range, NULL on failure
+ */
+static Section *
+resolve_target(Binary &bin, const char *target, uint64_t *start, uint64_t *end) {
+    const char  *colon;     /* separator of address range */
+    char        *p;         /* end of parsed number */
+    Symbol      *sym;       /* symbol named 'target' */
+    Section     *sec;       /* section containing range */
+    bool        range;      /* target is an address range */
+    char        msg[256];   /* error message */
+
+    range = false;
+    if ( ( colon = strchr(target, ':') ) && colon != target && colon[1] ) {
+        *start = strtoull(target, &p, 0);
+        range  = ( p == colon );
+        if ( range ) {
+            *end  = strtoull(colon + 1, &p, 0);
+            range = ( *p == '\0' );
+        }
+    }
+
+    if ( !range ) {
+        if ( !( sym = bin.find_symbol(target) ) || !sym -> addr ) {
+            snprintf(msg, sizeof(msg), "[!!] No symbol named %s\n", target);
+            target_error(msg);
+            return NULL;
+        }
+        *start = sym -> addr;
+        sym    = bin.next_symbol(*start);
+        *end   = sym ? sym -> addr : UINT64_MAX;
+    }
+
+    if ( !( sec = bin.find_section(*start) ) ) {
+        snprintf(msg, sizeof(msg), "[!!] Address 0x%016jx of %s is not in any section\n", (uintmax_t) *start, target);
+        target_error(msg);
+        return NULL;
+    }
+
+    if ( *end > sec -> vma + sec -> size ) *end = sec -> vma + sec -> size;
+    if ( *end <= *start ) {
+        snprintf(msg, sizeof(msg), "[!!] Empty address range %s\n", target);
+        target_error(msg);
+        return NULL;
+    }
+
+    return sec;
+}
+
+/* FUNCITON: disasm_range
+ * INPUT ARGUMENTS:
+ * 	sec	: section containing range
+ * 	start	: first address to decode
+ * 	end	: decoding stops at the first instruction starting at or after this address
+ * PROCESS:
+ * 	a) retrieve contents of section, mapped contents are touched only where decoded
+ * 	b) decode and print instructions starting in the range
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - disassembled
+ *		-1 - failure
+ */
+int
+disasm_range(Section *sec, uint64_t start, uint64_t end) {
+    DisasmHandle    *h;         /* capstone handle of calling thread */
+    uint8_t         *bytes;     /* contents of section */
+
+    if ( !( bytes = sec -> get_bytes() ) ) return -1;
+    if ( !( h = acquire_handle(*sec -> binary) ) ) return -1;
+
+    decode_range(h -> dis, h -> insn, sec, bytes, start, end, *out, NULL, NULL);
+
+    return 0;
+}
+
+/* FUNCITON: disasm_target
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	target	: symbol name or 'start:end' address range
+ * PROCESS:
+ * 	a) resolve target to an address range within one section
+ * 	b) decode only that range
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - disassembled
+ *		-1 - failure
+ */
+int
+disasm_target(Binary &bin, const char *target) {
+    Section         *sec;       /* section containing range */
+    uint64_t        start, end; /* address range to decode */
+
+    if ( !( sec = resolve_target(bin, target, &start, &end) ) ) return -1;
+
+    if ( out_format == OutputBuffer :: FMT_TEXT ) {
+        red();
+        out -> lit("[*] Disassembly of ");
+        out -> str(target);
+        out -> lit(" in ");
+        out -> str(sec -> name.c_str());
+        out -> lit(" (0x");
+        out -> hex(start, 16);
+        out -> lit(" - 0x");
+        out -> hex(end, 16);
+        out -> lit("):\n");
+        reset_color();
     }
 
-    red();
-    printf("[*] Disassembly of .text section:\n");
-    reset_color();
-    for ( size_t i = 0; i < n; ++i ) {
-	green();
-        printf("0x%016jx: ", insns[i].address);
-	reset_color();
-        
-        for ( size_t j = 0; j < 16; ++j ) {
-            (j < insns[i].size) ? printf("%02x ", insns[i].bytes[j]) : printf("   ");
+    return disasm_range(sec, start, end);
+}
+
+/* FUNCITON: disasm_replay
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	log	: records of instructions made by disasm()
+ * 	size	: number of bytes of records
+ * PROCESS:
+ * 	a) Retreive .text section of binary and its contents
+ * 	b) format each recorded instruction with its bytes taken from .text, addresses
+ * 	   follow from instruction sizes
+ * 	c) check records cover .text exactly
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - disassembled
+ *		-1 - failure (records do not match .text)
+ */
+int
+disasm_replay(Binary &bin, const uint8_t *log, size_t size) {
+    Section         *text;      /* .text section of binary */
+    uint8_t         *bytes;     /* contents of .text section */
+    const uint8_t   *p, *end;   /* next record, end of records */
+    uint64_t        off;        /* offset of instruction in .text */
+    size_t          n, m, o;    /* instruction size, mnemonic and operands length */
+    char            mnemonic[256], op_str[256];
+    PhaseTimer      timer(Metrics :: PHASE_FORMAT);     /* replaying skips decoding */
+
+    text = bin.get_text_section();
+
+    if ( !text ) {
+        fprintf(stderr, "Nothing to disassemble\n");
+        return 0;
+    }
+
+    if ( !( bytes = text -> get_bytes() ) ) return -1;
+
+    if ( out_format == OutputBuffer :: FMT_TEXT ) {
+        red();
+        out -> lit("[*] Disassembly of .text section:\n");
+        reset_color();
+    }
+
+    p   = log;
+    end = log + size;
+    off = 0;
+
+    while ( p < end ) {
+        n = *p++;
+
+        if ( n == 0 ) {
+            if ( off >= text -> size ) break;
+            format_data_byte(*out, text -> vma + off, bytes + off);
+            ++off;
+            continue;
         }
 
-        printf("%-8s %s\n", insns[i].mnemonic, insns[i].op_str);
+        if ( p >= end || ( m = *p ) >= (size_t) ( end - p ) ) break;
+        memcpy(mnemonic, p + 1, m);
+        mnemonic[m] = '\0';
+        p += m + 1;
+
+        if ( p >= end || ( o = *p ) >= (size_t) ( end - p ) ) break;
+        memcpy(op_str, p + 1, o);
+        op_str[o] = '\0';
+        p += o + 1;
 
+        if ( n > text -> size - off ) break;
+        format_insn(*out, text -> vma + off, bytes + off, n, mnemonic, op_str);
+        off += n;
     }
 
-    cs_free(insns, n);
-    cs_close(&dis);
+    if ( p != end || off != text -> size ) {
+        fprintf(stderr, "[!!] Recorded disassembly does not match .text section\n");
+        return -1;
+    }
 
     return 0;
 }
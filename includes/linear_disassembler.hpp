@@ -0,0 +1,35 @@
+#ifndef LINEAR_DISASSEMBLER_H
+#define LINEAR_DISASSEMBLER_H
+
+#include "loader.hpp"
+
+#define SHARD_SIZE		0x10000		/* preferred size of a .text shard decoded by one worker */
+#define SHARD_WINDOW		4		/* shards per worker allowed to run ahead of output */
+
+#include "output.hpp"
+
+/* Cut code section 'sec' into ranges of about SHARD_SIZE bytes, preferably at function
+ * symbols, appending their start and end addresses to 'ranges' */
+void partition_code(Binary &bin, Section *sec, std :: vector <std :: pair <uint64_t, uint64_t> > &ranges);
+
+/* Append instruction to 'o' in the current output format */
+void format_insn(OutputBuffer &o, uint64_t addr, const uint8_t *bytes, size_t size,
+                 const char *mnemonic, const char *op_str);
+
+/* Perform linear disassembly of .text section, using 'nthreads' workers; if 'log' is not NULL
+ * the sweep runs on one thread and appends a record of every instruction to it:
+ * size, mnemonic length, mnemonic, operands length, operands (sizes are single bytes),
+ * size 0 marking an undecodable byte */
+int disasm(Binary &bin, unsigned nthreads = 1, OutputBuffer *log = NULL);
+
+/* Perform linear disassembly of instructions of 'sec' starting in [start, end) */
+int disasm_range(Section *sec, uint64_t start, uint64_t end);
+
+/* Perform linear disassembly of a single symbol (up to the next symbol) or of a
+ * 'start:end' address range, decoding only bytes of that range */
+int disasm_target(Binary &bin, const char *target);
+
+/* Print linear disassembly of .text section from 'size' bytes of records made by disasm() */
+int disasm_replay(Binary &bin, const uint8_t *log, size_t size);
+
+#endif /* LINEAR_DISASSEMBLER_H */
@@ -12,8 +12,27 @@
 	#include <bfd.h>
 #endif
 
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "loader.hpp"
 #include "ansi_colors.hpp"
+#include "output.hpp"
+#include "hexdump.hpp"
+#include "elf_loader.hpp"
+#include "records.hpp"
+#include "metrics.hpp"
+
+static std :: mutex	bfd_lock;	/* libbfd is not thread-safe, every call into it holds this lock */
+static std :: once_flag	bfd_init_flag;	/* libbfd is initialized once per process */
+
+static int load_section_bytes_locked(Section *sec);
 
 /* FUNCTION: open_bfd
  * INPUT ARGUMENTS:
@@ -22,18 +41,16 @@
  * 	a) open file
  * 	b) check if the file is indeed a binary executable file
  * 	c) check the file format (ELF, PE, UNKNOWN)
+ * 	caller must hold bfd_lock
  * RETURN VALUE:
  * 	static bfd * : pointer to bfd structure defining the binary
  */
 static bfd *
 open_bfd(std :: string &fname) {
 	bfd		*bfd_h;			/* pointer to binary executable file */
-	static int	bfd_init_flag = 0;
 
-	if ( !bfd_init_flag ) {
-		bfd_init();		/* initialize internal data structures of libbfd */
-		bfd_init_flag = 1;	/* set flag appropriatly */
-	}
+	/* initialize internal data structures of libbfd */
+	std :: call_once(bfd_init_flag, bfd_init);
 
 	if ( !( bfd_h = bfd_openr(fname.c_str(), NULL) ) ) {
 		fprintf(stderr, "[!!] Failed to open binary '%s' (%s)\n",
@@ -64,15 +81,53 @@ open_bfd(std :: string &fname) {
 	return bfd_h;
 }
 
+/* FUNCTION: map_binary
+ * INPUT ARGUMENTS:
+ * 	fname	: name of the binary file to map
+ * 	bin	: binary's object (program internal representation)
+ * PROCESS:
+ * 	a) open file and retrieve its size
+ * 	b) map entire file read-only into memory
+ * 	c) record mapping in 'bin', it is released by unload_binary()
+ * RETURN VALUE:
+ * 	int : status code, errno describes failure
+ * 		 0 - success
+ * 		-1 - failure
+ */
+int
+map_binary(std :: string &fname, Binary *bin) {
+	int		fd;		/* file descriptor of binary file */
+	struct stat	st;		/* file status of binary file */
+	void		*map;		/* start of mapping */
+
+	if ( ( fd = open(fname.c_str(), O_RDONLY) ) < 0 ) return -1;
+
+	if ( fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	/* mapping stays valid once descriptor is closed */
+
+	if ( map == MAP_FAILED ) return -1;
+
+	bin -> map	= (uint8_t *) map;
+	bin -> map_size	= st.st_size;
+
+	return 0;
+}
+
 /* FUNCTION: load_symbols_bfd
  * INPUT ARGUMENTS:
  * 	bfd_h	: binary's bfd headers (bfd internal representation)
- * 	bin	: binary's object (program internal representation)
+ * 	merge	: merges symbols into binary's object (program internal representation)
  * PROCESS:
  * 	a) read size of symbol table in binary file
  * 	b) allocate heap space to store symbol table entries
  * 	c) read symbol table
- * 	d) tag function symbols, local & global symbols and debugging symbols
+ * 	d) merge each symbol, tagging function symbols, local & global symbols and debugging symbols
  * 	e) cleanup and return
  * RETURN VALUE:
  * 	static int : status code
@@ -80,7 +135,7 @@ open_bfd(std :: string &fname) {
  * 		-1 - failure 
  */
 static int
-load_symbols_bfd(bfd *bfd_h, Binary *bin) {
+load_symbols_bfd(bfd *bfd_h, SymbolMerger &merge) {
 	int	ret;
 	long	n, nsyms, i;		/* n: total size of symbol table (in bytes)
 					 * nsysm: number of symbols in binary
@@ -111,23 +166,8 @@ load_symbols_bfd(bfd *bfd_h, Binary *bin) {
 		}
 
 		for ( i = 0; i < nsyms; ++i ) {
-			/* create program internal instance of symbol */
-			bin -> symbols.push_back(Symbol());
-			sym = &bin -> symbols.back();
-			
-			/* populate information in instance of symbol */
-			sym -> name = std :: string(bfd_symtab[i] -> name);
-
-			/* format symbol name if too large */
-			if ( sym -> name.size() > MAX_SYM_NAME_LEN ) {
-				sym -> name[36] = '.';
-				sym -> name[37] = '.';
-				sym -> name[38] = '.';
-				sym -> name[39] = '\0';
-			}
-
-
-			sym -> addr = bfd_asymbol_value(bfd_symtab[i]);
+			/* find or create program internal instance of symbol, bfd frees names on close */
+			sym = merge.add(bfd_symtab[i] -> name, bfd_asymbol_value(bfd_symtab[i]), Symbol :: SYM_SRC_STATIC, true);
 
 			/* dynamic symbols associated with functions */
 			if ( bfd_symtab[i] -> flags & BSF_FUNCTION )
@@ -158,12 +198,12 @@ load_symbols_bfd(bfd *bfd_h, Binary *bin) {
 /* FUNCTION: load_dynsym_bfd
  * INPUT ARGUMENTS:
  * 	bfd_h	: binary's bfd headers (bfd internal representation)
- * 	bin	: binary's object (program internal representation)
+ * 	merge	: merges symbols into binary's object (program internal representation)
  * PROCESS:
  * 	a) read size of dynamic symbol table in binary file
  * 	b) allocate heap space to store dynamic symbol table entries
  * 	c) read dynamic symbol table
- * 	d) tag function symbols, local & global symbols and debugging symbols
+ * 	d) merge each symbol, tagging function symbols, local & global symbols and debugging symbols
  * 	e) cleanup and return
  * RETURN VALUE:
  * 	static int : status code
@@ -171,7 +211,7 @@ load_symbols_bfd(bfd *bfd_h, Binary *bin) {
  * 		-1 - failure 
  */
 static int
-load_dynsym_bfd(bfd *bfd_h, Binary *bin) {
+load_dynsym_bfd(bfd *bfd_h, SymbolMerger &merge) {
 	int	ret;
 	long	n, nsyms, i;		/* n: total size of dynamic symbol table (in bytes)
 					 * nsysm: number of dynamic symbols in binary
@@ -202,35 +242,22 @@ load_dynsym_bfd(bfd *bfd_h, Binary *bin) {
 		}
 		
 		for ( i = 0; i < nsyms; ++i ) {
-			/* create program internal instance of symbol */
-			bin -> symbols.push_back(Symbol());
-			sym = &bin -> symbols.back();
-			
-			/* populate information in instance of symbol */
-			sym -> name = std :: string(bfd_dynsym[i] -> name);
-
-			/* format symbol name if too large */
-			if ( sym -> name.size() > MAX_SYM_NAME_LEN ) {
-				sym -> name[36] = '.';
-				sym -> name[37] = '.';
-				sym -> name[38] = '.';
-				sym -> name[39] = '\0';
-			}
-
-			sym -> addr = bfd_asymbol_value(bfd_dynsym[i]);
+			/* find or create program internal instance of symbol, exported symbols are usually
+			 * already present from static symbol table */
+			sym = merge.add(bfd_dynsym[i] -> name, bfd_asymbol_value(bfd_dynsym[i]), Symbol :: SYM_SRC_DYNAMIC, true);
 
 			/* dynamic symbols associated with functions */
 			if ( bfd_dynsym[i] -> flags & BSF_FUNCTION )
-				sym -> type = Symbol :: SYM_TYPE_FUN;
+				sym -> type = sym -> type | Symbol :: SYM_TYPE_FUN;
 			/* dynamic symbols associated with local symbols */
 			if ( bfd_dynsym[i] -> flags & BSF_LOCAL)
-				sym -> type = Symbol :: SYM_TYPE_LOC;
+				sym -> type = sym -> type | Symbol :: SYM_TYPE_LOC;
 			/* dynamic symbols associated with global symbols */
 			if ( bfd_dynsym[i] -> flags & BSF_GLOBAL)
-				sym -> type = Symbol :: SYM_TYPE_GLB;
+				sym -> type = sym -> type | Symbol :: SYM_TYPE_GLB;
 			/* dynamic symbols associated with debugging symbols */
 			if ( bfd_dynsym[i] -> flags & BSF_DEBUGGING )
-				sym -> type = Symbol :: SYM_TYPE_DBG;
+				sym -> type = sym -> type | Symbol :: SYM_TYPE_DBG;
 		}
 	}
 
@@ -250,20 +277,20 @@ load_dynsym_bfd(bfd *bfd_h, Binary *bin) {
  * INPUT ARGUMENTS:
  * 	bfd_h	: binary's bfd headers (bfd internal representation)
  * 	bin	: binary's object (program internal representation)
+ * 	flags	: combination of Binary :: LoadFlags
  * PROCESS:
  * 	a) for each node in linked list representation of sections of binary
  * 		a1) retrieve section flags and set appropriate section type
  * 		a2) retrieve section virtual memory address, size, and name
  * 		a3) populate information in program internal representation of binary section
- * 		a4) allocate size to store section contents
- * 		a5) retrieve section contents and store them
+ * 		a4) unless loading lazily, retrieve section contents (caller holds bfd_lock)
  * RETURN VALUE:
  * 	static int : status code
  * 		 0 - success
  * 		-1 - failure 
  */
 static int
-load_sections_bfd(bfd *bfd_h, Binary *bin) {
+load_sections_bfd(bfd *bfd_h, Binary *bin, int flags) {
 	int			bfd_flags;	/* flags of given section. eg: code, data */
 	uint64_t		vma, size;	/* vma: virtual memory address to load the seciton at
 						 * size: size of section to load
@@ -308,21 +335,15 @@ load_sections_bfd(bfd *bfd_h, Binary *bin) {
 		sec -> type	= sectype;
 		sec -> vma	= vma;
 		sec -> size	= size;
-	
-		/* allocate memory to store section contents */
-		if ( !( sec -> bytes = (uint8_t *)malloc(size) ) ) {
-			fprintf(stderr, "[!!] Out of memory\n");
-			return -1;
-		}
-
-		/* retrieve section contents */
-		if ( !bfd_get_section_contents(bfd_h, bfd_sec, sec -> bytes, 0, size) ) {
-			fprintf(stderr, "[!!] Failed to read section '%s' (%s)\n",
-				secname, bfd_errmsg(bfd_get_error()));
-			return -1;
-		}
+		sec -> filepos	= bfd_sec -> filepos;
+		sec -> handle	= bfd_sec;
 	}
 
+	if ( flags & Binary :: LOAD_LAZY ) return 0;
+
+	for ( auto &s : bin -> sections )
+		if ( load_section_bytes_locked(&s) < 0 ) return -1;
+
 	return 0;
 }
 
@@ -331,24 +352,28 @@ load_sections_bfd(bfd *bfd_h, Binary *bin) {
  * 	fname	: name of binary file to load
  * 	bin	: binary's object (program internal representation)
  * 	type	: supported types of binary file
+ * 	flags	: combination of Binary :: LoadFlags
  * PROCESS:
  * 	a) set filename and entry point in 'bin'
  * 	b) set executalbe type in 'bin'
  * 	c) set target architecture type in 'bin'
  * 	d) load static symbols (if present)
  * 	e) load dynamic symbols
- * 	f) load sections
- * 	g) cleanup
+ * 	f) map binary file (if requested)
+ * 	g) load sections, keeping bfd open to retrieve contents later when loading lazily
+ * 	h) cleanup, undoing partial loading (sections, mapping) on failure
  * RETURN VALUE:
  * 	static int : status code
  * 		 0 - success
  * 		-1 - failure 
  */
 static int
-load_binary_bfd(std :: string fname, Binary *bin, Binary :: BinaryType type) {
+load_binary_bfd(std :: string fname, Binary *bin, Binary :: BinaryType type, int flags) {
 	int				ret;
 	bfd				*bfd_h;
 	const bfd_arch_info_type	*bfd_info;
+	PhaseTimer			timer;		/* charges open, symbols and sections phases */
+	std :: lock_guard <std :: mutex> guard(bfd_lock);
 
 	bfd_h	= NULL;
 	bfd_h	= open_bfd(fname);
@@ -395,18 +420,42 @@ load_binary_bfd(std :: string fname, Binary *bin, Binary :: BinaryType type) {
 		       goto fail;
 	}
 
-	/* symbols may not be present if the binary is stripped */
-	load_symbols_bfd(bfd_h, bin);	/* attempt to load static symbols */
-	load_dynsym_bfd(bfd_h, bin);	/* attempt to load dynamic symbols */
+	timer.lap(Metrics :: PHASE_OPEN);
+
+	/* symbols may not be present if the binary is stripped, tables are merged into one set */
+	{
+		long		n, m;	/* bytes of static and dynamic symbol tables */
+
+		n = bfd_get_symtab_upper_bound(bfd_h);
+		m = bfd_get_dynamic_symtab_upper_bound(bfd_h);
+
+		SymbolMerger	merge(bin, ( std :: max(n, 0L) + std :: max(m, 0L) ) / sizeof(asymbol *));
+
+		load_symbols_bfd(bfd_h, merge);	/* attempt to load static symbols */
+		load_dynsym_bfd(bfd_h, merge);	/* attempt to load dynamic symbols */
+	}
+	timer.lap(Metrics :: PHASE_SYMBOLS);
+
+	/* sections fall back to copying if the file cannot be mapped */
+	if ( flags & Binary :: LOAD_MMAP ) map_binary(fname, bin);
 
 	/* attempt to load sections */
-	if ( load_sections_bfd(bfd_h, bin) < 0 ) goto fail;
+	bin -> bfd_h = bfd_h;
+	if ( load_sections_bfd(bfd_h, bin, flags) < 0 ) goto fail;
+	timer.lap(Metrics :: PHASE_SECTIONS);
+
+	/* hand ownership of bfd to binary, unload_binary() closes it */
+	if ( flags & Binary :: LOAD_LAZY ) bfd_h = NULL;
+	else bin -> bfd_h = NULL;
 
 	ret = 0;
 	goto cleanup;
 
 	fail:
 		ret = -1;
+		bin -> bfd_h = NULL;	/* closed below */
+		unload_binary(bin);	/* sections read so far and mapping of file */
+		*bin = Binary();
 	
 	cleanup:
 		if ( bfd_h ) bfd_close(bfd_h);
@@ -419,81 +468,492 @@ load_binary_bfd(std :: string fname, Binary *bin, Binary :: BinaryType type) {
  * 	fname	: name of binary file to examine
  * 	bin	: binary's object (program internal representation)
  * 	type	: supported types of binary file
+ * 	flags	: combination of Binary :: LoadFlags
  * PROCESS:
- * 	a) load the binary and examine
+ * 	a) load ELF binaries natively, unless libbfd is requested; the native loader always
+ * 	   maps the file and references section contents in place, so LOAD_MMAP and LOAD_LAZY
+ * 	   only affect libbfd loads
+ * 	b) load other formats (or ELF files the native loader declines) through libbfd
+ * 	c) index its sections and symbols by address and name
  * RETURN VALUE:
  * 	int : status code
  * 		 0 - success
  * 		-1 - failure 
  */
 int
-load_binary(std :: string &fname, Binary *bin, Binary :: BinaryType type) {
-	return load_binary_bfd(fname, bin, type);
+load_binary(std :: string &fname, Binary *bin, Binary :: BinaryType type, int flags) {
+	if ( ( flags & Binary :: LOAD_BFD ) || load_binary_elf(fname, bin) != 0 )
+		if ( load_binary_bfd(fname, bin, type, flags) < 0 ) return -1;
+
+	PhaseTimer	timer(Metrics :: PHASE_SYMBOLS);	/* indexing counts as symbol processing */
+
+	bin -> build_index();
+	metrics.count(Metrics :: CNT_SYMBOLS, bin -> symbols.size());
+
+	return 0;
+}
+
+/* FUNCTION: StringArena :: alloc_slow
+ * INPUT ARGUMENTS:
+ * 	n	: number of bytes required
+ * PROCESS:
+ * 	a) give large requests a chunk of their own, keeping free space of current chunk
+ * 	b) otherwise start a new chunk of ARENA_CHUNK_SIZE bytes
+ * RETURN VALUE:
+ * 	char * : 'n' bytes of storage
+ */
+char *
+StringArena :: alloc_slow(size_t n) {
+	char	*chunk;		/* newly allocated chunk */
+
+	if ( n > ARENA_CHUNK_SIZE / 4 ) {
+		if ( !( chunk = (char *) malloc(n) ) ) throw std :: bad_alloc();
+		chunks.push_back(chunk);
+		return chunk;
+	}
+
+	if ( !( chunk = (char *) malloc(ARENA_CHUNK_SIZE) ) ) throw std :: bad_alloc();
+	chunks.push_back(chunk);
+	cur  = chunk + n;
+	left = ARENA_CHUNK_SIZE - n;
+	return chunk;
+}
+
+StringArena :: StringArena(StringArena &&other) noexcept
+	: chunks(std :: move(other.chunks)), cur(other.cur), left(other.left) {
+	other.chunks.clear();
+	other.cur  = NULL;
+	other.left = 0;
+}
+
+StringArena &
+StringArena :: operator=(StringArena &&other) noexcept {
+	if ( this != &other ) {
+		clear();
+		chunks.swap(other.chunks);
+		cur  = other.cur;
+		left = other.left;
+		other.cur  = NULL;
+		other.left = 0;
+	}
+	return *this;
+}
+
+/* FUNCTION: StringArena :: clear
+ * PROCESS:
+ * 	a) free every chunk, invalidating all strings added
+ * RETURN VALUE: NONE
+ */
+void
+StringArena :: clear() {
+	for ( size_t i = 0; i < chunks.size(); ++i ) free(chunks[i]);
+	chunks.clear();
+	cur  = NULL;
+	left = 0;
+}
+
+/* FUNCTION: Binary :: build_index
+ * PROCESS:
+ * 	a) sort indices of sections by virtual memory address
+ * 	b) copy symbols into columnar table, sort indices of symbols with a non-zero
+ * 	   address by address, keeping load order among symbols sharing an address
+ * 	c) hash sections and symbols by name, keeping the first of each name
+ * RETURN VALUE: NONE
+ */
+void
+Binary :: build_index() {
+	uint32_t	i;	/* loop iterator */
+
+	sec_by_addr.clear();
+	sym_by_addr.clear();
+	sec_by_name.clear();
+	sym_by_name.clear();
+
+	sec_by_addr.reserve(sections.size());
+	sec_by_name.reserve(sections.size());
+	for ( i = 0; i < sections.size(); ++i ) {
+		sec_by_addr.push_back(i);
+		sec_by_name.emplace(sections[i].name.c_str(), i);
+	}
+	std :: stable_sort(sec_by_addr.begin(), sec_by_addr.end(), [this](uint32_t a, uint32_t b) {
+		return sections[a].vma < sections[b].vma;
+	});
+
+	symtab.build(symbols);
+	sym_by_addr.reserve(symbols.size());
+	sym_by_name.reserve(symbols.size());
+	for ( i = 0; i < symbols.size(); ++i ) {
+		if ( symtab.addr[i] ) sym_by_addr.push_back(i);
+		sym_by_name.emplace(symtab.name[i], i);
+	}
+	symtab.sort_by_addr(sym_by_addr);
+}
+
+/* FUNCTION: Binary :: find_section
+ * INPUT ARGUMENTS:
+ * 	name	: name of section
+ * PROCESS:
+ * 	a) look up name index, scan sections if binary has not been indexed
+ * RETURN VALUE:
+ * 	Section * : section named 'name', NULL if none
+ */
+Section *
+Binary :: find_section(const char *name) {
+	NameIndex :: iterator	it;	/* entry of section in name index */
+
+	if ( sec_by_name.empty() ) {
+		for ( auto &s : sections )
+			if ( s.name == name )
+				return &s;
+		return NULL;
+	}
+
+	it = sec_by_name.find(name);
+	return ( it != sec_by_name.end() ) ? &sections[it -> second] : NULL;
+}
+
+/* FUNCTION: Binary :: find_section
+ * INPUT ARGUMENTS:
+ * 	addr	: virtual memory address
+ * PROCESS:
+ * 	a) binary search for last section starting at or below 'addr'
+ * 	b) check that the section actually extends over 'addr'
+ * RETURN VALUE:
+ * 	Section * : section containing 'addr', NULL if none
+ */
+Section *
+Binary :: find_section(uint64_t addr) {
+	std :: vector <uint32_t> :: iterator	it;	/* first section starting above 'addr' */
+
+	it = std :: upper_bound(sec_by_addr.begin(), sec_by_addr.end(), addr, [this](uint64_t a, uint32_t i) {
+		return a < sections[i].vma;
+	});
+
+	if ( it == sec_by_addr.begin() ) return NULL;
+	--it;
+
+	return sections[*it].contains(addr) ? &sections[*it] : NULL;
+}
+
+/* FUNCTION: Binary :: find_symbol
+ * INPUT ARGUMENTS:
+ * 	name	: name of symbol
+ * PROCESS:
+ * 	a) look up name index
+ * RETURN VALUE:
+ * 	Symbol * : first symbol named 'name', NULL if none
+ */
+Symbol *
+Binary :: find_symbol(const char *name) {
+	NameIndex :: iterator	it;	/* entry of symbol in name index */
+
+	it = sym_by_name.find(name);
+	return ( it != sym_by_name.end() ) ? &symbols[it -> second] : NULL;
+}
+
+/* FUNCTION: Binary :: nearest_symbol
+ * INPUT ARGUMENTS:
+ * 	addr	: virtual memory address
+ * PROCESS:
+ * 	a) binary search for last symbol at or below 'addr'
+ * 	b) among symbols sharing that address, pick the one loaded first
+ * RETURN VALUE:
+ * 	Symbol * : nearest preceding symbol, NULL if none
+ */
+Symbol *
+Binary :: nearest_symbol(uint64_t addr) {
+	std :: vector <uint32_t> :: iterator	it;	/* first symbol above 'addr' */
+	uint64_t				at;	/* address of nearest symbol */
+
+	it = std :: upper_bound(sym_by_addr.begin(), sym_by_addr.end(), addr, [this](uint64_t a, uint32_t i) {
+		return a < symtab.addr[i];
+	});
+
+	if ( it == sym_by_addr.begin() ) return NULL;
+
+	at = symtab.addr[*--it];
+	while ( it != sym_by_addr.begin() && symtab.addr[*( it - 1 )] == at ) --it;
+
+	return &symbols[*it];
+}
+
+/* FUNCTION: Binary :: next_symbol
+ * INPUT ARGUMENTS:
+ * 	addr	: virtual memory address
+ * PROCESS:
+ * 	a) binary search for first symbol above 'addr'
+ * RETURN VALUE:
+ * 	Symbol * : nearest following symbol, NULL if none
+ */
+Symbol *
+Binary :: next_symbol(uint64_t addr) {
+	std :: vector <uint32_t> :: iterator	it;	/* first symbol above 'addr' */
+
+	it = std :: upper_bound(sym_by_addr.begin(), sym_by_addr.end(), addr, [this](uint64_t a, uint32_t i) {
+		return a < symtab.addr[i];
+	});
+
+	return ( it != sym_by_addr.end() ) ? &symbols[*it] : NULL;
+}
+
+/* FUNCTION: Binary :: select_symbols
+ * INPUT ARGUMENTS:
+ * 	mask	: Symbol :: SymbolType flags, 0 selects every symbol
+ * 	idx	: receives indices into 'symbols'
+ * 	by_addr	: sort indices by address instead of load order
+ * PROCESS:
+ * 	a) filter type column of symbol table
+ * 	b) sort selection by address if requested
+ * RETURN VALUE: NONE
+ */
+void
+Binary :: select_symbols(uint8_t mask, std :: vector <uint32_t> &idx, bool by_addr) const {
+	idx.clear();
+	symtab.filter(mask, idx);
+	if ( by_addr ) symtab.sort_by_addr(idx);
+}
+
+/* FUNCTION: verbatim_in_file
+ * INPUT ARGUMENTS:
+ * 	bin	: binary containing the section
+ * 	sec	: section of binary
+ * 	file_size: size of binary file
+ * PROCESS:
+ * 	a) check section has contents, stored as-is (not relocated nor compressed),
+ * 	   inside the file; caller must hold bfd_lock
+ * RETURN VALUE:
+ * 	static bool : contents can be read from file at 'sec -> filepos'
+ */
+static bool
+verbatim_in_file(Binary *bin, Section *sec, uint64_t file_size) {
+	bfd		*bfd_h;		/* binary's bfd headers, kept open while loading lazily */
+	asection	*bfd_sec;	/* bfd internal representation of section */
+	int		bfd_flags;	/* flags of given section. eg: code, data */
+
+	bfd_h	= (bfd *) bin -> bfd_h;
+	bfd_sec	= (asection *) sec -> handle;
+	if ( !bfd_h || !bfd_sec ) return false;
+
+	bfd_flags = bfd_section_flags(bfd_sec);
+
+	return ( bfd_flags & SEC_HAS_CONTENTS ) && !( bfd_flags & SEC_RELOC )
+	       && !bfd_is_section_compressed(bfd_h, bfd_sec)
+	       && sec -> filepos <= file_size && sec -> size <= file_size - sec -> filepos;
+}
+
+/* FUNCTION: section_in_file
+ * INPUT ARGUMENTS:
+ * 	sec		: section of binary
+ * 	file_size	: size of binary file
+ * PROCESS:
+ * 	a) contents referenced in place are the file's own bytes
+ * 	b) while libbfd headers are kept (lazy loading), sections without contents are
+ * 	   all zero and verbatim_in_file() tells whether the file holds them as-is
+ * RETURN VALUE:
+ * 	int : origin of contents
+ * 		 1 - stored as-is at 'sec -> filepos'
+ * 		 0 - all zero
+ * 		-1 - unknown, contents must be retrieved and compared
+ */
+int
+section_in_file(Section *sec, uint64_t file_size) {
+	Binary		*bin;		/* binary containing the section */
+
+	if ( sec -> flags == Section :: SEC_FLAG_MAPPED ) return 1;
+
+	bin = sec -> binary;
+	if ( !bin -> bfd_h || !sec -> handle ) return -1;
+
+	std :: lock_guard <std :: mutex> guard(bfd_lock);
+
+	if ( !( bfd_section_flags((asection *) sec -> handle) & SEC_HAS_CONTENTS ) ) return 0;
+
+	return verbatim_in_file(bin, sec, file_size) ? 1 : -1;
+}
+
+/* FUNCTION: load_section_bytes_locked
+ * INPUT ARGUMENTS:
+ * 	sec : section who's contents are to be retrieved
+ * PROCESS:
+ * 	a) if binary is mapped and section contents are stored verbatim in file,
+ * 	   point section contents into the mapping
+ * 	b) otherwise allocate size to store section contents and retrieve them
+ * 	caller must hold bfd_lock
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+static int
+load_section_bytes_locked(Section *sec) {
+	Binary		*bin;		/* binary containing the section */
+	bfd		*bfd_h;		/* binary's bfd headers, kept open while loading lazily */
+	asection	*bfd_sec;	/* bfd internal representation of section */
+
+	if ( sec -> flags != Section :: SEC_FLAG_NONE ) return 0;	/* already retrieved */
+
+	bin	= sec -> binary;
+	bfd_h	= (bfd *) bin -> bfd_h;
+	bfd_sec	= (asection *) sec -> handle;
+
+	if ( !bfd_h || !bfd_sec ) {
+		fprintf(stderr, "[!!] Section '%s' is no longer retrievable\n", sec -> name.c_str());
+		return -1;
+	}
+
+	PhaseTimer	timer(Metrics :: PHASE_SECTIONS);
+
+	/* reference contents in place when the file holds them as-is */
+	if ( bin -> map && verbatim_in_file(bin, sec, bin -> map_size) ) {
+		sec -> bytes	= bin -> map + sec -> filepos;
+		sec -> flags	= Section :: SEC_FLAG_MAPPED;
+		metrics.count(Metrics :: CNT_BYTES_LOADED, sec -> size);
+		return 0;
+	}
+
+	/* allocate memory to store section contents */
+	if ( !( sec -> bytes = (uint8_t *)malloc(sec -> size) ) ) {
+		fprintf(stderr, "[!!] Out of memory\n");
+		return -1;
+	}
+	sec -> flags	= Section :: SEC_FLAG_MALLOC;
+
+	/* retrieve section contents */
+	if ( !bfd_get_section_contents(bfd_h, bfd_sec, sec -> bytes, 0, sec -> size) ) {
+		fprintf(stderr, "[!!] Failed to read section '%s' (%s)\n",
+			sec -> name.c_str(), bfd_errmsg(bfd_get_error()));
+		free(sec -> bytes);
+		sec -> bytes	= NULL;
+		sec -> flags	= Section :: SEC_FLAG_NONE;
+		return -1;
+	}
+	metrics.count(Metrics :: CNT_BYTES_LOADED, sec -> size);
+
+	return 0;
+}
+
+/* FUNCTION: load_section_bytes
+ * INPUT ARGUMENTS:
+ * 	sec : section who's contents are to be retrieved
+ * PROCESS:
+ * 	a) retrieve contents with load_section_bytes_locked() under bfd_lock
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - success
+ * 		-1 - failure
+ */
+int
+load_section_bytes(Section *sec) {
+	if ( sec -> flags != Section :: SEC_FLAG_NONE ) return 0;	/* already retrieved */
+
+	std :: lock_guard <std :: mutex> guard(bfd_lock);
+
+	return load_section_bytes_locked(sec);
 }
 
 /* FUNCTION: print_binary_header
  * INPUT ARGUMENTS:
  * 	bin : binary's object (program internal representation)
  * PROCESS:
- *	a) print name, type, target architecture, size and entry point of binary
- *	b) dump section information of binary
- *	c) dump symbol information of binary
+ *	a) in machine readable formats, emit a record per section and per symbol
+ *	b) print name, type, target architecture, size and entry point of binary
+ *	c) dump section information of binary
+ *	d) dump symbol information of binary
  * RETURN VALUE: NONE
  */
 void
 print_binary_header(Binary &bin) {
 	size_t		i;		/* loop iterator */
 	Section		*sec;		/* program internal representation of sections of a binary */
-	Symbol		*sym;		/* program internal representation of symbols in a binary */
+	size_t		len;		/* length of symbol name */
+	PhaseTimer	timer(Metrics :: PHASE_HEADER);
+
+	if ( bin.symtab.size() != bin.symbols.size() ) bin.symtab.build(bin.symbols);
+
+	/* records carry no colors or raw dumps, the binary record is emitted by the caller */
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		for ( i = 0; i < bin.sections.size(); ++i )
+			emit_section(*out, bin.sections[i]);
+		for ( i = 0; i < bin.symtab.size(); ++i )
+			emit_symbol(*out, bin.symtab.name[i], bin.symtab.addr[i], bin.symtab.type[i], bin.symbols[i].source);
+		return;
+	}
 
 	/* print information concering entire binary executable */
 	underlined_red();
-	printf("[*] Loaded binary '%s'\n", bin.filename.c_str());
+	out -> lit("[*] Loaded binary '");
+	out -> str(bin.filename.c_str());
+	out -> lit("'\n");
 	bold_blue();
-	printf("[*] Architecture: %s/%s (%u bits)\n", bin.type_str.c_str(), bin.arch_str.c_str(), bin.bits);
+	out -> lit("[*] Architecture: ");
+	out -> str(bin.type_str.c_str());
+	out -> put('/');
+	out -> str(bin.arch_str.c_str());
+	out -> lit(" (");
+	out -> dec(bin.bits);
+	out -> lit(" bits)\n");
 	bold_yellow();
-	printf("[*] Entry point: 0x%016jx\n\n", bin.entry);
+	out -> lit("[*] Entry point: 0x");
+	out -> hex(bin.entry, 16);
+	out -> lit("\n\n");
 
 	/* print information regarding section headers */
 	red();
-	printf("[*] Scanned section headers:\n");
+	out -> lit("[*] Scanned section headers:\n");
 	yellow();
-	printf(" %s %13s %8s %20s\n", &"VIRT ADDR", &"SIZE", &"NAME", &"TYPE");
+	out -> lit(" VIRT ADDR          SIZE     NAME                 TYPE\n");
 	reset_color();
-	printf(" %s %44s\n", &"RAW BYTES", &"ASCII");
+	out -> lit(" RAW BYTES                                        ASCII\n");
 
 	for ( i = 0; i < bin.sections.size(); ++i ) {
 		sec = &bin.sections[i];
 		yellow();
-		printf("\n 0x%016jx %-8ju %-20s %s\n",
-			sec -> vma, sec -> size, sec -> name.c_str(),
-			sec -> type == Section :: SEC_TYPE_CODE ? "CODE" : "DATA");
+		out -> lit("\n 0x");
+		out -> hex(sec -> vma, 16);
+		out -> put(' ');
+		out -> dec(sec -> size, -8);
+		out -> put(' ');
+		out -> str(sec -> name.c_str(), -20);
+		if ( sec -> type == Section :: SEC_TYPE_CODE )
+			out -> lit(" CODE\n");
+		else
+			out -> lit(" DATA\n");
 		reset_color();
 		raw_dump(sec);
 	}
 
 	/* print information regrading symbols (if present) */
 	if ( bin.symbols.size() > 0 ) {
-		printf("\n");
+		out -> put('\n');
 		red();
-		printf("[*] Scanned symbol tables:\n");
+		out -> lit("[*] Scanned symbol tables:\n");
 		blue();
-		printf(" %-40s %18s %20s\n", &"NAME", &"ADDRESS", &"SYMBOL TYPE");
+		out -> lit(" NAME                                                ADDRESS          SYMBOL TYPE\n");
 		reset_color();
 		
-		for ( i = 0; i < bin.symbols.size(); ++i ) {
-			sym = &bin.symbols[i];
-
-			printf(" %-40s 0x%016jx ", sym -> name.c_str(), sym -> addr);
-			if ( sym -> type & Symbol :: SYM_TYPE_FUN )
-				printf("%20s", &"FUNCTION");
-			if ( sym -> type & Symbol :: SYM_TYPE_LOC )
-				printf("%20s", &"LOCAL-SYMBOL");
-			if ( sym -> type & Symbol :: SYM_TYPE_GLB )
-				printf("%20s", &"GLOBAL-SYMBOL");
-			if ( sym -> type & Symbol :: SYM_TYPE_DBG )
-				printf("%20s", &"DEBUGGING-SYMBOL");
-			printf("\n");
+		/* walk columns of symbol table rather than symbol objects */
+		const SymbolTable &tab = bin.symtab;
+		for ( i = 0; i < tab.size(); ++i ) {
+			out -> put(' ');
+			/* names too large are cut, full name is kept in symbol */
+			if ( ( len = strlen(tab.name[i]) ) > MAX_SYM_NAME_LEN ) {
+				out -> write(tab.name[i], MAX_SYM_NAME_LEN - 2);
+				out -> lit("... ");
+			} else {
+				out -> str(tab.name[i], -40);
+			}
+			out -> lit(" 0x");
+			out -> hex(tab.addr[i], 16);
+			out -> put(' ');
+			if ( tab.type[i] & Symbol :: SYM_TYPE_FUN )
+				out -> lit("            FUNCTION");
+			if ( tab.type[i] & Symbol :: SYM_TYPE_LOC )
+				out -> lit("        LOCAL-SYMBOL");
+			if ( tab.type[i] & Symbol :: SYM_TYPE_GLB )
+				out -> lit("       GLOBAL-SYMBOL");
+			if ( tab.type[i] & Symbol :: SYM_TYPE_DBG )
+				out -> lit("    DEBUGGING-SYMBOL");
+			out -> put('\n');
 		}
 	}
 }
@@ -504,6 +964,9 @@ print_binary_header(Binary &bin) {
  * PROCESS:
  * 	a) for each section in binary's object
  * 		a1) free space allocated to store its contents
+ * 	b) close bfd kept open for lazy loading (if any)
+ * 	c) unmap binary file (if mapped)
+ * 	d) drop symbols, whose names point into mapping and string arena
  * RETURN VALUE: NONE
  */
 void
@@ -513,52 +976,195 @@ unload_binary(Binary *bin) {
 
 	for ( i = 0; i < bin -> sections.size(); ++i ) {
 		sec = &bin -> sections[i];	/* get the section in binary */
-		if ( sec -> bytes )
+		if ( sec -> bytes && ( sec -> flags & Section :: SEC_FLAG_MALLOC ) )
 			free(sec -> bytes);	/* de-allocate memory space used to store its contents */
+		sec -> bytes = NULL;
+		sec -> flags = Section :: SEC_FLAG_NONE;
+		sec -> handle = NULL;
+	}
+
+	if ( bin -> bfd_h ) {
+		std :: lock_guard <std :: mutex> guard(bfd_lock);
+		bfd_close((bfd *) bin -> bfd_h);
+		bin -> bfd_h = NULL;
 	}
+
+	if ( bin -> map ) {
+		munmap(bin -> map, bin -> map_size);
+		bin -> map	= NULL;
+		bin -> map_size	= 0;
+	}
+
+	bin -> symbols.clear();
+	bin -> sym_by_addr.clear();
+	bin -> sym_by_name.clear();
+	bin -> symtab.clear();
+	bin -> names.clear();
 }
 
-/* FUNCTION: raw_dump
+/* FUNCTION: dump_bytes
  * INPUT ARGUMENTS:
- * 	sec : section who's content are to be printed as raw bytes
+ * 	bytes	: contents to print
+ * 	size	: number of bytes, a multiple of MAX_LINE_LEN unless contents end here
  * PROCESS:
- * 	a) for each byte in section
- * 		a1) print hexadecimal value of each byte
- * 		a2) print corresponding ascii character if it exists
+ * 	a) format full lines of MAX_LINE_LEN bytes straight into output buffer, in batches,
+ * 	   using the vector kernel selected for the running cpu
+ * 	b) format last line less than maximum length
  * RETURN VALUE: NONE
  */
-void
-raw_dump(Section *sec) {
-	size_t		i, j, size;			/* i, j: loop iterators
-					 		* size: size of section
-					 		*/
-	
-	char		line[MAX_LINE_LEN + 1];		/* string to store a line to print */
-	char		ascii_code;			/* single character/byte in section content */
+static void
+dump_bytes(const uint8_t *bytes, size_t size) {
+	size_t		i, n, nlines;			/* i: loop iterator
+							 * n: number of lines formatted in one batch
+							 * nlines: number of full lines
+							 */
+	char		*p;				/* destination of formatted lines */
+
+	/* format full lines of MAX_LINE_LEN bytes in batches */
+	nlines = size / MAX_LINE_LEN;
+
+	for ( i = 0; i < nlines; i += n ) {
+		n = ( nlines - i < DUMP_BATCH_LINES ) ? nlines - i : DUMP_BATCH_LINES;
+		p = out -> reserve(n * DUMP_LINE_LEN);
+		dump_lines(p, bytes + i * MAX_LINE_LEN, n);
+		out -> advance(n * DUMP_LINE_LEN);
+	}
 
-	size = sec -> size;
+	/* last line less than maximum length */
+	if ( size % MAX_LINE_LEN ) {
+		p = out -> reserve(DUMP_LINE_LEN);
+		out -> advance(dump_partial_line(p, bytes + nlines * MAX_LINE_LEN, size % MAX_LINE_LEN));
+	}
+}
 
-	/* loop over each byte in section */
-	for ( i = 0; i < size; ++i ) {
-		ascii_code = sec -> bytes[i];
+/* FUNCTION: dump_mapped
+ * INPUT ARGUMENTS:
+ * 	sec : section who's contents point into a read-only file mapping
+ * PROCESS:
+ * 	a) advise kernel the contents are read sequentially
+ * 	b) print DUMP_WINDOW_SIZE bytes at a time, dropping pages of each printed window
+ * 	   (they are read again from the file if used later)
+ * RETURN VALUE: NONE
+ */
+static void
+dump_mapped(Section *sec) {
+	uintptr_t	page;		/* page size mask */
+	uintptr_t	start, end;	/* pages of section */
+	uintptr_t	done;		/* start of pages not yet dropped */
+	uint64_t	off, n;		/* offset and size of window */
+
+	page  = sysconf(_SC_PAGESIZE) - 1;
+	start = (uintptr_t) sec -> bytes & ~page;
+	end   = ( (uintptr_t) sec -> bytes + sec -> size + page ) & ~page;
+	madvise((void *) start, end - start, MADV_SEQUENTIAL);
+
+	done = start;
+	for ( off = 0; off < sec -> size; off += n ) {
+		n = std :: min <uint64_t> (DUMP_WINDOW_SIZE, sec -> size - off);
+		dump_bytes(sec -> bytes + off, n);
+
+		/* whole pages behind the cursor, the page holding it may be printed next */
+		end = ( (uintptr_t) sec -> bytes + off + n ) & ~page;
+		if ( off + n == sec -> size ) end = ( (uintptr_t) sec -> bytes + sec -> size + page ) & ~page;
+		if ( end > done ) {
+			madvise((void *) done, end - done, MADV_DONTNEED);
+			done = end;
+		}
+	}
+}
 
-		/* print hex value for each byte */
-		printf(" %02x", (uint8_t) ascii_code);
-		
-		/* add character to print to line and print the line */
-		line[i % MAX_LINE_LEN] = (ascii_code >= 32 && ascii_code <=128) ? ascii_code : '.';
+/* FUNCTION: dump_streamed
+ * INPUT ARGUMENTS:
+ * 	sec : section who's contents have not been retrieved
+ * PROCESS:
+ * 	a) check file holds contents as-is, before printing anything
+ * 	b) read DUMP_WINDOW_SIZE bytes at a time into one buffer and print them,
+ * 	   advising kernel to read ahead and to drop cached pages of printed windows
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - printed (possibly cut short by a read error, which is reported)
+ * 		-1 - contents must be retrieved as a whole instead
+ */
+static int
+dump_streamed(Section *sec) {
+	Binary		*bin;		/* binary containing the section */
+	int		fd;		/* file descriptor of binary file */
+	struct stat	st;		/* file status of binary file */
+	uint8_t		*buf;		/* window of contents */
+	uint64_t	off, n;		/* offset and size of window */
+	ssize_t		r;		/* bytes read */
+	size_t		got;		/* bytes of window read so far */
+	bool		ok;		/* contents can be streamed */
+
+	bin = sec -> binary;
+	if ( ( fd = open(bin -> filename.c_str(), O_RDONLY) ) < 0 ) return -1;
+
+	{
+		std :: lock_guard <std :: mutex> guard(bfd_lock);
+		ok = fstat(fd, &st) == 0 && verbatim_in_file(bin, sec, st.st_size);
+	}
+	if ( !ok || !( buf = (uint8_t *) malloc(DUMP_WINDOW_SIZE) ) ) {
+		close(fd);
+		return -1;
+	}
 
-		if ( ( i != 0 && ( i + 1 ) % MAX_LINE_LEN == 0 ) || i == size - 1 ) {
-			line[i % MAX_LINE_LEN + 1] = '\0';
+	posix_fadvise(fd, sec -> filepos, sec -> size, POSIX_FADV_SEQUENTIAL);
 
-			/* additional space for last line less than maximum length */
-			for ( j = strlen(line); j < MAX_LINE_LEN; ++j )
-				printf("   ");
+	for ( off = 0; off < sec -> size; off += n ) {
+		n = std :: min <uint64_t> (DUMP_WINDOW_SIZE, sec -> size - off);
 
-			/* column to separate hex and character columns */
-			printf("  ");
+		{
+			PhaseTimer	timer(Metrics :: PHASE_SECTIONS);
 
-			printf("%s\n", line);
+			for ( got = 0; got < n; got += r ) {
+				if ( ( r = pread(fd, buf + got, n - got, sec -> filepos + off + got) ) <= 0 ) {
+					if ( r < 0 && errno == EINTR ) { r = 0; continue; }
+					break;
+				}
+			}
+			metrics.count(Metrics :: CNT_BYTES_LOADED, got);
 		}
+
+		if ( got < n ) {
+			fprintf(stderr, "[!!] Failed to read section '%s' (%s)\n", sec -> name.c_str(),
+				r < 0 ? strerror(errno) : "unexpected end of file");
+			break;
+		}
+
+		dump_bytes(buf, n);
+		posix_fadvise(fd, sec -> filepos + off, n, POSIX_FADV_DONTNEED);
 	}
+
+	free(buf);
+	close(fd);
+
+	return 0;
+}
+
+/* FUNCTION: raw_dump
+ * INPUT ARGUMENTS:
+ * 	sec : section who's content are to be printed as raw bytes
+ * PROCESS:
+ * 	a) print sections larger than DUMP_WINDOW_SIZE one window at a time, so memory
+ * 	   used stays bounded: in place if mapped, otherwise read from file if not yet
+ * 	   retrieved and stored as-is
+ * 	b) otherwise retrieve section contents (if not yet retrieved) and print them
+ * RETURN VALUE: NONE
+ */
+void
+raw_dump(Section *sec) {
+	uint8_t		*bytes;				/* section contents */
+
+	if ( sec -> size > DUMP_WINDOW_SIZE ) {
+		if ( sec -> flags == Section :: SEC_FLAG_MAPPED ) {
+			dump_mapped(sec);
+			return;
+		}
+		if ( sec -> flags == Section :: SEC_FLAG_NONE && dump_streamed(sec) == 0 ) return;
+	}
+
+	/* retrieve section contents on first use */
+	if ( !( bytes = sec -> get_bytes() ) ) return;
+
+	dump_bytes(bytes, sec -> size);
 }
@@ -2,16 +2,81 @@
 #define BIN_LOADER_H
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #define MAX_SYM_NAME_LEN	38		/* maximum length of a symbol name to be displayed upto */
 #define MAX_LINE_LEN		16		/* maximum length of a line to be printed in raw_dump() */
+#define DUMP_LINE_LEN		( MAX_LINE_LEN * 4 + 3 )	/* formatted line: hex, separator, ascii, newline */
+#define ARENA_CHUNK_SIZE	( 1 << 16 )	/* bytes of string storage allocated at once */
 
 class Binary;
 class Section;
 class Symbol;
 
+/* Retrieve contents of section, defined in loader.cpp */
+int load_section_bytes(Section *sec);
+
+/* Hash of NUL terminated string (FNV-1a), used to index names without copying them */
+struct CStrHash {
+	size_t operator()(const char *s) const {
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for ( ; *s; ++s ) h = ( h ^ (uint8_t) *s ) * 0x100000001b3ULL;
+		return h;
+	}
+};
+
+/* Equality of NUL terminated strings */
+struct CStrEqual {
+	bool operator()(const char *a, const char *b) const { return strcmp(a, b) == 0; }
+};
+
+typedef std :: unordered_map <const char *, uint32_t, CStrHash, CStrEqual> NameIndex;
+
+/* Chunked storage of NUL terminated strings, added strings never move until clear() */
+class StringArena {
+	public:
+		StringArena() : cur(NULL), left(0) {}
+		StringArena(StringArena &&other) noexcept;
+		StringArena &operator=(StringArena &&other) noexcept;
+		~StringArena() { clear(); }
+
+		StringArena(const StringArena &) = delete;
+		StringArena &operator=(const StringArena &) = delete;
+
+		/* Return 'n' bytes of storage */
+		char * alloc(size_t n) {
+			char	*p;
+			if ( n > left ) return alloc_slow(n);
+			p = cur;
+			cur += n;
+			left -= n;
+			return p;
+		}
+
+		/* Copy 'n' bytes of 's' followed by NUL */
+		const char * add(const char *s, size_t n) {
+			char	*p = alloc(n + 1);
+			memcpy(p, s, n);
+			p[n] = '\0';
+			return p;
+		}
+
+		const char * add(const char *s) { return add(s, strlen(s)); }
+
+		/* Free all strings */
+		void clear();
+
+	private:
+		std :: vector <char *>	chunks;		/* allocated chunks */
+		char			*cur;		/* free space of current chunk */
+		size_t			left;		/* bytes left in current chunk */
+
+		char * alloc_slow(size_t n);
+};
+
 /* Identifies symbols describing (currenty only functions) */
 class Symbol {
 	public:
@@ -23,11 +88,61 @@ class Symbol {
 			SYM_TYPE_DBG	= 0x8	/* Debugging symbol */
 		};
 
+		enum SymbolSource {		/* Symbol tables listing the symbol */
+			SYM_SRC_NONE	= 0x0,
+			SYM_SRC_STATIC	= 0x1,	/* Static symbol table (.symtab) */
+			SYM_SRC_DYNAMIC	= 0x2	/* Dynamic symbol table (.dynsym) */
+		};
+
 		uint8_t		type;
-		std :: string	name;	/* Symbol name */
+		uint8_t		source;	/* Tables listing symbol (SymbolSource) */
+		const char	*name;	/* Symbol name, points into file mapping or Binary :: names */
 		uint64_t	addr;	/* address of symbol */
 
-		Symbol() : type(SYM_TYPE_UNK), name(), addr(0) {}
+		Symbol() : type(SYM_TYPE_UNK), source(SYM_SRC_NONE), name(""), addr(0) {}
+};
+
+/* Adds symbols of several tables to a binary, keeping one symbol per (name, address),
+ * defined in symbol_table.cpp */
+class SymbolMerger {
+	public:
+		/* Prepare 'bin' for up to 'nsyms' more symbols */
+		SymbolMerger(Binary *bin, size_t nsyms);
+
+		/* Return symbol named 'name' at 'addr', appending it if new, and tag it with
+		 * 'source'; 'name' is copied into string arena if 'copy', else it must outlive 'bin' */
+		Symbol * add(const char *name, uint64_t addr, uint8_t source, bool copy);
+
+	private:
+		Binary			*bin;		/* binary receiving symbols */
+		std :: vector <uint32_t> slots;		/* open addressing table of symbol index + 1 */
+		size_t			used;		/* occupied slots */
+
+		static size_t hash(const char *name, uint64_t addr) {
+			return CStrHash()(name) ^ ( addr * 0x9e3779b97f4a7c15ULL );
+		}
+		void rehash(size_t nslots);
+};
+
+/* Columnar copy of symbols (one array per field), defined in symbol_table.cpp */
+class SymbolTable {
+	public:
+		std :: vector <uint64_t>	addr;	/* address of each symbol */
+		std :: vector <uint8_t>		type;	/* Symbol :: SymbolType flags of each symbol */
+		std :: vector <const char *>	name;	/* name of each symbol */
+
+		/* Fill columns from 'symbols', indices match positions in 'symbols' */
+		void build(const std :: vector <Symbol> &symbols);
+
+		size_t size() const { return addr.size(); }
+
+		/* Append indices of symbols having any of the 'mask' type flags (all symbols if 0) */
+		void filter(uint8_t mask, std :: vector <uint32_t> &idx) const;
+
+		/* Sort indices by address, keeping index order among equal addresses */
+		void sort_by_addr(std :: vector <uint32_t> &idx) const;
+
+		void clear() { addr.clear(); type.clear(); name.clear(); }
 };
 
 /*Indentifies sections as either CODE section or DATA section */
@@ -39,14 +154,30 @@ class Section {
 			SEC_TYPE_DATA	= 2	/* Data section */
 		};
 
+		enum SectionFlags {		/* Ownership of section contents */
+			SEC_FLAG_NONE	= 0x0,	/* No contents */
+			SEC_FLAG_MALLOC	= 0x1,	/* Contents copied to heap, freed on unload */
+			SEC_FLAG_MAPPED	= 0x2	/* Contents point into the binary's file mapping */
+		};
+
 		Binary		*binary;	/* Pointer to binary object containing the section */
 		std :: string	name;		/* Section name */
 		SectionType	type;
 		uint64_t	vma;		/* Virtual memory address to be loaded to */
 		uint64_t	size;		/* Section size in bytes */
-		uint8_t		*bytes;
+		uint64_t	filepos;	/* Offset of section contents in binary file */
+		uint8_t		flags;		/* Ownership of section contents (SectionFlags) */
+		uint8_t		*bytes;		/* Section contents, use get_bytes() to retrieve them */
+		void		*handle;	/* Loader's handle to section, used to retrieve contents */
+
+		Section() : binary(NULL), type(SEC_TYPE_NONE), vma(0), size(0), filepos(0), flags(SEC_FLAG_NONE), bytes(NULL), handle(NULL) {}
 
-		Section() : binary(NULL), type(SEC_TYPE_NONE), vma(0), size(0), bytes(NULL) {}
+		/* Return section contents, retrieving them on first use. NULL on failure */
+		uint8_t * get_bytes() {
+			if ( flags == SEC_FLAG_NONE && load_section_bytes(this) < 0 )
+				return NULL;
+			return bytes;
+		}
 
 		/* Return TRUE if an address is within this section, else return FALSE */
 		bool contains(uint64_t addr) { return ( addr >= vma ) && ( addr - vma < size ); }
@@ -66,6 +197,13 @@ class Binary {
 			ARCH_X86	= 1, 	/* x86 OR amd64 file */
 		};
 
+		enum LoadFlags {		/* Options controlling how libbfd loads binary, native ELF loads always map */
+			LOAD_DEFAULT	= 0x0,	/* Copy section contents to heap */
+			LOAD_MMAP	= 0x1,	/* Map file once and reference section contents in place */
+			LOAD_LAZY	= 0x2,	/* Retrieve section contents on first use */
+			LOAD_BFD	= 0x4	/* Always load through libbfd, bypassing native ELF loader */
+		};
+
 		std :: string		filename;	/* Name of binary */
 		BinaryType		type;
 		std :: string		type_str;	/* Description of binary type */
@@ -75,20 +213,55 @@ class Binary {
 		uint64_t		entry;		/* Entry point of the binary*/
 		std :: vector <Section> sections;	/* All sections in binary file */
 		std :: vector <Symbol>	symbols;	/* All symbols in binary file */	
+		uint8_t			*map;		/* Read-only mapping of binary file (NULL if not mapped) */
+		uint64_t		map_size;	/* Size of mapping in bytes */
+		void			*bfd_h;		/* libbfd handle kept open while loading lazily */
+		StringArena		names;		/* symbol names not found verbatim in file mapping */
+
+		/* Indexes built by build_index() once sections and symbols are loaded */
+		std :: vector <uint32_t> sym_by_addr;	/* symbols with non-zero address, sorted by address */
+		std :: vector <uint32_t> sec_by_addr;	/* sections sorted by virtual memory address */
+		SymbolTable		symtab;		/* columnar copy of symbols */
+		NameIndex		sym_by_name;	/* first symbol of each name */
+		NameIndex		sec_by_name;	/* first section of each name */
+
+		Binary() : type(BIN_TYPE_AUTO), arch(ARCH_NONE), bits(0), entry(0), map(NULL), map_size(0), bfd_h(NULL) {}
+
+		/* Build address and name indexes, 'sections' and 'symbols' must not change afterwards */
+		void build_index();
+
+		/* Return section named 'name', NULL if none */
+		Section * find_section(const char *name);
+
+		/* Return section containing 'addr', NULL if none */
+		Section * find_section(uint64_t addr);
 
-		Binary() : type(BIN_TYPE_AUTO), arch(ARCH_NONE), bits(0), entry(0) {}
+		/* Return first symbol named 'name', NULL if none */
+		Symbol * find_symbol(const char *name);
+
+		/* Return symbol with greatest address not above 'addr', NULL if none */
+		Symbol * nearest_symbol(uint64_t addr);
+
+		/* Return first symbol with address above 'addr', NULL if none */
+		Symbol * next_symbol(uint64_t addr);
+
+		/* Fill 'idx' with indices of symbols having any of the 'mask' type flags
+		 * (all symbols if 0), in load order or sorted by address if 'by_addr' */
+		void select_symbols(uint8_t mask, std :: vector <uint32_t> &idx, bool by_addr = false) const;
 
 		/* Return pointer to .text section of binary, if locatable */
-		Section * get_text_section() {
-			for ( auto &s : sections )
-				if ( s.name == ".text" )
-					return &s;
-			return NULL;
-		}
+		Section * get_text_section() { return find_section(".text"); }
 };
 
-/* Load binary for inspection */
-int load_binary(std :: string &fname, Binary *bin, Binary :: BinaryType type);
+/* Load binary for inspection, 'flags' is a combination of Binary :: LoadFlags (only LOAD_BFD affects native ELF loads) */
+int load_binary(std :: string &fname, Binary *bin, Binary :: BinaryType type, int flags = Binary :: LOAD_DEFAULT);
+
+/* Map binary file read-only into 'bin', mapping is released by unload_binary() */
+int map_binary(std :: string &fname, Binary *bin);
+
+/* Tell, without retrieving them, whether contents of 'sec' are stored as-is at its file
+ * offset in a file of 'file_size' bytes (1), are all zero (0), or cannot be told (-1) */
+int section_in_file(Section *sec, uint64_t file_size);
 
 /* Print the header information of binary */
 void print_binary_header(Binary &bin);
@@ -0,0 +1,77 @@
+#include <sys/resource.h>
+#include "metrics.hpp"
+
+Metrics				metrics;
+thread_local uint64_t		Metrics :: charged = 0;
+
+static const char * const	phase_names[Metrics :: NUM_PHASES] = {
+	"open", "symbols", "sections", "header", "decode", "format", "write"
+};
+
+static const char * const	counter_names[Metrics :: NUM_COUNTERS] = {
+	"bytes_loaded", "symbols", "instructions", "bytes_written"
+};
+
+Metrics :: Metrics() : enabled(false) {
+	for ( int i = 0; i < NUM_PHASES; ++i ) phase_ns[i] = phase_calls[i] = 0;
+	for ( int i = 0; i < NUM_COUNTERS; ++i ) counters[i] = 0;
+}
+
+/* FUNCTION: ~PhaseTimer
+ * PROCESS:
+ * 	a) charge time since last lap to phase of timer, if it has one
+ * 	b) publish time and laps of every phase touched
+ * RETURN VALUE: NONE
+ */
+PhaseTimer :: ~PhaseTimer() {
+	if ( !on ) return;
+	if ( phase != Metrics :: NUM_PHASES ) lap(phase);
+
+	for ( int i = 0; i < Metrics :: NUM_PHASES; ++i )
+		if ( calls[i] ) metrics.add_time((Metrics :: Phase) i, ns[i], calls[i]);
+}
+
+/* FUNCTION: report
+ * INPUT ARGUMENTS:
+ * 	f	: stream to print to
+ * 	json	: print a single JSON object instead of a table
+ * PROCESS:
+ * 	a) print time and entries of every phase, and their total
+ * 	b) print counters and peak resident set size
+ * RETURN VALUE: NONE
+ */
+void
+Metrics :: report(FILE *f, bool json) {
+	struct rusage	ru;		/* resource usage of process */
+	uint64_t	total;		/* time of all phases */
+	long		rss;		/* peak resident set size in KB */
+
+	rss = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+
+	total = 0;
+	for ( int i = 0; i < NUM_PHASES; ++i ) total += phase_ns[i];
+
+	if ( json ) {
+		fprintf(f, "{\"phases\":{");
+		for ( int i = 0; i < NUM_PHASES; ++i )
+			fprintf(f, "%s\"%s\":{\"calls\":%llu,\"ns\":%llu}", i ? "," : "", phase_names[i],
+				(unsigned long long) phase_calls[i], (unsigned long long) phase_ns[i]);
+		fprintf(f, "},\"total_ns\":%llu,\"counters\":{", (unsigned long long) total);
+		for ( int i = 0; i < NUM_COUNTERS; ++i )
+			fprintf(f, "%s\"%s\":%llu", i ? "," : "", counter_names[i], (unsigned long long) counters[i]);
+		fprintf(f, "},\"peak_rss_kb\":%ld}\n", rss);
+		return;
+	}
+
+	fprintf(f, "[*] Timing (summed over threads):\n");
+	fprintf(f, " %-14s %12s %14s %7s\n", "PHASE", "CALLS", "TIME (ms)", "SHARE");
+	for ( int i = 0; i < NUM_PHASES; ++i )
+		fprintf(f, " %-14s %12llu %14.3f %6.1f%%\n", phase_names[i], (unsigned long long) phase_calls[i],
+			phase_ns[i] / 1e6, total ? 100.0 * phase_ns[i] / total : 0.0);
+	fprintf(f, " %-14s %12s %14.3f\n", "total", "", total / 1e6);
+
+	fprintf(f, "[*] Counters:\n");
+	for ( int i = 0; i < NUM_COUNTERS; ++i )
+		fprintf(f, " %-14s %12llu\n", counter_names[i], (unsigned long long) counters[i]);
+	fprintf(f, " %-14s %12ld\n", "peak_rss_kb", rss);
+}
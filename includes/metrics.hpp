@@ -0,0 +1,111 @@
+#ifndef BIN_METRICS_H
+#define BIN_METRICS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+
+/* Time spent per phase and work done by a run, collected when 'enabled' (-T) */
+class Metrics {
+	public:
+		enum Phase {			/* Phases timed, each nanosecond is charged to one phase only */
+			PHASE_OPEN	= 0,	/* Opening and mapping file, reading headers */
+			PHASE_SYMBOLS	= 1,	/* Reading, canonicalizing, merging and indexing symbols */
+			PHASE_SECTIONS	= 2,	/* Creating sections and reading their contents */
+			PHASE_HEADER	= 3,	/* Formatting header, section and symbol tables */
+			PHASE_DECODE	= 4,	/* Decoding instructions with capstone */
+			PHASE_FORMAT	= 5,	/* Formatting instructions */
+			PHASE_WRITE	= 6,	/* Writing output to file descriptors */
+			NUM_PHASES	= 7
+		};
+
+		enum Counter {
+			CNT_BYTES_LOADED	= 0,	/* Bytes of section contents read or mapped */
+			CNT_SYMBOLS		= 1,	/* Symbols loaded */
+			CNT_INSNS		= 2,	/* Instructions decoded */
+			CNT_BYTES_WRITTEN	= 3,	/* Bytes of output written */
+			NUM_COUNTERS		= 4
+		};
+
+		bool	enabled;
+
+		Metrics();
+
+		/* Monotonic time in nanoseconds */
+		static uint64_t now() {
+			return std :: chrono :: duration_cast <std :: chrono :: nanoseconds> (
+				std :: chrono :: steady_clock :: now().time_since_epoch()).count();
+		}
+
+		/* Charge 'ns' nanoseconds and 'calls' entries to 'phase' */
+		void add_time(Phase phase, uint64_t ns, uint64_t calls) {
+			phase_ns[phase].fetch_add(ns, std :: memory_order_relaxed);
+			phase_calls[phase].fetch_add(calls, std :: memory_order_relaxed);
+		}
+
+		/* Add 'n' to 'counter', if enabled */
+		void count(Counter counter, uint64_t n) {
+			if ( enabled ) counters[counter].fetch_add(n, std :: memory_order_relaxed);
+		}
+
+		/* Print phase times, counters and peak resident set size to 'f', as a table
+		 * or a single JSON object */
+		void report(FILE *f, bool json);
+
+		/* Nanoseconds charged by timers of the calling thread, lets enclosing timers
+		 * exclude the time of nested ones */
+		static thread_local uint64_t	charged;
+
+	private:
+		std :: atomic <uint64_t>	phase_ns[NUM_PHASES];
+		std :: atomic <uint64_t>	phase_calls[NUM_PHASES];
+		std :: atomic <uint64_t>	counters[NUM_COUNTERS];
+};
+
+extern Metrics metrics;
+
+/* Charges elapsed time to phases, excluding time charged by timers nested inside it.
+ * lap() charges time since the previous lap to a phase, so a loop alternating between
+ * phases keeps its sums locally and publishes them once, on destruction, together with
+ * the remaining time charged to the phase given at construction (if any) */
+class PhaseTimer {
+	public:
+		explicit PhaseTimer(Metrics :: Phase phase = Metrics :: NUM_PHASES) : phase(phase), on(metrics.enabled) {
+			if ( !on ) return;
+			last = Metrics :: now();
+			base = Metrics :: charged;
+			for ( int i = 0; i < Metrics :: NUM_PHASES; ++i ) ns[i] = calls[i] = 0;
+		}
+
+		~PhaseTimer();
+
+		PhaseTimer(const PhaseTimer &) = delete;
+		PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+		/* Charge time since previous lap, less nested timers, to 'p' */
+		void lap(Metrics :: Phase p) {
+			uint64_t	t, elapsed;
+
+			if ( !on ) return;
+			t       = Metrics :: now();
+			elapsed = t - last;
+
+			ns[p]	+= elapsed - ( Metrics :: charged - base );
+			calls[p]++;
+
+			Metrics :: charged = base + elapsed;
+			base = Metrics :: charged;
+			last = t;
+		}
+
+	private:
+		Metrics :: Phase	phase;				/* phase charged with remaining time */
+		bool			on;				/* metrics were enabled at construction */
+		uint64_t		last;				/* time of previous lap */
+		uint64_t		base;				/* 'charged' at previous lap */
+		uint64_t		ns[Metrics :: NUM_PHASES];	/* time charged per phase */
+		uint64_t		calls[Metrics :: NUM_PHASES];	/* laps per phase */
+};
+
+#endif /* BIN_METRICS_H */
@@ -0,0 +1,234 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <unistd.h>
+#include "output.hpp"
+#include "metrics.hpp"
+
+const char OutputBuffer :: hex_digits[17] = "0123456789abcdef";
+
+OutputBuffer			stdout_buf(STDOUT_FILENO);
+thread_local OutputBuffer	*out = &stdout_buf;
+OutputBuffer :: Format		out_format = OutputBuffer :: FMT_TEXT;
+
+/* FUNCTION: OutputBuffer
+ * INPUT ARGUMENTS:
+ * 	fd	: file descriptor to write to, < 0 to capture output in memory
+ * 	cap	: initial capacity of buffer
+ * PROCESS:
+ * 	a) allocate buffer
+ * RETURN VALUE: NONE
+ */
+OutputBuffer :: OutputBuffer(int fd, size_t cap) : fd(fd), buf(NULL), len(0), cap(cap), sent(0) {
+	if ( cap && !( buf = (char *) malloc(cap) ) ) throw std :: bad_alloc();
+}
+
+OutputBuffer :: OutputBuffer(OutputBuffer &&other) noexcept : fd(other.fd), buf(other.buf), len(other.len), cap(other.cap), sent(other.sent) {
+	other.buf = NULL;
+	other.len = 0;
+	other.cap = 0;
+}
+
+OutputBuffer :: ~OutputBuffer() {
+	flush();
+	free(buf);
+}
+
+/* FUNCTION: flush
+ * PROCESS:
+ * 	a) write buffered bytes to file descriptor, retrying on partial writes
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: flush() {
+	size_t	done;	/* bytes written so far */
+	ssize_t	n;	/* bytes written by single write() */
+
+	if ( fd < 0 || !buf ) return;
+
+	PhaseTimer	timer(Metrics :: PHASE_WRITE);
+	metrics.count(Metrics :: CNT_BYTES_WRITTEN, len);
+
+	for ( done = 0; done < len; done += n ) {
+		if ( ( n = :: write(fd, buf + done, len - done) ) < 0 ) {
+			if ( errno == EINTR ) { n = 0; continue; }
+			break;		/* reader went away, drop output */
+		}
+	}
+	sent += done;
+
+	len = 0;
+}
+
+/* FUNCTION: release
+ * PROCESS:
+ * 	a) flush buffered bytes (discarded when capturing)
+ * 	b) free buffer, it is reallocated on next write
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: release() {
+	flush();
+	free(buf);
+	buf = NULL;
+	len = 0;
+	cap = 0;
+}
+
+/* FUNCTION: write_slow
+ * INPUT ARGUMENTS:
+ * 	s	: bytes to append
+ * 	n	: number of bytes
+ * PROCESS:
+ * 	a) when writing to a file descriptor, flush buffer and write large blocks directly
+ * 	b) when capturing, grow buffer
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: write_slow(const char *s, size_t n) {
+	ssize_t	w;	/* bytes written by single write() */
+
+	if ( fd >= 0 ) {
+		flush();
+		if ( n >= cap ) {
+			PhaseTimer	timer(Metrics :: PHASE_WRITE);
+			metrics.count(Metrics :: CNT_BYTES_WRITTEN, n);
+
+			while ( n > 0 ) {
+				if ( ( w = :: write(fd, s, n) ) < 0 ) {
+					if ( errno == EINTR ) continue;
+					return;
+				}
+				s += w;
+				n -= w;
+				sent += w;
+			}
+			return;
+		}
+	} else {
+		grow(n);
+	}
+
+	memcpy(buf + len, s, n);
+	len += n;
+}
+
+/* FUNCTION: grow
+ * INPUT ARGUMENTS:
+ * 	n	: number of bytes that must fit after buffered bytes
+ * PROCESS:
+ * 	a) flush buffer when writing to a file descriptor
+ * 	b) enlarge buffer if 'n' bytes still do not fit
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: grow(size_t n) {
+	char	*p;		/* reallocated buffer */
+	size_t	ncap;		/* new capacity */
+
+	if ( fd >= 0 ) flush();
+	if ( n <= cap - len ) return;
+
+	for ( ncap = cap ? cap : OUT_BUF_SIZE; ncap - len < n; ncap *= 2 );
+
+	if ( !( p = (char *) realloc(buf, ncap) ) ) throw std :: bad_alloc();
+	buf = p;
+	cap = ncap;
+}
+
+/* FUNCTION: str
+ * INPUT ARGUMENTS:
+ * 	s	: string to append
+ * 	width	: minimum field width, right aligned if positive, left aligned if negative
+ * PROCESS:
+ * 	a) append padding and string the way printf("%*s") does
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: str(const char *s, int width) {
+	size_t	n;	/* length of string */
+	size_t	pad;	/* number of padding spaces */
+	char	*p;	/* destination of padding */
+
+	n   = strlen(s);
+	pad = ( width < 0 ? (size_t) -width : (size_t) width );
+	pad = ( pad > n ) ? pad - n : 0;
+
+	if ( width > 0 ) {
+		p = reserve(pad);
+		memset(p, ' ', pad);
+		advance(pad);
+	}
+
+	write(s, n);
+
+	if ( width < 0 ) {
+		p = reserve(pad);
+		memset(p, ' ', pad);
+		advance(pad);
+	}
+}
+
+/* FUNCTION: dec
+ * INPUT ARGUMENTS:
+ * 	v	: value to append
+ * 	width	: minimum field width, as in str()
+ * PROCESS:
+ * 	a) convert value to decimal digits and append them padded
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: dec(uint64_t v, int width) {
+	char	digits[21];	/* decimal digits of value, NUL terminated */
+	char	*p;		/* first digit */
+
+	p  = digits + sizeof(digits) - 1;
+	*p = '\0';
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while ( v );
+
+	str(p, width);
+}
+
+/* FUNCTION: json_str
+ * INPUT ARGUMENTS:
+ * 	s	: bytes to append
+ * 	n	: number of bytes
+ * PROCESS:
+ * 	a) append runs of printable ASCII at once
+ * 	b) escape quotes and backslashes, use short escapes for common control
+ * 	   characters and \u00XX for anything else, keeping output valid JSON
+ * 	   whatever the encoding of 's'
+ * RETURN VALUE: NONE
+ */
+void
+OutputBuffer :: json_str(const char *s, size_t n) {
+	size_t		i, run;		/* loop iterator, start of unescaped run */
+	unsigned char	c;		/* byte being examined */
+
+	put('"');
+	for ( i = run = 0; i < n; ++i ) {
+		c = s[i];
+		if ( c >= 0x20 && c < 0x7f && c != '"' && c != '\\' ) continue;
+
+		write(s + run, i - run);
+		run = i + 1;
+
+		switch ( c ) {
+			case '"':	lit("\\\"");	break;
+			case '\\':	lit("\\\\");	break;
+			case '\n':	lit("\\n");	break;
+			case '\t':	lit("\\t");	break;
+			case '\r':	lit("\\r");	break;
+			default:
+				lit("\\u00");
+				hex(c, 2);
+				break;
+		}
+	}
+	write(s + run, n - run);
+	put('"');
+}
@@ -0,0 +1,111 @@
+#ifndef BIN_OUTPUT_H
+#define BIN_OUTPUT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#define OUT_BUF_SIZE		(1 << 16)	/* bytes buffered before writing to file descriptor */
+
+/* Buffered writer used for all formatted output, replaces per-field printf */
+class OutputBuffer {
+	public:
+		enum Format {			/* Representation of output, see records.hpp */
+			FMT_TEXT	= 0,	/* Colored text for terminals */
+			FMT_JSONL	= 1,	/* One JSON object per line */
+			FMT_BIN		= 2	/* Length prefixed binary records */
+		};
+
+		/* 'fd' < 0 captures output in memory, retrieved through data() and size() */
+		explicit OutputBuffer(int fd, size_t cap = OUT_BUF_SIZE);
+		OutputBuffer(OutputBuffer &&other) noexcept;
+		~OutputBuffer();
+
+		OutputBuffer(const OutputBuffer &) = delete;
+		OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+		/* Append 'n' bytes */
+		void write(const char *s, size_t n) {
+			if ( n > cap - len ) { write_slow(s, n); return; }
+			memcpy(buf + len, s, n);
+			len += n;
+		}
+
+		/* Append string literal, its length is known at compile time */
+		template <size_t N>
+		void lit(const char (&s)[N]) { write(s, N - 1); }
+
+		/* Append single character */
+		void put(char c) {
+			if ( len == cap ) grow(1);
+			buf[len++] = c;
+		}
+
+		/* Append string, padded with spaces to 'width' like printf("%*s"), negative 'width' pads on right */
+		void str(const char *s, int width = 0);
+
+		/* Append 'digits' lowercase hexadecimal digits of 'v', like printf("%0*jx") */
+		void hex(uint64_t v, int digits) {
+			char	*p = reserve(digits);
+			for ( int i = digits - 1; i >= 0; --i, v >>= 4 )
+				p[i] = hex_digits[v & 0xf];
+			len += digits;
+		}
+
+		/* Append decimal value of 'v', padded like str() */
+		void dec(uint64_t v, int width = 0);
+
+		/* Append 'n' bytes of 's' as a quoted JSON string, escaping quotes, backslashes,
+		 * control characters and bytes outside printable ASCII */
+		void json_str(const char *s, size_t n);
+
+		/* Append value in native byte order */
+		template <class T>
+		void raw(T v) { write((const char *) &v, sizeof(v)); }
+
+		/* Return pointer to at least 'n' writable bytes, publish them with advance() */
+		char * reserve(size_t n) {
+			if ( n > cap - len ) grow(n);
+			return buf + len;
+		}
+
+		/* Publish 'n' bytes written to pointer returned by reserve() */
+		void advance(size_t n) { len += n; }
+
+		/* Write buffered bytes to file descriptor (no-op when capturing) */
+		void flush();
+
+		/* Captured output (only meaningful when 'fd' < 0) */
+		const char * data() const { return buf; }
+		size_t size() const { return len; }
+		void clear() { len = 0; }
+
+		/* Number of bytes written to file descriptor so far */
+		uint64_t written() const { return sent; }
+
+		/* Write pending bytes and give buffer memory back */
+		void release();
+
+		static const char hex_digits[17];
+
+	private:
+		int	fd;		/* destination file descriptor, < 0 when capturing */
+		char	*buf;		/* buffered bytes */
+		size_t	len;		/* number of buffered bytes */
+		size_t	cap;		/* capacity of buffer */
+		uint64_t	sent;		/* bytes written to file descriptor */
+
+		void write_slow(const char *s, size_t n);
+		void grow(size_t n);
+};
+
+/* Buffered standard output, flushed at exit */
+extern OutputBuffer stdout_buf;
+
+/* Destination of formatted output of the calling thread, standard output by default */
+extern thread_local OutputBuffer *out;
+
+/* Representation of all output (OutputBuffer :: Format), set once before output starts */
+extern OutputBuffer :: Format out_format;
+
+#endif /* BIN_OUTPUT_H */
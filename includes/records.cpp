@@ -0,0 +1,372 @@
+#include <cstring>
+#include "records.hpp"
+
+/* FUNCTION: bin_header
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	kind	: REC_* kind of record
+ * 	n	: bytes of fields following kind
+ * RETURN VALUE: NONE
+ */
+static void
+bin_header(OutputBuffer &o, uint8_t kind, size_t n) {
+	o.raw((uint32_t) ( n + 1 ));
+	o.raw(kind);
+}
+
+/* FUNCTION: bin_name
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	s	: string
+ * 	n	: length of string
+ * RETURN VALUE: NONE
+ */
+static void
+bin_name(OutputBuffer &o, const char *s, size_t n) {
+	o.raw((uint32_t) n);
+	o.write(s, n);
+}
+
+/* FUNCTION: emit_binary
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	bin	: loaded binary
+ * PROCESS:
+ * 	a) append file name, format, architecture, word size and entry point
+ * RETURN VALUE: NONE
+ */
+void
+emit_binary(OutputBuffer &o, Binary &bin) {
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_BINARY, 8 + 3 + 12 + bin.filename.size() + bin.type_str.size() + bin.arch_str.size());
+		o.raw(bin.entry);
+		o.raw((uint8_t) bin.bits);
+		o.raw((uint8_t) bin.type);
+		o.raw((uint8_t) bin.arch);
+		bin_name(o, bin.filename.data(), bin.filename.size());
+		bin_name(o, bin.type_str.data(), bin.type_str.size());
+		bin_name(o, bin.arch_str.data(), bin.arch_str.size());
+		return;
+	}
+
+	o.lit("{\"record\":\"binary\",\"file\":");
+	o.json_str(bin.filename.data(), bin.filename.size());
+	o.lit(",\"format\":");
+	o.json_str(bin.type_str.data(), bin.type_str.size());
+	o.lit(",\"arch\":");
+	o.json_str(bin.arch_str.data(), bin.arch_str.size());
+	o.lit(",\"bits\":");
+	o.dec(bin.bits);
+	o.lit(",\"entry\":");
+	o.dec(bin.entry);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_section
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	sec	: section of binary
+ * PROCESS:
+ * 	a) append name, address, size and type of section
+ * RETURN VALUE: NONE
+ */
+void
+emit_section(OutputBuffer &o, Section &sec) {
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_SECTION, 8 + 8 + 1 + 4 + sec.name.size());
+		o.raw(sec.vma);
+		o.raw(sec.size);
+		o.raw((uint8_t) sec.type);
+		bin_name(o, sec.name.data(), sec.name.size());
+		return;
+	}
+
+	o.lit("{\"record\":\"section\",\"name\":");
+	o.json_str(sec.name.data(), sec.name.size());
+	o.lit(",\"vma\":");
+	o.dec(sec.vma);
+	o.lit(",\"size\":");
+	o.dec(sec.size);
+	if ( sec.type == Section :: SEC_TYPE_CODE )
+		o.lit(",\"kind\":\"code\"}\n");
+	else if ( sec.type == Section :: SEC_TYPE_DATA )
+		o.lit(",\"kind\":\"data\"}\n");
+	else
+		o.lit(",\"kind\":\"none\"}\n");
+}
+
+/* FUNCTION: emit_symbol
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	name	: symbol name
+ * 	addr	: symbol address
+ * 	type	: Symbol :: SymbolType flags
+ * 	source	: Symbol :: SymbolSource flags
+ * PROCESS:
+ * 	a) append name and address of symbol, its type flags and tables listing it
+ * RETURN VALUE: NONE
+ */
+void
+emit_symbol(OutputBuffer &o, const char *name, uint64_t addr, uint8_t type, uint8_t source) {
+	size_t	n = strlen(name);
+	char	sep;	/* separator before next array element */
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_SYMBOL, 8 + 1 + 1 + 4 + n);
+		o.raw(addr);
+		o.raw(type);
+		o.raw(source);
+		bin_name(o, name, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"symbol\",\"name\":");
+	o.json_str(name, n);
+	o.lit(",\"addr\":");
+	o.dec(addr);
+
+	o.lit(",\"flags\":[");
+	sep = '\0';
+	if ( type & Symbol :: SYM_TYPE_FUN ) { o.lit("\"function\"");				sep = ','; }
+	if ( type & Symbol :: SYM_TYPE_LOC ) { if ( sep ) o.put(sep); o.lit("\"local\"");	sep = ','; }
+	if ( type & Symbol :: SYM_TYPE_GLB ) { if ( sep ) o.put(sep); o.lit("\"global\"");	sep = ','; }
+	if ( type & Symbol :: SYM_TYPE_DBG ) { if ( sep ) o.put(sep); o.lit("\"debugging\""); }
+
+	o.lit("],\"tables\":[");
+	if ( source & Symbol :: SYM_SRC_STATIC ) o.lit("\"static\"");
+	if ( source == ( Symbol :: SYM_SRC_STATIC | Symbol :: SYM_SRC_DYNAMIC ) ) o.put(',');
+	if ( source & Symbol :: SYM_SRC_DYNAMIC ) o.lit("\"dynamic\"");
+	o.lit("]}\n");
+}
+
+/* FUNCTION: emit_insn
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	addr	: address of instruction
+ * 	bytes	: encoded bytes of instruction
+ * 	size	: number of encoded bytes
+ * 	mnemonic: instruction mnemonic
+ * 	op_str	: instruction operands
+ * PROCESS:
+ * 	a) append address, encoded bytes, mnemonic and operands
+ * RETURN VALUE: NONE
+ */
+void
+emit_insn(OutputBuffer &o, uint64_t addr, const uint8_t *bytes, size_t size,
+          const char *mnemonic, const char *op_str) {
+	size_t	m = strlen(mnemonic), n = strlen(op_str);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_INSN, 8 + 1 + size + 1 + m + 1 + n);
+		o.raw(addr);
+		o.raw((uint8_t) size);
+		o.write((const char *) bytes, size);
+		o.raw((uint8_t) m);
+		o.write(mnemonic, m);
+		o.raw((uint8_t) n);
+		o.write(op_str, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"insn\",\"addr\":");
+	o.dec(addr);
+	o.lit(",\"bytes\":\"");
+	for ( size_t j = 0; j < size; ++j ) o.hex(bytes[j], 2);
+	o.lit("\",\"mnemonic\":");
+	o.json_str(mnemonic, m);
+	o.lit(",\"operands\":");
+	o.json_str(op_str, n);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_coverage
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	section	: name of code section
+ * 	size	: size of section
+ * 	covered	: bytes of section covered by decoded instructions
+ * 	ninsns	: number of decoded instructions
+ * RETURN VALUE: NONE
+ */
+void
+emit_coverage(OutputBuffer &o, const char *section, uint64_t size, uint64_t covered, uint64_t ninsns) {
+	size_t	n = strlen(section);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_COVERAGE, 8 + 8 + 8 + 4 + n);
+		o.raw(size);
+		o.raw(covered);
+		o.raw(ninsns);
+		bin_name(o, section, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"coverage\",\"section\":");
+	o.json_str(section, n);
+	o.lit(",\"size\":");
+	o.dec(size);
+	o.lit(",\"covered\":");
+	o.dec(covered);
+	o.lit(",\"insns\":");
+	o.dec(ninsns);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_diff
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	kind	: DIFF_KIND_* of compared region
+ * 	status	: DIFF_* outcome of comparison
+ * 	name	: name of section or function
+ * 	old_addr: address of region in old binary
+ * 	old_size: size of region in old binary
+ * 	new_addr: address of region in new binary
+ * 	new_size: size of region in new binary
+ * RETURN VALUE: NONE
+ */
+void
+emit_diff(OutputBuffer &o, uint8_t kind, uint8_t status, const char *name,
+          uint64_t old_addr, uint64_t old_size, uint64_t new_addr, uint64_t new_size) {
+	static const char * const	statuses[] = { "same", "changed", "added", "removed" };
+	size_t				n = strlen(name);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_DIFF, 8 * 4 + 1 + 1 + 4 + n);
+		o.raw(old_addr);
+		o.raw(old_size);
+		o.raw(new_addr);
+		o.raw(new_size);
+		o.raw(kind);
+		o.raw(status);
+		bin_name(o, name, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"diff\",\"kind\":");
+	if ( kind == DIFF_KIND_SECTION )
+		o.lit("\"section\"");
+	else
+		o.lit("\"function\"");
+	o.lit(",\"name\":");
+	o.json_str(name, n);
+	o.lit(",\"status\":\"");
+	o.str(statuses[status]);
+	o.lit("\",\"old_addr\":");
+	o.dec(old_addr);
+	o.lit(",\"old_size\":");
+	o.dec(old_size);
+	o.lit(",\"new_addr\":");
+	o.dec(new_addr);
+	o.lit(",\"new_size\":");
+	o.dec(new_size);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_stat
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	kind	: STAT_* kind of count
+ * 	name	: name of count
+ * 	count	: value
+ * RETURN VALUE: NONE
+ */
+void
+emit_stat(OutputBuffer &o, uint8_t kind, const char *name, uint64_t count) {
+	static const char * const	kinds[] = { "total", "class", "length", "mnemonic" };
+	size_t				n = strlen(name);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_STAT, 8 + 1 + 4 + n);
+		o.raw(count);
+		o.raw(kind);
+		bin_name(o, name, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"stat\",\"kind\":\"");
+	o.str(kinds[kind]);
+	o.lit("\",\"name\":");
+	o.json_str(name, n);
+	o.lit(",\"count\":");
+	o.dec(count);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_match
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	sig	: index of signature
+ * 	pattern	: signature as given
+ * 	section	: name of section holding match
+ * 	addr	: address of match
+ * 	symbol	: name of symbol with greatest address not above match, empty if none
+ * 	offset	: offset of match into symbol
+ * RETURN VALUE: NONE
+ */
+void
+emit_match(OutputBuffer &o, uint32_t sig, const char *pattern, const char *section,
+           uint64_t addr, const char *symbol, uint64_t offset) {
+	size_t	np = strlen(pattern);
+	size_t	ns = strlen(section);
+	size_t	ny = strlen(symbol);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_MATCH, 8 + 8 + 4 + 4 + np + 4 + ns + 4 + ny);
+		o.raw(addr);
+		o.raw(offset);
+		o.raw(sig);
+		bin_name(o, pattern, np);
+		bin_name(o, section, ns);
+		bin_name(o, symbol, ny);
+		return;
+	}
+
+	o.lit("{\"record\":\"match\",\"signature\":");
+	o.dec(sig);
+	o.lit(",\"pattern\":");
+	o.json_str(pattern, np);
+	o.lit(",\"section\":");
+	o.json_str(section, ns);
+	o.lit(",\"addr\":");
+	o.dec(addr);
+	o.lit(",\"symbol\":");
+	o.json_str(symbol, ny);
+	o.lit(",\"offset\":");
+	o.dec(offset);
+	o.lit("}\n");
+}
+
+/* FUNCTION: emit_string
+ * INPUT ARGUMENTS:
+ * 	o	: output buffer
+ * 	section	: name of section holding string
+ * 	addr	: address of string
+ * 	enc	: STR_* encoding of string in section
+ * 	value	: characters of string (UTF-16LE code units narrowed to ASCII)
+ * 	n	: number of characters
+ * RETURN VALUE: NONE
+ */
+void
+emit_string(OutputBuffer &o, const char *section, uint64_t addr, uint8_t enc, const char *value, size_t n) {
+	size_t	ns = strlen(section);
+
+	if ( out_format == OutputBuffer :: FMT_BIN ) {
+		bin_header(o, REC_STRING, 8 + 1 + 4 + ns + 4 + n);
+		o.raw(addr);
+		o.raw(enc);
+		bin_name(o, section, ns);
+		bin_name(o, value, n);
+		return;
+	}
+
+	o.lit("{\"record\":\"string\",\"section\":");
+	o.json_str(section, ns);
+	o.lit(",\"addr\":");
+	o.dec(addr);
+	if ( enc == STR_UTF16LE )
+		o.lit(",\"encoding\":\"utf16le\",\"value\":");
+	else
+		o.lit(",\"encoding\":\"ascii\",\"value\":");
+	o.json_str(value, n);
+	o.lit("}\n");
+}
@@ -0,0 +1,95 @@
+#ifndef BIN_RECORDS_H
+#define BIN_RECORDS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "loader.hpp"
+#include "output.hpp"
+
+/* Machine readable output (out_format other than FMT_TEXT). Output of each binary is a
+ * binary record followed by section and symbol records (-x) and instruction records (-l).
+ *
+ * FMT_JSONL writes one object per line, with a "record" member naming its kind:
+ * 	{"record":"binary","file":..,"format":..,"arch":..,"bits":..,"entry":..}
+ * 	{"record":"section","name":..,"vma":..,"size":..,"kind":"code"|"data"|"none"}
+ * 	{"record":"symbol","name":..,"addr":..,"flags":["function",..],"tables":["static",..]}
+ * 	{"record":"insn","addr":..,"bytes":"hex",..,"mnemonic":..,"operands":..}
+ * 	{"record":"coverage","section":..,"size":..,"covered":..,"insns":..}
+ * 	{"record":"diff","kind":"section"|"function","name":..,"status":"same"|"changed"|"added"|"removed",
+ * 	 "old_addr":..,"old_size":..,"new_addr":..,"new_size":..}
+ * 	{"record":"stat","kind":"total"|"class"|"length"|"mnemonic","name":..,"count":..}
+ * 	{"record":"string","section":..,"addr":..,"encoding":"ascii"|"utf16le","value":..}
+ * 	{"record":"match","signature":..,"pattern":..,"section":..,"addr":..,"symbol":..,"offset":..}
+ *
+ * FMT_BIN writes records as a uint32 length of what follows, a uint8 REC_* kind and the
+ * fields below in native byte order, strings being preceded by their length (uint32 for
+ * names, uint8 for mnemonic and operands):
+ * 	REC_BINARY	uint64 entry, uint8 bits, uint8 type, uint8 arch, file, format, arch
+ * 	REC_SECTION	uint64 vma, uint64 size, uint8 type, name
+ * 	REC_SYMBOL	uint64 addr, uint8 type flags, uint8 source flags, name
+ * 	REC_INSN	uint64 addr, uint8 size, bytes, mnemonic, operands
+ * 	REC_COVERAGE	uint64 size, uint64 covered, uint64 insns, section name
+ * 	REC_DIFF	uint64 old addr, uint64 old size, uint64 new addr, uint64 new size,
+ * 			uint8 kind (DIFF_KIND_*), uint8 status (DIFF_*), name
+ * 	REC_STAT	uint64 count, uint8 kind (STAT_*), name
+ * 	REC_STRING	uint64 addr, uint8 encoding (STR_*), section name, value (UTF-16LE narrowed)
+ * 	REC_MATCH	uint64 addr, uint64 offset into symbol, uint32 signature index, pattern,
+ * 			section name, symbol name (empty if none)
+ */
+#define REC_BINARY		1
+#define REC_SECTION		2
+#define REC_SYMBOL		3
+#define REC_INSN		4
+#define REC_COVERAGE		5
+#define REC_DIFF		6
+#define REC_STAT		7
+#define REC_MATCH		8
+#define REC_STRING		9
+
+#define DIFF_KIND_SECTION	0		/* diff record compares sections */
+#define DIFF_KIND_FUNCTION	1		/* diff record compares functions */
+
+#define DIFF_SAME		0		/* region has identical contents in both binaries */
+#define DIFF_CHANGED		1		/* region exists in both binaries, contents differ */
+#define DIFF_ADDED		2		/* region exists in new binary only */
+#define DIFF_REMOVED		3		/* region exists in old binary only */
+
+#define STAT_TOTAL		0		/* instructions, bytes decoded, undecodable bytes */
+#define STAT_CLASS		1		/* instructions of a class (calls, syscalls, ..) */
+#define STAT_LENGTH		2		/* instructions of an encoded length, named by length */
+#define STAT_MNEMONIC		3		/* instructions of a mnemonic */
+
+#define STR_ASCII		0		/* string of printable ASCII bytes */
+#define STR_UTF16LE		1		/* string of UTF-16LE code units in printable ASCII range */
+
+/* Append record describing binary as a whole */
+void emit_binary(OutputBuffer &o, Binary &bin);
+
+/* Append record of section (contents are not included) */
+void emit_section(OutputBuffer &o, Section &sec);
+
+/* Append record of symbol */
+void emit_symbol(OutputBuffer &o, const char *name, uint64_t addr, uint8_t type, uint8_t source);
+
+/* Append record of decoded instruction */
+void emit_insn(OutputBuffer &o, uint64_t addr, const uint8_t *bytes, size_t size,
+               const char *mnemonic, const char *op_str);
+
+/* Append record of bytes of a section covered by recursive disassembly */
+void emit_coverage(OutputBuffer &o, const char *section, uint64_t size, uint64_t covered, uint64_t ninsns);
+
+/* Append record comparing a section or function of two binaries (absent side is all zero) */
+void emit_diff(OutputBuffer &o, uint8_t kind, uint8_t status, const char *name,
+               uint64_t old_addr, uint64_t old_size, uint64_t new_addr, uint64_t new_size);
+
+/* Append record of one count of instruction statistics */
+void emit_stat(OutputBuffer &o, uint8_t kind, const char *name, uint64_t count);
+
+/* Append record of string of 'n' characters 'value' found at 'addr' */
+void emit_string(OutputBuffer &o, const char *section, uint64_t addr, uint8_t enc, const char *value, size_t n);
+
+/* Append record of signature 'sig' (index of pattern on command line) found at 'addr' */
+void emit_match(OutputBuffer &o, uint32_t sig, const char *pattern, const char *section,
+                uint64_t addr, const char *symbol, uint64_t offset);
+
+#endif /* BIN_RECORDS_H */
@@ -0,0 +1,470 @@
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <capstone/capstone.h>
+#include "recursive_disassembler.hpp"
+#include "linear_disassembler.hpp"
+#include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+#include "metrics.hpp"
+#include "disasm_backend.hpp"
+
+/* A code section being explored */
+struct CodeRegion {
+    Section         *sec;       /* code section */
+    const uint8_t   *bytes;     /* contents of section */
+    std :: unique_ptr <std :: atomic <uint64_t> []> visited;   /* bit per byte, set once decoding from it is claimed */
+
+    CodeRegion(Section *s, const uint8_t *b) : sec(s), bytes(b), visited(new std :: atomic <uint64_t> [s -> size / 64 + 1]) {
+        for ( uint64_t i = 0; i <= s -> size / 64; ++i ) visited[i].store(0, std :: memory_order_relaxed);
+    }
+
+    /* Claim decoding at 'addr', FALSE if a worker already did */
+    bool claim(uint64_t addr) {
+        uint64_t    off = addr - sec -> vma;
+        uint64_t    bit = 1ULL << ( off & 63 );
+        return !( visited[off >> 6].fetch_or(bit, std :: memory_order_relaxed) & bit );
+    }
+
+    /* Return TRUE if decoding at 'addr' was claimed */
+    bool claimed(uint64_t addr) const {
+        uint64_t    off = addr - sec -> vma;
+        return visited[off >> 6].load(std :: memory_order_relaxed) & ( 1ULL << ( off & 63 ) );
+    }
+};
+
+/* Instruction decoded by a worker */
+struct Found {
+    uint64_t        addr;       /* address of instruction */
+    uint32_t        region;     /* index of code region holding it */
+    uint8_t         size;       /* number of encoded bytes */
+    const char      *mnemonic;  /* strings kept in arena of worker */
+    const char      *op_str;
+};
+
+/* Address to decode from, with region holding it (sections of object files share addresses) */
+typedef std :: pair <uint64_t, uint32_t> Target;
+
+/* State of one worker, its queue can be stolen from by other workers */
+struct Worker {
+    std :: mutex            lock;       /* guards 'queue' */
+    std :: deque <Target>   queue;      /* owner pushes and pops at back, thieves take from front */
+    std :: vector <Found>   found;      /* instructions decoded by worker */
+    StringArena             strings;    /* mnemonics and operands of 'found' */
+};
+
+/* Shared state of recursive descent */
+struct Explorer {
+    std :: vector <CodeRegion>      regions;    /* code sections sorted by address */
+    std :: unique_ptr <Worker []>   workers;    /* per worker queues and results */
+    unsigned                        nworkers;
+    std :: atomic <int64_t>         pending;    /* targets queued or being decoded */
+    std :: atomic <bool>            failed;     /* a worker could not open capstone */
+    DisasmMode                      mode;       /* decoding mode of binary */
+    std :: mutex                    idle_lock;  /* held by idle workers from their last look at the queues until they sleep */
+    std :: condition_variable       idle_cv;    /* signalled when a target is queued or exploration ends */
+    std :: atomic <unsigned>        idle;       /* workers parked on 'idle_cv' */
+};
+
+/* FUNCTION: find_region_below
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	addr	: address to locate
+ * 	below	: only regions with a lower index are searched
+ * PROCESS:
+ * 	a) binary search last region starting at or below 'addr'
+ * 	b) walk back to the first one containing it, sections of object files overlap
+ * RETURN VALUE:
+ * 	long : index of last such region containing 'addr', -1 if none
+ */
+static long
+find_region_below(Explorer &ex, uint64_t addr, long below) {
+    std :: vector <CodeRegion> :: iterator  it;     /* first region starting past 'addr' */
+
+    it = std :: upper_bound(ex.regions.begin(), ex.regions.begin() + below, addr, [](uint64_t a, const CodeRegion &r) {
+        return a < r.sec -> vma;
+    });
+    while ( it != ex.regions.begin() )
+        if ( ( --it ) -> sec -> contains(addr) ) return it - ex.regions.begin();
+
+    return -1;
+}
+
+/* FUNCTION: find_region
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	addr	: address to locate
+ * 	hint	: region tried first, branches mostly stay in their section
+ * PROCESS:
+ * 	a) check hint, then search all regions
+ * RETURN VALUE:
+ * 	long : index of region containing 'addr', -1 if none
+ */
+static long
+find_region(Explorer &ex, uint64_t addr, uint32_t hint) {
+    if ( hint < ex.regions.size() && ex.regions[hint].sec -> contains(addr) ) return hint;
+
+    return find_region_below(ex, addr, ex.regions.size());
+}
+
+/* FUNCTION: wake_workers
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	all	: wake every parked worker, not just one
+ * PROCESS:
+ * 	a) signal parked workers under 'idle_lock', so none misses it between its last
+ * 	   look at the queues and going to sleep
+ * RETURN VALUE: NONE
+ */
+static void
+wake_workers(Explorer &ex, bool all) {
+    std :: lock_guard <std :: mutex> g(ex.idle_lock);
+
+    if ( all ) ex.idle_cv.notify_all();
+    else ex.idle_cv.notify_one();
+}
+
+/* FUNCTION: push_target
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	w	: worker whose queue receives target
+ * 	addr	: address to decode from
+ * 	hint	: region tried first
+ * PROCESS:
+ * 	a) queue addresses inside code regions not decoded yet
+ * 	b) wake a parked worker to steal it
+ * RETURN VALUE: NONE
+ */
+static void
+push_target(Explorer &ex, Worker &w, uint64_t addr, uint32_t hint) {
+    long    r = find_region(ex, addr, hint);   /* region holding target */
+
+    if ( r < 0 || ex.regions[r].claimed(addr) ) return;
+
+    ex.pending.fetch_add(1);
+    {
+        std :: lock_guard <std :: mutex> g(w.lock);
+        w.queue.push_back(Target(addr, r));
+    }
+
+    if ( ex.idle.load() ) wake_workers(ex, false);
+}
+
+/* FUNCTION: next_target
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	id	: index of calling worker
+ * 	t	: receives target
+ * PROCESS:
+ * 	a) pop newest target of own queue, depth first keeps a function's blocks together
+ * 	b) otherwise steal oldest target of another worker
+ * RETURN VALUE:
+ * 	bool : TRUE if a target was found
+ */
+static bool
+next_target(Explorer &ex, unsigned id, Target &t) {
+    for ( unsigned k = 0; k < ex.nworkers; ++k ) {
+        Worker  &w = ex.workers[( id + k ) % ex.nworkers];
+
+        std :: lock_guard <std :: mutex> g(w.lock);
+        if ( w.queue.empty() ) continue;
+        if ( k == 0 ) {
+            t = w.queue.back();
+            w.queue.pop_back();
+        } else {
+            t = w.queue.front();
+            w.queue.pop_front();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/* FUNCTION: ends_flow
+ * INPUT ARGUMENTS:
+ * 	dis	: handler to capstone api
+ * 	insn	: decoded instruction
+ * RETURN VALUE:
+ * 	bool : TRUE if execution does not continue at following instruction
+ */
+static bool
+ends_flow(csh dis, cs_insn *insn) {
+    switch ( insn -> id ) {
+        case X86_INS_JMP:
+        case X86_INS_LJMP:
+        case X86_INS_HLT:
+        case X86_INS_UD2:
+        case X86_INS_INT3:
+            return true;
+        default:
+            return cs_insn_group(dis, insn, CS_GRP_RET) || cs_insn_group(dis, insn, CS_GRP_IRET);
+    }
+}
+
+/* FUNCTION: explore_flow
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	w	: calling worker
+ * 	dis	: handler to capstone api of worker
+ * 	insn	: reusable instruction of worker
+ * 	t	: address to decode from
+ * PROCESS:
+ * 	a) claim and decode instructions one after another, stopping at addresses
+ * 	   already claimed, undecodable bytes, the end of the section and
+ * 	   instructions after which execution does not fall through
+ * 	b) queue immediate targets of jumps and calls
+ * RETURN VALUE: NONE
+ */
+static void
+explore_flow(Explorer &ex, Worker &w, csh dis, cs_insn *insn, Target t) {
+    CodeRegion      &reg = ex.regions[t.second];
+    uint64_t        addr = t.first;     /* address of next instruction */
+    const uint8_t   *pc;                /* next byte to decode */
+    size_t          n;                  /* bytes left in section */
+    cs_x86          *x86;               /* operands of instruction */
+    Found           f;                  /* record of decoded instruction */
+    PhaseTimer      timer(Metrics :: PHASE_DECODE);
+
+    while ( reg.sec -> contains(addr) && reg.claim(addr) ) {
+        pc = reg.bytes + ( addr - reg.sec -> vma );
+        n  = reg.sec -> size - ( addr - reg.sec -> vma );
+
+        if ( !cs_disasm_iter(dis, &pc, &n, &addr, insn) ) break;
+
+        f.addr      = insn -> address;
+        f.region    = t.second;
+        f.size      = insn -> size;
+        f.mnemonic  = w.strings.add(insn -> mnemonic);
+        f.op_str    = w.strings.add(insn -> op_str);
+        w.found.push_back(f);
+
+        if ( cs_insn_group(dis, insn, CS_GRP_JUMP) || cs_insn_group(dis, insn, CS_GRP_CALL) ) {
+            x86 = &insn -> detail -> x86;
+            if ( x86 -> op_count > 0 && x86 -> operands[0].type == X86_OP_IMM )
+                push_target(ex, w, x86 -> operands[0].imm, t.second);
+        }
+
+        if ( ends_flow(dis, insn) ) break;
+    }
+}
+
+/* FUNCTION: explore
+ * INPUT ARGUMENTS:
+ * 	ex	: shared state of recursive descent
+ * 	id	: index of worker
+ * PROCESS:
+ * 	a) acquire thread's capstone handle with instruction details
+ * 	b) decode flows from own or stolen targets until no target is queued or
+ * 	   being decoded by any worker
+ * 	c) with every queue empty, park until a target is queued or exploration ends;
+ * 	   the worker finishing the last target wakes all others
+ * RETURN VALUE: NONE
+ */
+static void
+explore(Explorer &ex, unsigned id) {
+    DisasmHandle    *h;     /* capstone handle of worker */
+    Target          t;      /* address being decoded from */
+    bool            got;    /* a target was found */
+
+    if ( !( h = acquire_handle(ex.mode, true) ) ) {
+        ex.failed = true;
+        wake_workers(ex, true);
+        return;
+    }
+
+    for ( ;; ) {
+        got = next_target(ex, id, t);
+        if ( !got ) {
+            std :: unique_lock <std :: mutex> g(ex.idle_lock);
+
+            /* a target queued after this worker counts itself idle is seen below or signalled */
+            ex.idle.fetch_add(1);
+            while ( ex.pending.load() > 0 && !ex.failed && !( got = next_target(ex, id, t) ) )
+                ex.idle_cv.wait(g);
+            ex.idle.fetch_sub(1);
+        }
+        if ( !got || ex.failed ) break;
+
+        explore_flow(ex, ex.workers[id], h -> dis, h -> insn, t);
+        if ( ex.pending.fetch_sub(1) == 1 ) wake_workers(ex, true);
+    }
+}
+
+/* FUNCTION: print_coverage
+ * INPUT ARGUMENTS:
+ * 	name	: name of section, NULL for total
+ * 	size	: bytes of section
+ * 	covered	: bytes covered by decoded instructions
+ * 	ninsns	: number of decoded instructions
+ * PROCESS:
+ * 	a) print one row of coverage table, or a coverage record
+ * RETURN VALUE: NONE
+ */
+static void
+print_coverage(const char *name, uint64_t size, uint64_t covered, uint64_t ninsns) {
+    uint64_t    pct;    /* covered share in hundredths of a percent */
+
+    if ( out_format != OutputBuffer :: FMT_TEXT ) {
+        if ( name ) emit_coverage(*out, name, size, covered, ninsns);
+        return;
+    }
+
+    pct = size ? covered * 10000 / size : 0;
+
+    out -> put(' ');
+    out -> str(name ? name : "TOTAL", -20);
+    out -> put(' ');
+    out -> dec(size, 12);
+    out -> put(' ');
+    out -> dec(covered, 12);
+    out -> put(' ');
+    out -> dec(pct / 100, 4);
+    out -> put('.');
+    out -> put('0' + pct / 10 % 10);
+    out -> put('0' + pct % 10);
+    out -> lit("% ");
+    out -> dec(ninsns, 12);
+    out -> put('\n');
+}
+
+/* FUNCITON: disasm_recursive
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	nthreads: number of workers
+ * PROCESS:
+ * 	a) collect code sections and their contents
+ * 	b) seed worker queues with entry point and function symbols, round robin, in
+ * 	   every region holding them (sections of object files share addresses)
+ * 	c) explore flows on 'nthreads' workers, idle workers steal targets from others
+ * 	d) sort decoded instructions by section and address and print them, a blank
+ * 	   line marking bytes not reached
+ * 	e) print bytes covered and instructions decoded per code section
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - disassembled
+ *		-1 - failure
+ */
+int
+disasm_recursive(Binary &bin, unsigned nthreads) {
+    Explorer                    ex;         /* shared state of workers */
+    std :: vector <std :: thread> threads;  /* worker threads */
+    std :: vector <Found>       all;        /* instructions of all workers */
+    std :: vector <uint64_t>    seeds;      /* entry point and function starts */
+    std :: vector <uint32_t>    funs;       /* function symbols, by address */
+    uint8_t                     *bytes;     /* contents of code section */
+    uint64_t                    hi;         /* end of furthest instruction printed */
+    uint64_t                    covered, total_covered, total_size, total_insns;
+    size_t                      i, j;       /* loop iterators */
+    long                        r;          /* region of seed */
+
+    for ( auto &sec : bin.sections )
+        if ( sec.type == Section :: SEC_TYPE_CODE && sec.size && ( bytes = sec.get_bytes() ) )
+            ex.regions.emplace_back(&sec, bytes);
+
+    if ( ex.regions.empty() ) {
+        fprintf(stderr, "Nothing to disassemble\n");
+        return 0;
+    }
+
+    std :: stable_sort(ex.regions.begin(), ex.regions.end(), [](const CodeRegion &a, const CodeRegion &b) {
+        return a.sec -> vma < b.sec -> vma;
+    });
+
+    ex.nworkers = nthreads ? nthreads : 1;
+    ex.workers.reset(new Worker[ex.nworkers]);
+    ex.pending  = 0;
+    ex.failed   = false;
+    ex.idle     = 0;
+    ex.mode     = disasm_mode(bin);
+
+    seeds.push_back(bin.entry);
+    bin.select_symbols(Symbol :: SYM_TYPE_FUN, funs, true);
+    for ( auto k : funs )
+        if ( bin.symbols[k].addr ) seeds.push_back(bin.symbols[k].addr);
+
+    for ( i = j = 0; i < seeds.size(); ++i ) {
+        for ( r = find_region_below(ex, seeds[i], ex.regions.size()); r >= 0; r = find_region_below(ex, seeds[i], r) ) {
+            ex.workers[j++ % ex.nworkers].queue.push_back(Target(seeds[i], r));
+            ex.pending.fetch_add(1);
+        }
+    }
+
+    for ( unsigned t = 1; t < ex.nworkers; ++t )
+        threads.push_back(std :: thread(explore, std :: ref(ex), t));
+    explore(ex, 0);
+    for ( auto &t : threads ) t.join();
+
+    if ( ex.failed ) return -1;
+
+    for ( unsigned t = 0; t < ex.nworkers; ++t )
+        all.insert(all.end(), ex.workers[t].found.begin(), ex.workers[t].found.end());
+    std :: sort(all.begin(), all.end(), [](const Found &a, const Found &b) {
+        return a.region != b.region ? a.region < b.region : a.addr < b.addr;
+    });
+    metrics.count(Metrics :: CNT_INSNS, all.size());
+
+    PhaseTimer  timer(Metrics :: PHASE_FORMAT);
+
+    /* instructions, grouped by section */
+    std :: vector <uint64_t>    sec_covered(ex.regions.size(), 0), sec_insns(ex.regions.size(), 0);
+    for ( i = 0; i < all.size(); ) {
+        CodeRegion  &reg = ex.regions[all[i].region];
+
+        if ( out_format == OutputBuffer :: FMT_TEXT ) {
+            red();
+            out -> lit("[*] Recursive disassembly of ");
+            out -> str(reg.sec -> name.c_str());
+            out -> lit(" section:\n");
+            reset_color();
+        }
+
+        covered = 0;
+        hi      = all[i].addr;
+        for ( j = i; j < all.size() && all[j].region == all[i].region; ++j ) {
+            Found   &f = all[j];
+
+            if ( f.addr > hi && out_format == OutputBuffer :: FMT_TEXT ) out -> put('\n');
+            format_insn(*out, f.addr, reg.bytes + ( f.addr - reg.sec -> vma ), f.size, f.mnemonic, f.op_str);
+
+            if ( f.addr + f.size > hi ) {
+                covered += f.addr + f.size - std :: max(hi, f.addr);
+                hi       = f.addr + f.size;
+            }
+        }
+
+        sec_covered[all[i].region]  = covered;
+        sec_insns[all[i].region]    = j - i;
+        i = j;
+    }
+
+    /* coverage of every code section, including those never reached */
+    if ( out_format == OutputBuffer :: FMT_TEXT ) {
+        red();
+        out -> lit("[*] Coverage of recursive disassembly (");
+        out -> dec(seeds.size());
+        out -> lit(" seeds):\n");
+        blue();
+        out -> lit(" SECTION                      SIZE      COVERED  PERCENT        INSNS\n");
+        reset_color();
+    }
+
+    total_covered = total_size = total_insns = 0;
+    for ( i = 0; i < ex.regions.size(); ++i ) {
+        print_coverage(ex.regions[i].sec -> name.c_str(), ex.regions[i].sec -> size, sec_covered[i], sec_insns[i]);
+        total_size      += ex.regions[i].sec -> size;
+        total_covered   += sec_covered[i];
+        total_insns     += sec_insns[i];
+    }
+    print_coverage(NULL, total_size, total_covered, total_insns);
+
+    return 0;
+}
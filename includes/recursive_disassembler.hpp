@@ -0,0 +1,10 @@
+#ifndef RECURSIVE_DISASSEMBLER_H
+#define RECURSIVE_DISASSEMBLER_H
+
+#include "loader.hpp"
+
+/* Perform recursive descent disassembly of code sections, starting at the entry point and
+ * function symbols and following direct branches and calls, using 'nthreads' workers */
+int disasm_recursive(Binary &bin, unsigned nthreads = 1);
+
+#endif /* RECURSIVE_DISASSEMBLER_H */
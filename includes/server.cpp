@@ -0,0 +1,663 @@
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "server.hpp"
+#include "loader.hpp"
+#include "output.hpp"
+#include "records.hpp"
+#include "linear_disassembler.hpp"
+#include "insn_stats.hpp"
+
+#define SYMBOL_COST		( sizeof(Symbol) + 64 )	/* approximate bytes per symbol, with its columns,
+							 * index entries and copied name */
+
+/* Loaded binary kept by the cache, with the identity of its file when loaded */
+struct CachedBinary {
+	std :: shared_ptr <Binary>		bin;	/* stays valid for requests holding it after eviction */
+	struct timespec				mtime;
+	off_t					size;
+	ino_t					ino;
+	dev_t					dev;
+	size_t					cost;	/* approximate bytes held by binary */
+	std :: list <std :: string> :: iterator	lru;	/* position in recency list */
+};
+
+/* Loaded binaries by canonical path, least recently used ones evicted beyond a memory budget */
+class BinaryCache {
+	public:
+		BinaryCache(size_t limit, int load_flags) : limit(limit), used(0), load_flags(load_flags) {}
+
+		/* Return binary at canonical path 'path', loading it if missing or changed, NULL on failure */
+		std :: shared_ptr <Binary> get(const std :: string &path, OutputBuffer &err);
+
+		/* Drop all binaries (requests still holding one keep it until done) */
+		void clear();
+
+	private:
+		std :: mutex					lock;		/* guards all members below */
+		std :: unordered_map <std :: string, CachedBinary> entries;
+		std :: list <std :: string>			recency;	/* paths, most recently used first */
+		size_t						limit;		/* memory budget in bytes */
+		size_t						used;		/* approximate bytes of cached binaries */
+		int						load_flags;	/* Binary :: LoadFlags of every load */
+
+		void erase(std :: unordered_map <std :: string, CachedBinary> :: iterator it);
+};
+
+/* Accepted connections waiting for a worker */
+struct ConnQueue {
+	std :: mutex			lock;
+	std :: condition_variable	ready;
+	std :: deque <int>		fds;
+	bool				closed;		/* no more connections, workers exit once drained */
+
+	ConnQueue() : closed(false) {}
+};
+
+/* A request verb and the query it runs on a loaded binary */
+struct Verb {
+	const char	*name;
+	bool		has_arg;	/* takes an argument before the path */
+	int		(*run)(Binary &bin, const char *arg);
+};
+
+static volatile sig_atomic_t	stopping;	/* set by SIGINT or SIGTERM */
+
+/* FUNCTION: footprint
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * PROCESS:
+ * 	a) add up file mapping, copied section contents and symbols with their indexes
+ * RETURN VALUE:
+ * 	static size_t : approximate bytes held by binary
+ */
+static size_t
+footprint(const Binary &bin) {
+	size_t	n;	/* bytes counted */
+
+	n = bin.map_size + bin.symbols.size() * SYMBOL_COST;
+	for ( auto &sec : bin.sections ) {
+		n += sizeof(Section) + sec.name.size();
+		if ( sec.flags & Section :: SEC_FLAG_MALLOC ) n += sec.size;
+	}
+
+	return n;
+}
+
+/* FUNCTION: same_file
+ * INPUT ARGUMENTS:
+ * 	e	: cached binary
+ * 	st	: current status of its file
+ * RETURN VALUE:
+ * 	static bool : file is unchanged since binary was loaded
+ */
+static bool
+same_file(const CachedBinary &e, const struct stat &st) {
+	return e.mtime.tv_sec == st.st_mtim.tv_sec && e.mtime.tv_nsec == st.st_mtim.tv_nsec
+	       && e.size == st.st_size && e.ino == st.st_ino && e.dev == st.st_dev;
+}
+
+/* FUNCTION: BinaryCache :: erase
+ * INPUT ARGUMENTS:
+ * 	it	: entry to drop, caller holds lock
+ * RETURN VALUE: NONE
+ */
+void
+BinaryCache :: erase(std :: unordered_map <std :: string, CachedBinary> :: iterator it) {
+	used -= it -> second.cost;
+	recency.erase(it -> second.lru);
+	entries.erase(it);
+}
+
+/* FUNCTION: BinaryCache :: get
+ * INPUT ARGUMENTS:
+ * 	path	: canonical path of binary
+ * 	err	: receives error message on failure
+ * PROCESS:
+ * 	a) look up path, dropping its entry when the file's modification time, size or inode
+ * 	   changed since it was loaded
+ * 	b) on a hit, move entry to front of recency list
+ * 	c) on a miss, load binary without holding the lock (sections are retrieved at once, so
+ * 	   that requests sharing the binary never modify it, libbfd loads read them under the
+ * 	   single bfd_lock hold of load_binary_bfd()), then insert it unless a concurrent
+ * 	   request loaded the same file meanwhile
+ * 	d) evict least recently used binaries until the budget is met, keeping the new one
+ * RETURN VALUE:
+ * 	std :: shared_ptr <Binary> : loaded binary, NULL on failure
+ */
+std :: shared_ptr <Binary>
+BinaryCache :: get(const std :: string &path, OutputBuffer &err) {
+	struct stat			st;	/* status of file */
+	std :: shared_ptr <Binary>	bin;	/* binary returned */
+	CachedBinary			e;	/* entry of loaded binary */
+	std :: string			fname;	/* path passed to loader */
+
+	if ( stat(path.c_str(), &st) < 0 ) {
+		err.lit("[!!] Failed to stat '");
+		err.str(path.c_str());
+		err.lit("' (");
+		err.str(strerror(errno));
+		err.lit(")\n");
+
+		std :: lock_guard <std :: mutex> g(lock);
+		auto it = entries.find(path);
+		if ( it != entries.end() ) erase(it);
+		return NULL;
+	}
+
+	{
+		std :: lock_guard <std :: mutex> g(lock);
+		auto it = entries.find(path);
+		if ( it != entries.end() ) {
+			if ( same_file(it -> second, st) ) {
+				recency.splice(recency.begin(), recency, it -> second.lru);
+				return it -> second.bin;
+			}
+			erase(it);
+		}
+	}
+
+	bin = std :: shared_ptr <Binary> (new Binary(), [](Binary *b) {
+		unload_binary(b);
+		delete b;
+	});
+	fname = path;
+	if ( load_binary(fname, bin.get(), Binary :: BIN_TYPE_AUTO, load_flags & ~Binary :: LOAD_LAZY) < 0 ) {
+		err.lit("[!!] Failed to load '");
+		err.str(path.c_str());
+		err.lit("'\n");
+		return NULL;
+	}
+
+	e.bin	= bin;
+	e.mtime	= st.st_mtim;
+	e.size	= st.st_size;
+	e.ino	= st.st_ino;
+	e.dev	= st.st_dev;
+	e.cost	= footprint(*bin);
+
+	std :: lock_guard <std :: mutex> g(lock);
+	auto it = entries.find(path);
+	if ( it != entries.end() ) {
+		if ( same_file(it -> second, st) ) return it -> second.bin;
+		erase(it);
+	}
+
+	recency.push_front(path);
+	e.lru = recency.begin();
+	entries.emplace(path, e);
+	used += e.cost;
+
+	while ( used > limit && recency.size() > 1 )
+		erase(entries.find(recency.back()));
+
+	return bin;
+}
+
+/* FUNCTION: BinaryCache :: clear
+ * RETURN VALUE: NONE
+ */
+void
+BinaryCache :: clear() {
+	std :: lock_guard <std :: mutex> g(lock);
+	entries.clear();
+	recency.clear();
+	used = 0;
+}
+
+/* FUNCTION: run_header
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * RETURN VALUE:
+ * 	static int : 0
+ */
+static int
+run_header(Binary &bin, const char *) {
+	print_binary_header(bin);
+	return 0;
+}
+
+/* FUNCTION: run_symbol
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * 	arg	: address looked up
+ * PROCESS:
+ * 	a) find symbol with greatest address not above the address
+ * 	b) print it with the offset of the address into it, or a symbol record
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - invalid address, or no symbol below it
+ */
+static int
+run_symbol(Binary &bin, const char *arg) {
+	Symbol		*sym;		/* symbol found */
+	uint64_t	addr;		/* address looked up */
+	uint64_t	off;		/* offset of address into symbol */
+	int		digits;		/* hexadecimal digits of offset */
+	char		*end;		/* end of address in argument */
+
+	addr = strtoull(arg, &end, 0);
+	if ( end == arg || *end ) {
+		out -> lit("[!!] Invalid address '");
+		out -> str(arg);
+		out -> lit("'\n");
+		return -1;
+	}
+
+	if ( !( sym = bin.nearest_symbol(addr) ) ) {
+		out -> lit("[!!] No symbol at or below 0x");
+		out -> hex(addr, 16);
+		out -> put('\n');
+		return -1;
+	}
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_symbol(*out, sym -> name, sym -> addr, sym -> type, sym -> source);
+		return 0;
+	}
+
+	out -> lit(" 0x");
+	out -> hex(addr, 16);
+	out -> put(' ');
+	out -> str(sym -> name);
+	if ( addr != sym -> addr ) {
+		off = addr - sym -> addr;
+		for ( digits = 1; digits < 16 && off >> ( 4 * digits ); ++digits ) ;
+		out -> lit("+0x");
+		out -> hex(off, digits);
+	}
+	out -> put('\n');
+
+	return 0;
+}
+
+/* FUNCTION: run_disasm
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * 	arg	: symbol or address range
+ * RETURN VALUE:
+ * 	static int : status code of disasm_target()
+ */
+static int
+run_disasm(Binary &bin, const char *arg) {
+	return disasm_target(bin, arg);
+}
+
+/* FUNCTION: run_linear
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * RETURN VALUE:
+ * 	static int : status code of disasm(), on the worker's thread only
+ */
+static int
+run_linear(Binary &bin, const char *) {
+	return disasm(bin, 1);
+}
+
+/* FUNCTION: run_stats
+ * INPUT ARGUMENTS:
+ * 	bin	: loaded binary
+ * RETURN VALUE:
+ * 	static int : status code of disasm_stats(), on the worker's thread only
+ */
+static int
+run_stats(Binary &bin, const char *) {
+	return disasm_stats(bin, 1);
+}
+
+static const Verb verbs[] = {
+	{ "header", false, run_header },
+	{ "symbol", true,  run_symbol },
+	{ "disasm", true,  run_disasm },
+	{ "linear", false, run_linear },
+	{ "stats",  false, run_stats },
+};
+
+/* FUNCTION: write_all
+ * INPUT ARGUMENTS:
+ * 	fd	: connected socket
+ * 	p	: bytes to send
+ * 	n	: number of bytes
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - peer went away
+ */
+static int
+write_all(int fd, const char *p, size_t n) {
+	ssize_t	w;	/* bytes sent by one call */
+
+	while ( n > 0 ) {
+		if ( ( w = send(fd, p, n, MSG_NOSIGNAL) ) < 0 ) {
+			if ( errno == EINTR ) continue;
+			return -1;
+		}
+		p += w;
+		n -= w;
+	}
+
+	return 0;
+}
+
+/* FUNCTION: read_request
+ * INPUT ARGUMENTS:
+ * 	fd	: connected socket
+ * 	line	: receives request line, without terminator
+ * RETURN VALUE:
+ * 	static int : status code
+ * 		 0 - success
+ * 		-1 - connection closed, timed out or line too long
+ */
+static int
+read_request(int fd, std :: string &line) {
+	char	buf[256];	/* bytes received by one call */
+	ssize_t	n;		/* number of bytes received */
+	char	*nl;		/* line terminator */
+
+	line.clear();
+	while ( line.size() < MAX_REQUEST_LEN ) {
+		if ( ( n = recv(fd, buf, sizeof(buf), 0) ) < 0 ) {
+			if ( errno == EINTR ) continue;
+			return -1;
+		}
+		if ( n == 0 ) return line.empty() ? -1 : 0;	/* last line may lack terminator */
+		if ( ( nl = (char *) memchr(buf, '\n', n) ) ) {
+			line.append(buf, nl - buf);
+			return 0;
+		}
+		line.append(buf, n);
+	}
+
+	return -1;
+}
+
+/* FUNCTION: handle
+ * INPUT ARGUMENTS:
+ * 	fd	: connected socket
+ * 	cache	: loaded binaries
+ * PROCESS:
+ * 	a) read request line, split off verb, argument (if the verb takes one) and path
+ * 	b) get binary of canonical path from cache
+ * 	c) run query with output of calling thread streamed to the socket, behind a
+ * 	   status byte reserved at the start of the buffer
+ * 	d) set status byte while it is still buffered: output larger than the buffer
+ * 	   goes out with status '0', a failure after that ends with its error message
+ * RETURN VALUE: NONE
+ */
+static void
+handle(int fd, BinaryCache &cache) {
+	std :: string			line;		/* request line */
+	std :: string			arg;		/* argument of verb */
+	const Verb			*verb;		/* verb requested */
+	char				real[PATH_MAX];	/* canonical path of binary */
+	std :: shared_ptr <Binary>	bin;		/* binary queried */
+	OutputBuffer			sock(fd);	/* reply, written to socket as it fills */
+	char				*status;	/* status byte, first in buffer */
+	size_t				p, q;		/* ends of words in request line */
+	int				ret;		/* status of query */
+
+	if ( read_request(fd, line) < 0 ) return;
+
+	status  = sock.reserve(1);
+	*status = '0';
+	sock.advance(1);
+
+	ret  = -1;
+	verb = NULL;
+	p = line.find(' ');
+	for ( auto &v : verbs )
+		if ( p != std :: string :: npos && !line.compare(0, p, v.name) ) verb = &v;
+
+	if ( !verb ) {
+		sock.lit("[!!] Unknown request '");
+		sock.write(line.data(), std :: min <size_t> (line.size(), 64));
+		sock.lit("'\n");
+	} else {
+		++p;
+		if ( verb -> has_arg ) {
+			q = line.find(' ', p);
+			if ( q != std :: string :: npos ) {
+				arg = line.substr(p, q - p);
+				p = q + 1;
+			} else {
+				p = line.size();
+			}
+		}
+
+		if ( p >= line.size() ) {
+			sock.lit("[!!] Missing path in request\n");
+		} else if ( !realpath(line.c_str() + p, real) ) {
+			sock.lit("[!!] Failed to resolve '");
+			sock.str(line.c_str() + p);
+			sock.lit("' (");
+			sock.str(strerror(errno));
+			sock.lit(")\n");
+		} else if ( ( bin = cache.get(real, sock) ) ) {
+			out = &sock;
+			if ( out_format != OutputBuffer :: FMT_TEXT )
+				emit_binary(*out, *bin);
+			ret = verb -> run(*bin, arg.c_str());
+			out = &stdout_buf;
+		}
+	}
+
+	/* nothing flushed yet, so the buffer was never moved or reused */
+	if ( !sock.written() ) *status = ( ret == 0 ) ? '0' : '1';
+	sock.flush();
+}
+
+/* FUNCTION: on_signal
+ * RETURN VALUE: NONE
+ */
+static void
+on_signal(int) {
+	stopping = 1;
+}
+
+/* FUNCTION: open_socket
+ * INPUT ARGUMENTS:
+ * 	path	: path of unix socket
+ * 	addr	: receives address of socket
+ * RETURN VALUE:
+ * 	static int : socket descriptor, -1 on failure
+ */
+static int
+open_socket(const char *path, struct sockaddr_un *addr) {
+	int	fd;	/* unix socket */
+
+	if ( strlen(path) >= sizeof(addr -> sun_path) ) {
+		fprintf(stderr, "[!!] Socket path '%s' is too long\n", path);
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr -> sun_family = AF_UNIX;
+	strcpy(addr -> sun_path, path);
+
+	if ( ( fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) ) < 0 )
+		fprintf(stderr, "[!!] Failed to create socket (%s)\n", strerror(errno));
+
+	return fd;
+}
+
+/* FUNCTION: serve
+ * INPUT ARGUMENTS:
+ * 	path		: path of unix socket to listen on
+ * 	nthreads	: number of workers answering requests
+ * 	cache_size	: memory budget of loaded binaries in bytes
+ * 	load_flags	: Binary :: LoadFlags binaries are loaded with (lazy loading is ignored)
+ * PROCESS:
+ * 	a) refuse to start if a server already answers on path, else replace stale socket
+ * 	b) bind and listen, stop on SIGINT or SIGTERM
+ * 	c) start workers taking accepted connections from a queue
+ * 	d) accept connections, giving each a bounded time to send its request
+ * 	e) on interruption, let workers drain the queue, remove socket and drop cache
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - stopped by signal
+ * 		-1 - failure
+ */
+int
+serve(const char *path, unsigned nthreads, size_t cache_size, int load_flags) {
+	int				fd, conn;	/* listening and accepted sockets */
+	struct sockaddr_un		addr;		/* address of socket */
+	struct sigaction		sa;		/* handler of stopping signals */
+	struct timeval			tv;		/* timeout of request */
+	BinaryCache			cache(cache_size, load_flags);
+	ConnQueue			queue;		/* accepted connections */
+	std :: vector <std :: thread>	workers;	/* answering threads */
+
+	if ( ( fd = open_socket(path, &addr) ) < 0 ) return -1;
+
+	if ( connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 ) {
+		fprintf(stderr, "[!!] A server already listens on '%s'\n", path);
+		close(fd);
+		return -1;
+	}
+	if ( errno == ECONNREFUSED ) unlink(path);
+
+	if ( bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SERVER_BACKLOG) < 0 ) {
+		fprintf(stderr, "[!!] Failed to listen on '%s' (%s)\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	/* no SA_RESTART, so that accept() returns once interrupted */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if ( nthreads < 1 ) nthreads = 1;
+	for ( unsigned t = 0; t < nthreads; ++t ) {
+		workers.push_back(std :: thread([&]() {
+			int	c;	/* connection taken */
+
+			for ( ;; ) {
+				{
+					std :: unique_lock <std :: mutex> g(queue.lock);
+					queue.ready.wait(g, [&]() { return queue.closed || !queue.fds.empty(); });
+					if ( queue.fds.empty() ) return;
+					c = queue.fds.front();
+					queue.fds.pop_front();
+				}
+				handle(c, cache);
+				close(c);
+			}
+		}));
+	}
+
+	fprintf(stderr, "[*] Listening on '%s' with %u workers\n", path, nthreads);
+
+	tv.tv_sec  = REQUEST_TIMEOUT;
+	tv.tv_usec = 0;
+	while ( !stopping ) {
+		if ( ( conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC) ) < 0 ) {
+			if ( errno == EINTR || errno == ECONNABORTED ) continue;
+			fprintf(stderr, "[!!] Failed to accept connection (%s)\n", strerror(errno));
+			break;
+		}
+		setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+		std :: lock_guard <std :: mutex> g(queue.lock);
+		queue.fds.push_back(conn);
+		queue.ready.notify_one();
+	}
+
+	{
+		std :: lock_guard <std :: mutex> g(queue.lock);
+		queue.closed = true;
+		queue.ready.notify_all();
+	}
+	for ( auto &w : workers ) w.join();
+
+	close(fd);
+	unlink(path);
+	cache.clear();
+
+	return stopping ? 0 : -1;
+}
+
+/* FUNCTION: query
+ * INPUT ARGUMENTS:
+ * 	path	: path of unix socket server listens on
+ * 	argc	: number of words of request
+ * 	argv	: verb, argument (if any) and path of binary
+ * PROCESS:
+ * 	a) make path of binary absolute, as the server may run in another directory
+ * 	b) connect, send request line and close sending side
+ * 	c) read status byte, copy rest of reply to standard output, or to standard error
+ * 	   on failure
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - request succeeded
+ * 		-1 - failure
+ */
+int
+query(const char *path, int argc, char **argv) {
+	int			fd;		/* connected socket */
+	struct sockaddr_un	addr;		/* address of socket */
+	std :: string		line;		/* request line */
+	char			real[PATH_MAX];	/* canonical path of binary */
+	char			buf[OUT_BUF_SIZE];	/* reply bytes received by one call */
+	char			status;		/* status byte of reply */
+	ssize_t			n;		/* number of bytes received */
+	int			dst;		/* descriptor reply is copied to */
+
+	if ( argc < 2 ) return -1;
+
+	for ( int i = 0; i < argc - 1; ++i ) {
+		line += argv[i];
+		line += ' ';
+	}
+	line += realpath(argv[argc - 1], real) ? real : argv[argc - 1];
+	line += '\n';
+
+	if ( ( fd = open_socket(path, &addr) ) < 0 ) return -1;
+	if ( connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ) {
+		fprintf(stderr, "[!!] Failed to connect to '%s' (%s)\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if ( write_all(fd, line.data(), line.size()) < 0 || shutdown(fd, SHUT_WR) < 0
+	     || recv(fd, &status, 1, MSG_WAITALL) != 1 ) {
+		fprintf(stderr, "[!!] Server on '%s' closed connection\n", path);
+		close(fd);
+		return -1;
+	}
+
+	dst = status == '0' ? STDOUT_FILENO : STDERR_FILENO;
+	while ( ( n = recv(fd, buf, sizeof(buf), 0) ) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			break;
+		}
+		if ( write(dst, buf, n) != n ) break;
+	}
+
+	close(fd);
+
+	return status == '0' ? 0 : -1;
+}
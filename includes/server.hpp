@@ -0,0 +1,30 @@
+#ifndef BIN_SERVER_H
+#define BIN_SERVER_H
+
+#include <cstddef>
+
+#define SERVER_CACHE_SIZE	( (size_t) 1 << 30 )	/* default bytes of loaded binaries kept by server */
+#define SERVER_BACKLOG		64			/* connections waiting to be accepted */
+#define MAX_REQUEST_LEN		4096			/* longest request line, including path */
+#define REQUEST_TIMEOUT		5			/* seconds a client may take to send its request */
+
+/* Protocol: a client connects, sends one request line and reads the reply until the server
+ * closes the connection. A request is 'VERB [ARG] PATH\n', PATH taking the rest of the line:
+ * 	header PATH		sections and symbols (as -x)
+ * 	symbol ADDR PATH	symbol with greatest address not above ADDR
+ * 	disasm TARGET PATH	disassembly of symbol or START:END range (as -s)
+ * 	linear PATH		linear disassembly of .text (as -l)
+ * 	stats PATH		instruction statistics (as -S)
+ * A reply is one status byte ('0' success, '1' failure) followed by the output of the request,
+ * in the output format of the server, or by an error message. Output is streamed: once more
+ * than OUT_BUF_SIZE bytes are sent the status stays '0', a later failure ends with its message */
+
+/* Listen on unix socket 'path', answering requests on 'nthreads' workers from binaries kept
+ * loaded in a cache of about 'cache_size' bytes, until interrupted */
+int serve(const char *path, unsigned nthreads, size_t cache_size, int load_flags);
+
+/* Send request made of 'argc' words of 'argv' (the last one a path, made absolute) to server
+ * listening on 'path', copy reply to standard output (or error message to standard error) */
+int query(const char *path, int argc, char **argv);
+
+#endif /* BIN_SERVER_H */
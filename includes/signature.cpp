@@ -0,0 +1,493 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <immintrin.h>
+#include "signature.hpp"
+#include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+
+/* A range of anchor positions of a section scanned by one worker */
+struct SearchJob {
+	uint32_t	sec;		/* index of section */
+	uint64_t	start;		/* offset of first anchor position */
+	uint64_t	end;		/* offset past last anchor position */
+};
+
+/* Signature found in a section */
+struct SigMatch {
+	uint32_t	sec;		/* index of section */
+	uint32_t	sig;		/* index of signature */
+	uint64_t	off;		/* offset of match in section */
+};
+
+/* FUNCTION: nibble
+ * INPUT ARGUMENTS:
+ * 	c	: hexadecimal digit or '?'
+ * 	v	: receives value of digit
+ * 	m	: receives mask of digit, 0 for '?'
+ * RETURN VALUE:
+ * 	static bool : character is a digit or '?'
+ */
+static bool
+nibble(char c, uint8_t *v, uint8_t *m) {
+	*m = 0xf;
+	if ( c >= '0' && c <= '9' )		*v = c - '0';
+	else if ( c >= 'a' && c <= 'f' )	*v = c - 'a' + 10;
+	else if ( c >= 'A' && c <= 'F' )	*v = c - 'A' + 10;
+	else if ( c == '?' )			*v = *m = 0;
+	else					return false;
+	return true;
+}
+
+/* FUNCTION: SignatureSet :: add
+ * INPUT ARGUMENTS:
+ * 	pattern	: hex digits of signature, '?' for any nibble, blanks ignored
+ * PROCESS:
+ * 	a) pair nibbles into byte values and masks
+ * 	b) pick longest run of fully literal bytes as anchor, cut to SIG_ANCHOR_MAX bytes
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - success
+ * 		-1 - odd number of nibbles, bad character, too long or no literal byte
+ */
+int
+SignatureSet :: add(const char *pattern) {
+	Signature	sig;		/* signature parsed */
+	uint8_t		v[2], m[2];	/* value and mask of nibbles of a byte */
+	int		k;		/* nibbles of current byte */
+	uint32_t	run;		/* length of run of literal bytes ending at current byte */
+
+	sig.text = pattern;
+	k = 0;
+	for ( const char *p = pattern; *p; ++p ) {
+		if ( *p == ' ' || *p == '\t' ) continue;
+		if ( !nibble(*p, &v[k], &m[k]) ) goto bad;
+		if ( ++k < 2 ) continue;
+		sig.value.push_back(v[0] << 4 | v[1]);
+		sig.mask.push_back(m[0] << 4 | m[1]);
+		k = 0;
+	}
+	if ( k || sig.value.empty() || sig.value.size() > SIG_MAX_LEN ) goto bad;
+
+	sig.anchor = sig.anchor_len = run = 0;
+	for ( uint32_t i = 0; i < sig.mask.size(); ++i ) {
+		run = sig.mask[i] == 0xff ? run + 1 : 0;
+		if ( run > sig.anchor_len ) {
+			sig.anchor	= i + 1 - run;
+			sig.anchor_len	= run;
+		}
+	}
+	if ( !sig.anchor_len ) goto bad;
+	if ( sig.anchor_len > SIG_ANCHOR_MAX ) sig.anchor_len = SIG_ANCHOR_MAX;
+
+	sigs.push_back(sig);
+	return 0;
+
+bad:
+	fprintf(stderr, "[!!] Invalid signature '%s'\n", pattern);
+	return -1;
+}
+
+/* FUNCTION: SignatureSet :: add_file
+ * INPUT ARGUMENTS:
+ * 	fname	: file of patterns
+ * PROCESS:
+ * 	a) read lines, dropping comments, line terminators and blank lines
+ * 	b) add pattern of each remaining line
+ * RETURN VALUE:
+ * 	int : status code
+ * 		 0 - success
+ * 		-1 - file unreadable or a pattern malformed
+ */
+int
+SignatureSet :: add_file(const char *fname) {
+	FILE	*f;		/* pattern file */
+	char	*line;		/* line read from file */
+	size_t	cap;		/* capacity of 'line' */
+	ssize_t	n;		/* length of line */
+	char	*hash;		/* start of comment */
+	int	ret;		/* status code */
+
+	if ( !( f = fopen(fname, "r") ) ) {
+		fprintf(stderr, "[!!] Failed to open '%s' (%s)\n", fname, strerror(errno));
+		return -1;
+	}
+
+	line = NULL;
+	cap  = 0;
+	ret  = 0;
+	while ( ret == 0 && ( n = getline(&line, &cap, f) ) >= 0 ) {
+		if ( ( hash = strchr(line, '#') ) ) n = hash - line;
+		while ( n > 0 && strchr(" \t\r\n", line[n - 1]) ) --n;
+		line[n] = '\0';
+		if ( line[strspn(line, " \t")] ) ret = add(line);
+	}
+
+	free(line);
+	fclose(f);
+
+	return ret;
+}
+
+/* FUNCTION: add_nibbles
+ * INPUT ARGUMENTS:
+ * 	lo, hi	: nibble tables of a byte set
+ * 	b	: byte added to set
+ * PROCESS:
+ * 	a) put byte in bucket of its high nibble modulo 8, a byte tests positive if its low
+ * 	   nibble was added to the bucket of its high nibble (high nibbles h and h + 8 share
+ * 	   a bucket, the only source of false positives)
+ * RETURN VALUE: NONE
+ */
+static void
+add_nibbles(uint8_t *lo, uint8_t *hi, uint8_t b) {
+	lo[b & 0xf] |= 1 << ( ( b >> 4 ) & 7 );
+	hi[b >> 4]  |= 1 << ( ( b >> 4 ) & 7 );
+}
+
+/* FUNCTION: SignatureSet :: compile
+ * PROCESS:
+ * 	a) fill prefilter sets with first and second byte of every anchor (any second byte
+ * 	   when an anchor is a single byte), in exact and nibble table form
+ * 	b) insert anchors in trie, recording at the last node of each the signatures it anchors
+ * RETURN VALUE: NONE
+ */
+void
+SignatureSet :: compile() {
+	int32_t		node;		/* trie node walked */
+	uint8_t		b;		/* anchor byte */
+	bool		any_second;	/* an anchor has a single byte */
+
+	memset(first, 0, sizeof(first));
+	memset(second, 0, sizeof(second));
+	memset(lo1, 0, sizeof(lo1));
+	memset(hi1, 0, sizeof(hi1));
+	memset(lo2, 0, sizeof(lo2));
+	memset(hi2, 0, sizeof(hi2));
+	trie.assign(256, -1);
+	matches.assign(1, std :: vector <uint32_t> ());
+
+	any_second = false;
+	for ( uint32_t s = 0; s < sigs.size(); ++s ) {
+		const Signature &sig = sigs[s];
+
+		first[sig.value[sig.anchor]] = 1;
+		add_nibbles(lo1, hi1, sig.value[sig.anchor]);
+		if ( sig.anchor_len > 1 ) {
+			second[sig.value[sig.anchor + 1]] = 1;
+			add_nibbles(lo2, hi2, sig.value[sig.anchor + 1]);
+		} else {
+			any_second = true;
+		}
+
+		node = 0;
+		for ( uint32_t i = 0; i < sig.anchor_len; ++i ) {
+			b = sig.value[sig.anchor + i];
+			if ( trie[node * 256 + b] < 0 ) {
+				trie[node * 256 + b] = matches.size();
+				trie.resize(trie.size() + 256, -1);
+				matches.push_back(std :: vector <uint32_t> ());
+			}
+			node = trie[node * 256 + b];
+		}
+		matches[node].push_back(s);
+	}
+
+	if ( any_second ) {
+		memset(second, 1, sizeof(second));
+		memset(lo2, 0xff, sizeof(lo2));
+		memset(hi2, 0xff, sizeof(hi2));
+	}
+}
+
+/* FUNCTION: prefilter_scalar
+ * INPUT ARGUMENTS:
+ * 	set	: compiled signatures
+ * 	p	: first position tested
+ * 	n	: number of positions tested
+ * 	avail	: bytes readable from 'p' (at least 'n')
+ * 	cands	: receives offsets from 'p' of candidate anchor positions
+ * PROCESS:
+ * 	a) keep positions whose byte may start an anchor and whose next byte (if any) may
+ * 	   follow it
+ * RETURN VALUE: NONE
+ */
+static void
+prefilter_scalar(const SignatureSet &set, const uint8_t *p, size_t n, size_t avail, std :: vector <uint32_t> &cands) {
+	for ( size_t i = 0; i < n; ++i )
+		if ( set.first[p[i]] && ( i + 1 >= avail || set.second[p[i + 1]] ) ) cands.push_back(i);
+}
+
+/* FUNCTION: prefilter_ssse3
+ * INPUT ARGUMENTS:
+ * 	set	: compiled signatures
+ * 	p	: first position tested
+ * 	n	: number of positions tested
+ * 	avail	: bytes readable from 'p' (at least 'n')
+ * 	cands	: receives offsets from 'p' of candidate anchor positions
+ * PROCESS:
+ * 	a) look up low and high nibbles of 16 bytes (and of the 16 following them by one)
+ * 	   in nibble tables with pshufb, a position is a candidate when both lookups of
+ * 	   both bytes share a bucket
+ * 	b) test last positions with the scalar kernel
+ * RETURN VALUE: NONE
+ */
+__attribute__((target("ssse3")))
+static void
+prefilter_ssse3(const SignatureSet &set, const uint8_t *p, size_t n, size_t avail, std :: vector <uint32_t> &cands) {
+	const __m128i	lo1  = _mm_loadu_si128((const __m128i *) set.lo1);
+	const __m128i	hi1  = _mm_loadu_si128((const __m128i *) set.hi1);
+	const __m128i	lo2  = _mm_loadu_si128((const __m128i *) set.lo2);
+	const __m128i	hi2  = _mm_loadu_si128((const __m128i *) set.hi2);
+	const __m128i	nib  = _mm_set1_epi8(0x0f);
+	const __m128i	zero = _mm_setzero_si128();
+	__m128i		a, b;		/* bytes at positions and following positions */
+	__m128i		ma, mb;		/* buckets of 'a' and 'b' */
+	uint32_t	bits;		/* candidate positions of block */
+	size_t		i;		/* first position of block */
+
+	for ( i = 0; i + 16 <= n && i + 17 <= avail; i += 16 ) {
+		a  = _mm_loadu_si128((const __m128i *) ( p + i ));
+		b  = _mm_loadu_si128((const __m128i *) ( p + i + 1 ));
+		ma = _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(a, nib)),
+		                   _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(a, 4), nib)));
+		mb = _mm_and_si128(_mm_shuffle_epi8(lo2, _mm_and_si128(b, nib)),
+		                   _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(b, 4), nib)));
+		bits = ~_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(ma, zero), _mm_cmpeq_epi8(mb, zero))) & 0xffff;
+		for ( ; bits; bits &= bits - 1 ) cands.push_back(i + __builtin_ctz(bits));
+	}
+
+	size_t	base = cands.size();
+	prefilter_scalar(set, p + i, n - i, avail - i, cands);
+	for ( size_t j = base; j < cands.size(); ++j ) cands[j] += i;
+}
+
+/* FUNCTION: prefilter_avx2
+ * INPUT ARGUMENTS:
+ * 	set	: compiled signatures
+ * 	p	: first position tested
+ * 	n	: number of positions tested
+ * 	avail	: bytes readable from 'p' (at least 'n')
+ * 	cands	: receives offsets from 'p' of candidate anchor positions
+ * PROCESS:
+ * 	a) same as prefilter_ssse3() on 32 bytes at a time, nibble tables are repeated in
+ * 	   both 128 bit lanes as vpshufb looks up within a lane
+ * 	b) test last positions with the scalar kernel
+ * RETURN VALUE: NONE
+ */
+__attribute__((target("avx2")))
+static void
+prefilter_avx2(const SignatureSet &set, const uint8_t *p, size_t n, size_t avail, std :: vector <uint32_t> &cands) {
+	const __m256i	lo1  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set.lo1));
+	const __m256i	hi1  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set.hi1));
+	const __m256i	lo2  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set.lo2));
+	const __m256i	hi2  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) set.hi2));
+	const __m256i	nib  = _mm256_set1_epi8(0x0f);
+	const __m256i	zero = _mm256_setzero_si256();
+	__m256i		a, b;		/* bytes at positions and following positions */
+	__m256i		ma, mb;		/* buckets of 'a' and 'b' */
+	uint32_t	bits;		/* candidate positions of block */
+	size_t		i;		/* first position of block */
+
+	for ( i = 0; i + 32 <= n && i + 33 <= avail; i += 32 ) {
+		a  = _mm256_loadu_si256((const __m256i *) ( p + i ));
+		b  = _mm256_loadu_si256((const __m256i *) ( p + i + 1 ));
+		ma = _mm256_and_si256(_mm256_shuffle_epi8(lo1, _mm256_and_si256(a, nib)),
+		                      _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(a, 4), nib)));
+		mb = _mm256_and_si256(_mm256_shuffle_epi8(lo2, _mm256_and_si256(b, nib)),
+		                      _mm256_shuffle_epi8(hi2, _mm256_and_si256(_mm256_srli_epi16(b, 4), nib)));
+		bits = ~_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(ma, zero), _mm256_cmpeq_epi8(mb, zero)));
+		for ( ; bits; bits &= bits - 1 ) cands.push_back(i + __builtin_ctz(bits));
+	}
+
+	size_t	base = cands.size();
+	prefilter_scalar(set, p + i, n - i, avail - i, cands);
+	for ( size_t j = base; j < cands.size(); ++j ) cands[j] += i;
+}
+
+/* FUNCTION: select_prefilter
+ * PROCESS:
+ * 	a) pick widest prefilter kernel supported by the running cpu
+ * RETURN VALUE:
+ * 	pointer to prefilter kernel
+ */
+static void (*select_prefilter())(const SignatureSet &, const uint8_t *, size_t, size_t, std :: vector <uint32_t> &) {
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) return prefilter_avx2;
+	if ( __builtin_cpu_supports("ssse3") ) return prefilter_ssse3;
+	return prefilter_scalar;
+}
+
+static void (*const prefilter)(const SignatureSet &, const uint8_t *, size_t, size_t, std :: vector <uint32_t> &) = select_prefilter();
+
+/* FUNCTION: scan_range
+ * INPUT ARGUMENTS:
+ * 	set	: compiled signatures
+ * 	sec	: section scanned, contents retrieved
+ * 	job	: anchor positions scanned
+ * 	cands	: scratch space for candidate positions
+ * 	found	: receives matches
+ * PROCESS:
+ * 	a) collect candidate anchor positions of the range with the prefilter kernel
+ * 	b) from each candidate, walk trie of anchors over following bytes
+ * 	c) for each signature anchored at a node reached, compare all its bytes under its mask,
+ * 	   the match may start before and end after the range but not outside the section
+ * RETURN VALUE: NONE
+ */
+static void
+scan_range(const SignatureSet &set, Section &sec, const SearchJob &job, std :: vector <uint32_t> &cands, std :: vector <SigMatch> &found) {
+	const uint8_t	*bytes;		/* contents of section */
+	uint64_t	pos;		/* candidate anchor position */
+	uint64_t	start;		/* offset signature would start at */
+	int32_t		node;		/* trie node reached */
+
+	bytes = sec.bytes;
+	cands.clear();
+	prefilter(set, bytes + job.start, job.end - job.start, sec.size - job.start, cands);
+
+	for ( auto c : cands ) {
+		pos  = job.start + c;
+		node = 0;
+		for ( uint64_t i = pos; i < sec.size; ++i ) {
+			if ( ( node = set.trie[node * 256 + bytes[i]] ) < 0 ) break;
+
+			for ( auto s : set.matches[node] ) {
+				const Signature &sig = set.sigs[s];
+				size_t k;
+
+				if ( pos < sig.anchor || sec.size - ( start = pos - sig.anchor ) < sig.value.size() ) continue;
+				for ( k = 0; k < sig.value.size(); ++k )
+					if ( ( bytes[start + k] & sig.mask[k] ) != sig.value[k] ) break;
+				if ( k == sig.value.size() ) found.push_back(SigMatch { job.sec, s, start });
+			}
+		}
+	}
+}
+
+/* FUNCTION: print_match
+ * INPUT ARGUMENTS:
+ * 	bin	: binary searched
+ * 	set	: compiled signatures
+ * 	m	: match found
+ * PROCESS:
+ * 	a) find symbol with greatest address not above the match
+ * 	b) print address, section, symbol with offset into it and signature, or a match record
+ * RETURN VALUE: NONE
+ */
+static void
+print_match(Binary &bin, const SignatureSet &set, const SigMatch &m) {
+	Section		&sec = bin.sections[m.sec];
+	uint64_t	addr;		/* address of match */
+	Symbol		*sym;		/* symbol containing match */
+	const char	*name;		/* name of symbol, empty if none */
+	uint64_t	off;		/* offset of match into symbol */
+	char		hex[24];	/* offset of match into symbol, formatted */
+	std :: string	where;		/* symbol and offset of match */
+
+	addr = sec.vma + m.off;
+	sym  = bin.nearest_symbol(addr);
+	name = sym ? sym -> name : "";
+	off  = sym ? addr - sym -> addr : 0;
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_match(*out, m.sig, set.sigs[m.sig].text.c_str(), sec.name.c_str(), addr, name, off);
+		return;
+	}
+
+	yellow();
+	out -> lit(" 0x");
+	out -> hex(addr, 16);
+	reset_color();
+	out -> put(' ');
+	out -> str(sec.name.c_str(), -20);
+	out -> put(' ');
+	where = sym ? name : "-";
+	if ( off ) {
+		snprintf(hex, sizeof(hex), "+0x%llx", (unsigned long long) off);
+		where += hex;
+	}
+	out -> str(where.c_str(), -MAX_SYM_NAME_LEN);
+	out -> put(' ');
+	out -> str(set.sigs[m.sig].text.c_str());
+	out -> put('\n');
+}
+
+/* FUNCITON: search_signatures
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	set	: compiled signatures
+ * 	nthreads: number of workers
+ * PROCESS:
+ * 	a) retrieve contents of every section and cut them into ranges of SEARCH_CHUNK_SIZE
+ * 	   anchor positions
+ * 	b) scan ranges on 'nthreads' workers, each collecting matches of its own
+ * 	c) sort matches by section, address and signature and print them
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - searched
+ *		-1 - section contents could not be retrieved
+ */
+int
+search_signatures(Binary &bin, const SignatureSet &set, unsigned nthreads) {
+	std :: vector <SearchJob>			jobs;		/* ranges to scan */
+	std :: vector <std :: vector <SigMatch> >	per;		/* matches of each worker */
+	std :: vector <std :: thread>			workers;	/* scanning threads */
+	std :: atomic <size_t>				next(0);	/* next job to take */
+	std :: vector <SigMatch>			all;		/* matches of all workers */
+
+	for ( uint32_t s = 0; s < bin.sections.size(); ++s ) {
+		Section &sec = bin.sections[s];
+
+		if ( !sec.size ) continue;
+		if ( !sec.get_bytes() ) return -1;
+		for ( uint64_t off = 0; off < sec.size; off += SEARCH_CHUNK_SIZE )
+			jobs.push_back(SearchJob { s, off, std :: min <uint64_t> (off + SEARCH_CHUNK_SIZE, sec.size) });
+	}
+
+	if ( nthreads < 1 ) nthreads = 1;
+	if ( nthreads > jobs.size() ) nthreads = jobs.size() ? jobs.size() : 1;
+	per.resize(nthreads);
+
+	auto work = [&](unsigned id) {
+		std :: vector <uint32_t>	cands;	/* candidate positions of job */
+		size_t				j;	/* job taken */
+
+		while ( ( j = next.fetch_add(1) ) < jobs.size() )
+			scan_range(set, bin.sections[jobs[j].sec], jobs[j], cands, per[id]);
+	};
+
+	for ( unsigned t = 1; t < nthreads; ++t ) workers.push_back(std :: thread(work, t));
+	work(0);
+	for ( auto &w : workers ) w.join();
+
+	for ( auto &p : per ) all.insert(all.end(), p.begin(), p.end());
+	std :: sort(all.begin(), all.end(), [](const SigMatch &a, const SigMatch &b) {
+		if ( a.sec != b.sec ) return a.sec < b.sec;
+		if ( a.off != b.off ) return a.off < b.off;
+		return a.sig < b.sig;
+	});
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		red();
+		out -> lit("[*] Signature matches in '");
+		out -> str(bin.filename.c_str());
+		out -> lit("' (");
+		out -> dec(all.size());
+		out -> lit(" matches of ");
+		out -> dec(set.sigs.size());
+		out -> lit(" signatures):\n");
+		blue();
+		out -> lit(" ADDRESS            SECTION              SYMBOL");
+		for ( int i = 6; i < MAX_SYM_NAME_LEN; ++i ) out -> put(' ');
+		out -> lit(" SIGNATURE\n");
+		reset_color();
+	}
+	for ( auto &m : all ) print_match(bin, set, m);
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef BIN_SIGNATURE_H
+#define BIN_SIGNATURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "loader.hpp"
+
+#define SIG_MAX_LEN		256		/* longest signature in bytes */
+#define SIG_ANCHOR_MAX		16		/* longest run of literal bytes of a signature used as anchor */
+#define SEARCH_CHUNK_SIZE	0x10000		/* bytes of a section scanned as one unit of work */
+
+/* Byte signature parsed from hex digits, '?' standing for any nibble ("48 8b 05 ?? ?? ?? ??") */
+struct Signature {
+	std :: string			text;		/* pattern as given */
+	std :: vector <uint8_t>		value;		/* bits compared of each byte */
+	std :: vector <uint8_t>		mask;		/* bits of each byte compared, 0 for a wildcard */
+	uint32_t			anchor;		/* offset of longest run of literal bytes */
+	uint32_t			anchor_len;	/* length of that run (at most SIG_ANCHOR_MAX) */
+};
+
+/* Signatures searched together: a prefilter on the first two bytes of every anchor finds
+ * candidate positions, a trie of anchors tells which signatures to verify at each of them */
+class SignatureSet {
+	public:
+		std :: vector <Signature>		sigs;
+
+		/* Prefilter: exact byte sets, and nibble tables of the same sets for vector kernels
+		 * (byte b is in a set if lo[b & 0xf] & hi[b >> 4] is non-zero) */
+		uint8_t					first[256];	/* first byte of an anchor */
+		uint8_t					second[256];	/* second byte of an anchor, all if an anchor has one byte */
+		uint8_t					lo1[16], hi1[16];
+		uint8_t					lo2[16], hi2[16];
+
+		/* Trie of anchors, 256 children per node (-1 if none), node 0 is the root */
+		std :: vector <int32_t>			trie;
+		std :: vector <std :: vector <uint32_t> > matches;	/* signatures whose anchor ends at node */
+
+		/* Parse 'pattern' and add it, return -1 if malformed */
+		int add(const char *pattern);
+
+		/* Add patterns read from 'fname', one per line, '#' starting a comment */
+		int add_file(const char *fname);
+
+		/* Build prefilter and trie once all signatures are added */
+		void compile();
+};
+
+/* Scan contents of every section of 'bin' for signatures of 'set' on 'nthreads' workers and
+ * report each match with its section, address and nearest symbol */
+int search_signatures(Binary &bin, const SignatureSet &set, unsigned nthreads = 1);
+
+#endif /* BIN_SIGNATURE_H */
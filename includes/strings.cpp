@@ -0,0 +1,386 @@
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+#include "strings.hpp"
+#include "ansi_colors.hpp"
+#include "output.hpp"
+#include "records.hpp"
+
+/* A range of a section whose strings are found by one worker, strings starting in the
+ * range belong to it even when they extend past its end */
+struct StringJob {
+	Section		*sec;		/* section scanned, contents retrieved */
+	uint64_t	start;		/* offset of range in section */
+	uint64_t	end;		/* offset past range */
+	OutputBuffer	out;		/* strings of range, formatted */
+	bool		done;		/* range scanned, 'out' ready to print */
+
+	StringJob(Section *sec, uint64_t start, uint64_t end) : sec(sec), start(start), end(end), out(-1, 0), done(false) {}
+};
+
+/* String found in a range */
+struct StringRun {
+	uint64_t	off;		/* offset of first byte in section */
+	uint64_t	size;		/* bytes of string (two per UTF-16LE character) */
+	uint8_t		enc;		/* STR_ASCII or STR_UTF16LE */
+};
+
+/* FUNCTION: printable
+ * INPUT ARGUMENTS:
+ * 	c	: byte or UTF-16 code unit
+ * RETURN VALUE:
+ * 	static bool : character is printable ASCII or tab
+ */
+static inline bool
+printable(uint32_t c) {
+	return c == '\t' || ( c >= 0x20 && c < 0x7f );
+}
+
+/* FUNCTION: classify_tail
+ * INPUT ARGUMENTS:
+ * 	p	: bytes to classify
+ * 	i	: first byte not classified yet, a multiple of 64
+ * 	n	: number of bytes
+ * 	wide	: classify UTF-16LE code units at even offsets instead of bytes
+ * 	bits	: receives one bit per byte, set if printable (both bits of a printable unit)
+ * RETURN VALUE: NONE
+ */
+static void
+classify_tail(const uint8_t *p, size_t i, size_t n, bool wide, uint64_t *bits) {
+	uint64_t	w;	/* bits of last word */
+	size_t		base;	/* first byte of last word */
+
+	if ( i >= n ) return;
+
+	w    = 0;
+	base = i;
+	if ( wide ) {
+		for ( ; i + 2 <= n; i += 2 )
+			if ( printable(p[i] | p[i + 1] << 8) ) w |= (uint64_t) 3 << ( i - base );
+	} else {
+		for ( ; i < n; ++i )
+			if ( printable(p[i]) ) w |= (uint64_t) 1 << ( i - base );
+	}
+	bits[base >> 6] = w;
+}
+
+/* FUNCTION: classify_sse2
+ * INPUT ARGUMENTS:
+ * 	p	: bytes to classify
+ * 	n	: number of bytes
+ * 	wide	: classify UTF-16LE code units at even offsets instead of bytes
+ * 	bits	: receives one bit per byte, set if printable (both bits of a printable unit)
+ * PROCESS:
+ * 	a) compare 16 bytes (or 8 code units) at a time against the printable range with
+ * 	   signed compares (bytes above 0x7f and units above 0x7fff are negative), or tab
+ * 	b) gather comparison masks of 64 bytes into a word of 'bits'
+ * 	c) classify last bytes with the scalar test
+ * RETURN VALUE: NONE
+ */
+static void
+classify_sse2(const uint8_t *p, size_t n, bool wide, uint64_t *bits) {
+	const __m128i	lo8  = _mm_set1_epi8(0x1f),  hi8  = _mm_set1_epi8(0x7f),  tab8  = _mm_set1_epi8('\t');
+	const __m128i	lo16 = _mm_set1_epi16(0x1f), hi16 = _mm_set1_epi16(0x7f), tab16 = _mm_set1_epi16('\t');
+	__m128i		v, m;		/* bytes and their printable mask */
+	uint64_t	w;		/* bits of 64 bytes */
+	size_t		i;		/* first byte of word */
+
+	for ( i = 0; i + 64 <= n; i += 64 ) {
+		w = 0;
+		for ( int k = 0; k < 4; ++k ) {
+			v = _mm_loadu_si128((const __m128i *) ( p + i + 16 * k ));
+			if ( wide )
+				m = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi16(v, lo16), _mm_cmpgt_epi16(hi16, v)),
+				                 _mm_cmpeq_epi16(v, tab16));
+			else
+				m = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(v, lo8), _mm_cmpgt_epi8(hi8, v)),
+				                 _mm_cmpeq_epi8(v, tab8));
+			w |= (uint64_t) (uint32_t) _mm_movemask_epi8(m) << ( 16 * k );
+		}
+		bits[i >> 6] = w;
+	}
+
+	classify_tail(p, i, n, wide, bits);
+}
+
+/* FUNCTION: classify_avx2
+ * INPUT ARGUMENTS:
+ * 	p	: bytes to classify
+ * 	n	: number of bytes
+ * 	wide	: classify UTF-16LE code units at even offsets instead of bytes
+ * 	bits	: receives one bit per byte, set if printable (both bits of a printable unit)
+ * PROCESS:
+ * 	a) same as classify_sse2() on 32 bytes at a time
+ * 	b) classify last bytes with the scalar test
+ * RETURN VALUE: NONE
+ */
+__attribute__((target("avx2")))
+static void
+classify_avx2(const uint8_t *p, size_t n, bool wide, uint64_t *bits) {
+	const __m256i	lo8  = _mm256_set1_epi8(0x1f),  hi8  = _mm256_set1_epi8(0x7f),  tab8  = _mm256_set1_epi8('\t');
+	const __m256i	lo16 = _mm256_set1_epi16(0x1f), hi16 = _mm256_set1_epi16(0x7f), tab16 = _mm256_set1_epi16('\t');
+	__m256i		v, m;		/* bytes and their printable mask */
+	uint64_t	w;		/* bits of 64 bytes */
+	size_t		i;		/* first byte of word */
+
+	for ( i = 0; i + 64 <= n; i += 64 ) {
+		w = 0;
+		for ( int k = 0; k < 2; ++k ) {
+			v = _mm256_loadu_si256((const __m256i *) ( p + i + 32 * k ));
+			if ( wide )
+				m = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi16(v, lo16), _mm256_cmpgt_epi16(hi16, v)),
+				                    _mm256_cmpeq_epi16(v, tab16));
+			else
+				m = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi8(v, lo8), _mm256_cmpgt_epi8(hi8, v)),
+				                    _mm256_cmpeq_epi8(v, tab8));
+			w |= (uint64_t) (uint32_t) _mm256_movemask_epi8(m) << ( 32 * k );
+		}
+		bits[i >> 6] = w;
+	}
+
+	classify_tail(p, i, n, wide, bits);
+}
+
+/* FUNCTION: select_classify
+ * PROCESS:
+ * 	a) pick widest classification kernel supported by the running cpu (SSE2 is part
+ * 	   of x86-64)
+ * RETURN VALUE:
+ * 	pointer to classification kernel
+ */
+static void (*select_classify())(const uint8_t *, size_t, bool, uint64_t *) {
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports("avx2") ) return classify_avx2;
+	return classify_sse2;
+}
+
+static void (*const classify)(const uint8_t *, size_t, bool, uint64_t *) = select_classify();
+
+/* FUNCTION: next_bit
+ * INPUT ARGUMENTS:
+ * 	bits	: bitmap
+ * 	i	: first position searched
+ * 	n	: number of positions
+ * 	set	: search a set bit, else a clear one
+ * RETURN VALUE:
+ * 	static size_t : first position from 'i' holding the bit searched, 'n' if none
+ */
+static size_t
+next_bit(const uint64_t *bits, size_t i, size_t n, bool set) {
+	uint64_t	w;	/* word holding position */
+
+	while ( i < n ) {
+		w = set ? bits[i >> 6] : ~bits[i >> 6];
+		w &= ~(uint64_t) 0 << ( i & 63 );
+		if ( w ) return std :: min(n, ( i & ~(size_t) 63 ) + __builtin_ctzll(w));
+		i = ( i | 63 ) + 1;
+	}
+
+	return n;
+}
+
+/* FUNCTION: find_runs
+ * INPUT ARGUMENTS:
+ * 	sec	: section scanned
+ * 	base	: offset of first byte classified
+ * 	end	: offset past last position owned by range
+ * 	wide	: find UTF-16LE strings made of code units at 'base' + 2k
+ * 	min_len	: shortest string reported, in characters
+ * 	bits	: scratch space for bitmap
+ * 	runs	: receives strings found
+ * PROCESS:
+ * 	a) classify bytes (or code units) of range with kernel selected for the running cpu
+ * 	b) walk runs of set bits, skipping a leading run continuing a string of the
+ * 	   previous range and extending a trailing run past the range while printable
+ * 	c) keep runs of at least 'min_len' characters
+ * RETURN VALUE: NONE
+ */
+static void
+find_runs(Section *sec, uint64_t base, uint64_t end, bool wide, size_t min_len,
+          std :: vector <uint64_t> &bits, std :: vector <StringRun> &runs) {
+	const uint8_t	*bytes;		/* contents of section */
+	size_t		n;		/* bytes classified */
+	size_t		unit;		/* bytes per character */
+	size_t		r, e;		/* start and end of run in bitmap */
+	uint64_t	s, t;		/* start and end of run in section */
+
+	bytes = sec -> bytes;
+	unit  = wide ? 2 : 1;
+	if ( base >= end ) return;
+
+	/* a code unit starting in range may end one byte past it */
+	n = std :: min <uint64_t> (end + unit - 1, sec -> size) - base;
+	if ( wide ) n &= ~(size_t) 1;
+	bits.assign(( n + 63 ) / 64, 0);
+	classify(bytes + base, n, wide, bits.data());
+
+	for ( r = 0; ( r = next_bit(bits.data(), r, n, true) ) < n; r = e ) {
+		e = next_bit(bits.data(), r, n, false);
+		s = base + r;
+		t = base + e;
+
+		if ( r == 0 && s >= unit && printable(wide ? bytes[s - 2] | bytes[s - 1] << 8 : bytes[s - 1]) )
+			continue;
+		if ( e == n )
+			while ( t + unit <= sec -> size && printable(wide ? bytes[t] | bytes[t + 1] << 8 : bytes[t]) )
+				t += unit;
+
+		if ( ( t - s ) / unit >= min_len ) runs.push_back(StringRun { s, t - s, (uint8_t) ( wide ? STR_UTF16LE : STR_ASCII ) });
+	}
+}
+
+/* FUNCTION: print_string
+ * INPUT ARGUMENTS:
+ * 	sec	: section holding string
+ * 	run	: string found
+ * 	text	: scratch space for characters of string
+ * PROCESS:
+ * 	a) narrow UTF-16LE code units to their ASCII characters
+ * 	b) print address, section, encoding and string, or a string record
+ * RETURN VALUE: NONE
+ */
+static void
+print_string(Section *sec, const StringRun &run, std :: string &text) {
+	const char	*p;		/* characters of string */
+	size_t		n;		/* number of characters */
+
+	p = (const char *) sec -> bytes + run.off;
+	n = run.size;
+	if ( run.enc == STR_UTF16LE ) {
+		n /= 2;
+		text.resize(n);
+		for ( size_t i = 0; i < n; ++i ) text[i] = p[2 * i];
+		p = text.data();
+	}
+
+	if ( out_format != OutputBuffer :: FMT_TEXT ) {
+		emit_string(*out, sec -> name.c_str(), sec -> vma + run.off, run.enc, p, n);
+		return;
+	}
+
+	yellow();
+	out -> lit(" 0x");
+	out -> hex(sec -> vma + run.off, 16);
+	reset_color();
+	out -> put(' ');
+	out -> str(sec -> name.c_str(), -20);
+	if ( run.enc == STR_UTF16LE )
+		out -> lit(" utf16 ");
+	else
+		out -> lit(" ascii ");
+	out -> write(p, n);
+	out -> put('\n');
+}
+
+/* FUNCITON: extract_strings
+ * INPUT ARGUMENTS:
+ * 	bin	: binary file loaded
+ * 	min_len	: shortest string reported, in characters
+ * 	all	: scan every section instead of data sections only
+ * 	nthreads: number of workers
+ * PROCESS:
+ * 	a) retrieve contents of scanned sections and cut them into ranges of
+ * 	   STRINGS_CHUNK_SIZE bytes
+ * 	b) on 'nthreads' workers, find ASCII strings and UTF-16LE strings of both byte
+ * 	   alignments of each range, sort them by offset and format them into the range's
+ * 	   buffer; workers stay at most STRINGS_WINDOW ranges each ahead of output
+ * 	c) print buffers of ranges in order as they complete, releasing them
+ * RETURN VALUE:
+ *	int : statue code
+ *		 0 - scanned
+ *		-1 - section contents could not be retrieved
+ */
+int
+extract_strings(Binary &bin, size_t min_len, bool all, unsigned nthreads) {
+	std :: vector <StringJob>	jobs;		/* ranges to scan */
+	std :: mutex			lock;		/* guards 'next', 'emitted' and StringJob :: done */
+	std :: condition_variable	cv;		/* signalled whenever a range is scanned or printed */
+	std :: vector <std :: thread>	workers;	/* scanning threads */
+	size_t				next;		/* next range to hand to a worker */
+	size_t				emitted;	/* ranges printed so far */
+
+	if ( min_len < 1 ) min_len = 1;
+
+	for ( auto &sec : bin.sections ) {
+		if ( !sec.size || ( !all && sec.type != Section :: SEC_TYPE_DATA ) ) continue;
+		if ( !sec.get_bytes() ) return -1;
+		for ( uint64_t off = 0; off < sec.size; off += STRINGS_CHUNK_SIZE )
+			jobs.emplace_back(&sec, off, std :: min <uint64_t> (off + STRINGS_CHUNK_SIZE, sec.size));
+	}
+
+	if ( out_format == OutputBuffer :: FMT_TEXT ) {
+		red();
+		out -> lit("[*] Strings of at least ");
+		out -> dec(min_len);
+		if ( all )
+			out -> lit(" characters in all sections:\n");
+		else
+			out -> lit(" characters in data sections:\n");
+		blue();
+		out -> lit(" ADDRESS            SECTION              ENC   STRING\n");
+		reset_color();
+	}
+
+	next	= 0;
+	emitted	= 0;
+	if ( nthreads < 1 ) nthreads = 1;
+	if ( nthreads > jobs.size() ) nthreads = jobs.size();
+
+	for ( unsigned t = 0; t < nthreads; ++t ) {
+		workers.push_back(std :: thread([&]() {
+			std :: vector <uint64_t>	bits;	/* printable bitmap of range */
+			std :: vector <StringRun>	runs;	/* strings of range */
+			std :: string			text;	/* narrowed UTF-16LE string */
+			size_t				i;	/* range being scanned */
+
+			for ( ;; ) {
+				{
+					std :: unique_lock <std :: mutex> g(lock);
+					cv.wait(g, [&]() { return next < emitted + STRINGS_WINDOW * nthreads; });
+					if ( next >= jobs.size() ) break;
+					i = next++;
+				}
+
+				StringJob &job = jobs[i];
+				runs.clear();
+				find_runs(job.sec, job.start, job.end, false, min_len, bits, runs);
+				find_runs(job.sec, job.start, job.end, true, min_len, bits, runs);
+				find_runs(job.sec, job.start + 1, job.end, true, min_len, bits, runs);
+				std :: sort(runs.begin(), runs.end(), [](const StringRun &a, const StringRun &b) {
+					return a.off < b.off;
+				});
+
+				out = &job.out;
+				for ( auto &r : runs ) print_string(job.sec, r, text);
+				out = &stdout_buf;
+
+				std :: lock_guard <std :: mutex> g(lock);
+				job.done = true;
+				cv.notify_all();
+			}
+		}));
+	}
+
+	for ( auto &job : jobs ) {
+		{
+			std :: unique_lock <std :: mutex> g(lock);
+			cv.wait(g, [&]() { return job.done; });
+		}
+
+		out -> write(job.out.data(), job.out.size());
+		job.out.release();
+
+		std :: lock_guard <std :: mutex> g(lock);
+		++emitted;
+		cv.notify_all();
+	}
+
+	for ( auto &w : workers ) w.join();
+
+	return 0;
+}
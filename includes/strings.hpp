@@ -0,0 +1,16 @@
+#ifndef BIN_STRINGS_H
+#define BIN_STRINGS_H
+
+#include <cstddef>
+#include "loader.hpp"
+
+#define STRINGS_MIN_LEN		4		/* default shortest string reported, in characters */
+#define STRINGS_CHUNK_SIZE	0x40000		/* bytes of a section scanned as one unit of work (even) */
+#define STRINGS_WINDOW		4		/* chunks per worker allowed to run ahead of output */
+
+/* Report runs of at least 'min_len' printable ASCII characters (tab included) and of
+ * UTF-16LE code units in that range, found in data sections (all sections if 'all'),
+ * scanning chunks of sections on 'nthreads' workers */
+int extract_strings(Binary &bin, size_t min_len = STRINGS_MIN_LEN, bool all = false, unsigned nthreads = 1);
+
+#endif /* BIN_STRINGS_H */
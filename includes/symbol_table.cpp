@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "loader.hpp"
+
+/* FUNCTION: SymbolTable :: build
+ * INPUT ARGUMENTS:
+ * 	symbols	: symbols of binary
+ * PROCESS:
+ * 	a) copy address, type and name of each symbol into its column
+ * RETURN VALUE: NONE
+ */
+void
+SymbolTable :: build(const std :: vector <Symbol> &symbols) {
+	size_t	i;	/* loop iterator */
+
+	clear();
+	addr.resize(symbols.size());
+	type.resize(symbols.size());
+	name.resize(symbols.size());
+
+	for ( i = 0; i < symbols.size(); ++i ) {
+		addr[i]	= symbols[i].addr;
+		type[i]	= symbols[i].type;
+		name[i]	= symbols[i].name;
+	}
+}
+
+/* FUNCTION: SymbolTable :: filter
+ * INPUT ARGUMENTS:
+ * 	mask	: Symbol :: SymbolType flags, 0 selects every symbol
+ * 	idx	: receives indices of matching symbols
+ * PROCESS:
+ * 	a) test type flags of 16 symbols at once, turning matches into a bit mask
+ * 	b) append index of each set bit
+ * 	c) test remaining symbols one at a time
+ * RETURN VALUE: NONE
+ */
+void
+SymbolTable :: filter(uint8_t mask, std :: vector <uint32_t> &idx) const {
+	size_t		i, n;		/* loop iterator, number of symbols */
+	const uint8_t	*t;		/* type column */
+
+	n = type.size();
+	t = type.data();
+
+	if ( !mask ) {
+		for ( i = 0; i < n; ++i ) idx.push_back(i);
+		return;
+	}
+
+	i = 0;
+#ifdef __SSE2__
+	{
+		const __m128i	m    = _mm_set1_epi8((char) mask);
+		const __m128i	zero = _mm_setzero_si128();
+		unsigned	bits;	/* one bit per matching symbol */
+
+		for ( ; i + 16 <= n; i += 16 ) {
+			__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) ( t + i )), m);
+			bits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xffff;
+			for ( ; bits; bits &= bits - 1 )
+				idx.push_back(i + __builtin_ctz(bits));
+		}
+	}
+#endif
+	for ( ; i < n; ++i )
+		if ( t[i] & mask ) idx.push_back(i);
+}
+
+/* FUNCTION: SymbolTable :: sort_by_addr
+ * INPUT ARGUMENTS:
+ * 	idx	: indices of symbols, sorted in place
+ * PROCESS:
+ * 	a) pair each index with its address so comparisons touch contiguous memory
+ * 	b) sort pairs, ties are ordered by index which keeps sort stable
+ * 	c) write indices back
+ * RETURN VALUE: NONE
+ */
+void
+SymbolTable :: sort_by_addr(std :: vector <uint32_t> &idx) const {
+	std :: vector <std :: pair <uint64_t, uint32_t> >	keys;	/* (address, index) */
+	size_t							i;	/* loop iterator */
+
+	keys.resize(idx.size());
+	for ( i = 0; i < idx.size(); ++i ) keys[i] = std :: make_pair(addr[idx[i]], idx[i]);
+
+	std :: sort(keys.begin(), keys.end());
+
+	for ( i = 0; i < idx.size(); ++i ) idx[i] = keys[i].second;
+}
+
+/* FUNCTION: SymbolMerger :: SymbolMerger
+ * INPUT ARGUMENTS:
+ * 	bin	: binary receiving symbols
+ * 	nsyms	: upper bound of symbols to be added
+ * PROCESS:
+ * 	a) reserve room for symbols so appending never reallocates
+ * 	b) size hash table to at most half full, indexing symbols already present
+ * RETURN VALUE: NONE
+ */
+SymbolMerger :: SymbolMerger(Binary *bin, size_t nsyms) : bin(bin), used(0) {
+	size_t	nslots;		/* slots of hash table, power of two */
+
+	bin -> symbols.reserve(bin -> symbols.size() + nsyms);
+
+	for ( nslots = 16; nslots < 2 * ( bin -> symbols.size() + nsyms ); nslots <<= 1 );
+	rehash(nslots);
+}
+
+/* FUNCTION: SymbolMerger :: rehash
+ * INPUT ARGUMENTS:
+ * 	nslots	: new number of slots, power of two
+ * PROCESS:
+ * 	a) re-insert every symbol of binary into empty table
+ * RETURN VALUE: NONE
+ */
+void
+SymbolMerger :: rehash(size_t nslots) {
+	size_t	i, j;	/* symbol index, slot */
+
+	slots.assign(nslots, 0);
+	used = 0;
+	for ( i = 0; i < bin -> symbols.size(); ++i ) {
+		j = hash(bin -> symbols[i].name, bin -> symbols[i].addr) & ( nslots - 1 );
+		while ( slots[j] ) j = ( j + 1 ) & ( nslots - 1 );
+		slots[j] = i + 1;
+		++used;
+	}
+}
+
+/* FUNCTION: SymbolMerger :: add
+ * INPUT ARGUMENTS:
+ * 	name	: name of symbol
+ * 	addr	: address of symbol
+ * 	source	: table symbol was read from (Symbol :: SymbolSource)
+ * 	copy	: copy name into string arena of binary
+ * PROCESS:
+ * 	a) probe hash table for a symbol of same name and address
+ * 	b) if none, append symbol, copying its name if requested, and record it
+ * 	c) tag symbol with source table
+ * RETURN VALUE:
+ * 	Symbol * : symbol whose type flags are to be updated by caller
+ */
+Symbol *
+SymbolMerger :: add(const char *name, uint64_t addr, uint8_t source, bool copy) {
+	size_t	j;	/* slot */
+	Symbol	*sym;	/* matching or appended symbol */
+
+	if ( 2 * ( used + 1 ) > slots.size() ) rehash(slots.size() * 2);
+
+	for ( j = hash(name, addr) & ( slots.size() - 1 ); slots[j]; j = ( j + 1 ) & ( slots.size() - 1 ) ) {
+		sym = &bin -> symbols[slots[j] - 1];
+		if ( sym -> addr == addr && !strcmp(sym -> name, name) ) {
+			sym -> source |= source;
+			return sym;
+		}
+	}
+
+	bin -> symbols.push_back(Symbol());
+	sym = &bin -> symbols.back();
+	sym -> name	= copy ? bin -> names.add(name) : name;
+	sym -> addr	= addr;
+	sym -> source	= source;
+
+	slots[j] = bin -> symbols.size();
+	++used;
+
+	return sym;
+}
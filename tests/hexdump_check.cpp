@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+
+/* line kernels are static, build them into the driver */
+#include "../includes/hexdump.cpp"
+
+typedef void (*LineKernel)(char *, const uint8_t *, size_t);
+
+/* FUNCTION: reference_dump
+ * INPUT ARGUMENTS:
+ * 	src	: bytes to format
+ * 	size	: number of bytes
+ * PROCESS:
+ * 	a) format bytes the way the original printf based raw_dump() did: " %02x" per
+ * 	   byte, last line padded to MAX_LINE_LEN columns, two spaces, then characters
+ * 	   0x20-0x7f as is and anything else as '.'
+ * RETURN VALUE:
+ * 	std :: string : formatted lines
+ */
+static std :: string
+reference_dump(const uint8_t *src, size_t size) {
+	std :: string	s;			/* formatted lines */
+	char		line[MAX_LINE_LEN + 1];	/* characters of current line */
+	char		hex[4];			/* formatted byte */
+	char		ascii_code;		/* single character/byte */
+	size_t		i, j;			/* loop iterators */
+
+	for ( i = 0; i < size; ++i ) {
+		ascii_code = src[i];
+		snprintf(hex, sizeof(hex), " %02x", (uint8_t) ascii_code);
+		s += hex;
+
+		line[i % MAX_LINE_LEN] = (ascii_code >= 32 && ascii_code <=128) ? ascii_code : '.';
+
+		if ( ( i + 1 ) % MAX_LINE_LEN == 0 || i == size - 1 ) {
+			line[i % MAX_LINE_LEN + 1] = '\0';
+			for ( j = strlen(line); j < MAX_LINE_LEN; ++j )
+				s += "   ";
+			s += "  ";
+			s += line;
+			s += '\n';
+		}
+	}
+
+	return s;
+}
+
+/* FUNCTION: check
+ * INPUT ARGUMENTS:
+ * 	name	: name of line kernel
+ * 	kernel	: line kernel formatting full lines
+ * 	src	: bytes to format
+ * 	size	: number of bytes
+ * PROCESS:
+ * 	a) format full lines with kernel and last partial line with dump_partial_line()
+ * 	b) compare with reference_dump(), report first differing line
+ * RETURN VALUE:
+ * 	static int : 0 if output matches, 1 otherwise
+ */
+static int
+check(const char *name, LineKernel kernel, const uint8_t *src, size_t size) {
+	std :: vector <char>	dst;		/* formatted lines */
+	std :: string		got, want;	/* output of kernel and of reference */
+	size_t			nlines;		/* full lines */
+	size_t			len;		/* bytes formatted */
+	size_t			i;		/* first difference */
+
+	nlines = size / MAX_LINE_LEN;
+	dst.resize(( nlines + 1 ) * DUMP_LINE_LEN);
+	kernel(dst.data(), src, nlines);
+	len = nlines * DUMP_LINE_LEN;
+	if ( size % MAX_LINE_LEN )
+		len += dump_partial_line(dst.data() + len, src + nlines * MAX_LINE_LEN, size % MAX_LINE_LEN);
+
+	got.assign(dst.data(), len);
+	want = reference_dump(src, size);
+	if ( got == want ) return 0;
+
+	for ( i = 0; i < got.size() && i < want.size() && got[i] == want[i]; ++i );
+	i -= i % DUMP_LINE_LEN;
+	fprintf(stderr, "[!!] %s: %zu bytes differ from reference at line %zu\n", name, size, i / DUMP_LINE_LEN);
+	fprintf(stderr, "     got : %s", got.substr(i, DUMP_LINE_LEN).c_str());
+	fprintf(stderr, "     want: %s", want.substr(i, DUMP_LINE_LEN).c_str());
+
+	return 1;
+}
+
+/* FUNCTION: main
+ * PROCESS:
+ * 	a) collect kernels supported by the running cpu, scalar and dispatched ones always
+ * 	b) check every byte value in every column, then random buffers of lengths around
+ * 	   line and vector boundaries
+ * RETURN VALUE:
+ * 	int : 0 if every kernel matches the reference, 1 otherwise
+ */
+int
+main() {
+	struct Kernel {
+		const char	*name;
+		LineKernel	fn;
+	};
+	std :: vector <Kernel>	kernels;	/* kernels checked */
+	std :: vector <uint8_t>	buf;		/* input bytes */
+	std :: mt19937		rng(0x6865);	/* fixed seed, runs are reproducible */
+	static const size_t	lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 100, 255, 257, 1000, 4095, 4096, 4097, 65537 };
+	int			failed;		/* failed checks */
+	unsigned		nchecks;	/* checks run */
+
+	__builtin_cpu_init();
+	kernels.push_back({ "scalar", dump_lines_scalar });
+	if ( __builtin_cpu_supports("ssse3") ) kernels.push_back({ "ssse3", dump_lines_ssse3 });
+	else printf("[*] ssse3 not supported, skipped\n");
+	if ( __builtin_cpu_supports("avx2") ) kernels.push_back({ "avx2", dump_lines_avx2 });
+	else printf("[*] avx2 not supported, skipped\n");
+	kernels.push_back({ "dispatch", dump_lines });
+
+	failed  = 0;
+	nchecks = 0;
+
+	/* 256 byte values, rotated so each value lands in every column */
+	buf.resize(256);
+	for ( unsigned shift = 0; shift < MAX_LINE_LEN; ++shift ) {
+		for ( unsigned i = 0; i < 256; ++i ) buf[i] = (uint8_t) ( i + shift );
+		for ( auto &k : kernels ) {
+			failed += check(k.name, k.fn, buf.data(), buf.size());
+			++nchecks;
+		}
+	}
+
+	for ( size_t n : lengths ) {
+		buf.resize(n);
+		for ( auto &b : buf ) b = (uint8_t) rng();
+		for ( auto &k : kernels ) {
+			failed += check(k.name, k.fn, buf.data(), n);
+			++nchecks;
+		}
+	}
+
+	printf("[*] hexdump: %u checks, %d failed\n", nchecks, failed);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <csignal>
+#include <unistd.h>
+#include "../includes/loader.hpp"
+
+#define LOAD_TIMEOUT		10		/* seconds a load may take before it is deemed hung */
+
+/* Load flags checked, eager libbfd loads first: they once deadlocked on bfd_lock */
+static const struct {
+	const char	*name;
+	int		flags;
+} modes[] = {
+	{ "bfd",		Binary :: LOAD_BFD },
+	{ "bfd mmap",		Binary :: LOAD_BFD | Binary :: LOAD_MMAP },
+	{ "bfd lazy",		Binary :: LOAD_BFD | Binary :: LOAD_LAZY },
+	{ "bfd lazy mmap",	Binary :: LOAD_BFD | Binary :: LOAD_LAZY | Binary :: LOAD_MMAP },
+	{ "default",		Binary :: LOAD_DEFAULT },
+	{ "lazy",		Binary :: LOAD_LAZY },
+};
+
+static const char	*current;	/* mode being checked, reported on timeout */
+
+/* FUNCTION: on_alarm
+ * RETURN VALUE: NONE
+ */
+static void
+on_alarm(int) {
+	static const char	msg[] = " load did not return (deadlock on bfd_lock?)\n";
+
+	if ( write(STDERR_FILENO, "[!!] loader: ", 13) < 0
+	     || write(STDERR_FILENO, current, strlen(current)) < 0
+	     || write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0 ) {}
+	_exit(1);
+}
+
+/* FUNCTION: main
+ * INPUT ARGUMENTS:
+ * 	argv[1]	: binary to load, this program by default
+ * PROCESS:
+ * 	a) load binary with every mode of 'modes', failing if a load takes longer than
+ * 	   LOAD_TIMEOUT seconds
+ * 	b) retrieve contents of every section, then unload
+ * RETURN VALUE:
+ * 	int : 0 if every load returned and succeeded, 1 otherwise
+ */
+int
+main(int argc, char **argv) {
+	std :: string	fname;		/* binary loaded */
+	int		failed;		/* failed loads */
+
+	fname  = ( argc > 1 ) ? argv[1] : "/proc/self/exe";
+	failed = 0;
+	signal(SIGALRM, on_alarm);
+
+	for ( auto &m : modes ) {
+		Binary	bin;	/* binary loaded with this mode */
+
+		current = m.name;
+		alarm(LOAD_TIMEOUT);
+
+		if ( load_binary(fname, &bin, Binary :: BIN_TYPE_AUTO, m.flags) < 0 ) {
+			fprintf(stderr, "[!!] loader: %s load of '%s' failed\n", m.name, fname.c_str());
+			++failed;
+			continue;
+		}
+		for ( auto &sec : bin.sections ) {
+			if ( !sec.get_bytes() ) {
+				fprintf(stderr, "[!!] loader: %s load, contents of '%s' not retrieved\n", m.name, sec.name.c_str());
+				++failed;
+			}
+		}
+		unload_binary(&bin);
+
+		alarm(0);
+	}
+
+	printf("[*] loader: %zu modes, %d failed\n", sizeof(modes) / sizeof(modes[0]), failed);
+
+	return failed ? 1 : 0;
+}